@@ -0,0 +1,282 @@
+#include <Checkpoint.h>
+#include <Optimizer.h>
+#include <ParseSettings.h>
+#include <Profiler.h>
+#include <Relaxation.h>
+#include <Scene.h>
+#include <Trace.h>
+#include <Utility.h>
+
+#include "Flags.h"
+#include "MeshGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+/*
+ * Micro benchmarks of the stages of a rectification, run on generated meshes of increasing size to show how each stage scales with the number of helices.
+ * For every shape and size, a line gives the milliseconds spent reading the mesh, in the parser, setting up the helices and creating their rigid bodies,
+ * in one relaxation, in writing the result and in one gradient descent sweep trying two moves per helix. The fastest of --repeat runs is kept.
+ * A sweep relaxes the scene for every trial, so it is only run on meshes of up to --sweep_limit helices. Finally, every stage gets the exponent k of
+ * a least squares fit of time ~ helices^k over the sizes, per shape. The settings of the rectification, such as --engine or --max_steps, apply.
+ * Every size is run once per scene profile of --sim_profiles, by default only --sim_profile.
+ *
+ * With --generate=<shape>, a mesh of --edges edges is written to --output instead, as input for the rectification.
+ */
+
+namespace {
+	enum Stage {
+		kRead = 0, // All of scene::read_rmesh.
+		kParse = 1,
+		kSetupHelices = 2, // Excluding the rigid bodies.
+		kCreateRigidBodies = 3,
+		kRelaxation = 4,
+		kWrite = 5,
+		kSweep = 6,
+		kStageCount = 7
+	};
+
+	const char *kStageNames[kStageCount] = { "read", "parse", "setup_helices", "create_bodies", "relaxation", "write", "sweep" };
+	const char *kProfileNames[] = { "fast", "balanced", "accurate" };
+
+	struct settings_type {
+		std::vector<std::string> shapes;
+		std::vector<physics::Profile> profiles;
+		size_t min_edges, max_edges, sweep_limit;
+		unsigned int repeat;
+		double edge_length;
+		std::string generate;
+		size_t edges;
+	};
+
+	struct sample_type {
+		size_t helices;
+		unsigned int steps;
+		double milliseconds[kStageCount]; // Negative if not run.
+	};
+
+	void parse(int argc, const char **argv, const physics::settings_type & physics_settings, settings_type & settings) {
+		settings.shapes.clear();
+		settings.profiles.clear();
+		settings.min_edges = 100;
+		settings.max_edges = 100000;
+		settings.sweep_limit = 300;
+		settings.repeat = 1;
+		settings.edge_length = 10;
+		settings.edges = 1000;
+
+		std::string value("icosphere,torus,tube");
+		flags::get(argc, argv, "shapes", value);
+		std::istringstream shapes(value);
+		while (std::getline(shapes, value, ','))
+			settings.shapes.push_back(value);
+
+		if (flags::get(argc, argv, "sim_profiles", value)) {
+			std::istringstream profiles(value);
+			while (std::getline(profiles, value, ',')) {
+				const char **name(std::find_if(std::begin(kProfileNames), std::end(kProfileNames), [&value](const char *name) { return value == name; }));
+				if (name != std::end(kProfileNames))
+					settings.profiles.push_back(physics::Profile(name - std::begin(kProfileNames)));
+				else
+					std::cerr << "Unknown scene profile \"" << value << "\"" << std::endl;
+			}
+		} else
+			settings.profiles.push_back(physics_settings.profile);
+
+		if (flags::get(argc, argv, "min_edges", value))
+			settings.min_edges = size_t(atol(value.c_str()));
+		if (flags::get(argc, argv, "max_edges", value))
+			settings.max_edges = size_t(atol(value.c_str()));
+		if (flags::get(argc, argv, "sweep_limit", value))
+			settings.sweep_limit = size_t(atol(value.c_str()));
+		if (flags::get(argc, argv, "repeat", value))
+			settings.repeat = std::max(1, atoi(value.c_str()));
+		if (flags::get(argc, argv, "edge_length", value))
+			settings.edge_length = atof(value.c_str());
+		if (flags::get(argc, argv, "edges", value))
+			settings.edges = size_t(atol(value.c_str()));
+		flags::get(argc, argv, "generate", settings.generate);
+	}
+
+	// Stages are timed by the steady clock, as the real time clock trace::now reads outside Windows can jump.
+	inline double milliseconds(std::chrono::steady_clock::time_point begin) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+	/*
+	 * One run of every stage on the mesh. Returns false if the mesh could not be read.
+	 * The relaxation is created for the run, so that no run, repetition or profile is served configurations cached by another.
+	 */
+	bool run(physics & phys, const scene::settings_type & scene_settings, const Helix::settings_type & helix_settings, const relaxation::settings_type & relaxation_settings, const settings_type & settings,
+			const std::string & contents, sample_type & sample) {
+		const relaxation relax(relaxation_settings);
+		scene mesh(scene_settings, helix_settings);
+
+		profiler::reset();
+		std::chrono::steady_clock::time_point begin(std::chrono::steady_clock::now());
+		if (!mesh.read_rmesh(phys, contents.data(), contents.data() + contents.size()))
+			return false;
+
+		sample.milliseconds[kRead] = milliseconds(begin);
+		sample.milliseconds[kParse] = profiler::total(profiler::kParse) / 1e6;
+		sample.milliseconds[kSetupHelices] = (profiler::total(profiler::kSetupHelices) - profiler::total(profiler::kCreateRigidBody)) / 1e6;
+		sample.milliseconds[kCreateRigidBodies] = profiler::total(profiler::kCreateRigidBody) / 1e6;
+		sample.helices = mesh.getHelixCount();
+
+		begin = std::chrono::steady_clock::now();
+		sample.steps = relax.relax(mesh, phys, []() { return true; });
+		sample.milliseconds[kRelaxation] = milliseconds(begin);
+
+		const SceneDescription description(mesh);
+		std::ostringstream out;
+		begin = std::chrono::steady_clock::now();
+		description.write(out);
+		sample.milliseconds[kWrite] = milliseconds(begin);
+
+		sample.milliseconds[kSweep] = -1;
+		if (sample.helices <= settings.sweep_limit) {
+			checkpointer checkpoints(std::string(), 0);
+			begin = std::chrono::steady_clock::now();
+			optimizer::gradient_descent(mesh, phys, relax, 7, checkpoints, [](scene &, physics::real_type, physics::real_type, physics::real_type, physics::real_type) {}, []() { return true; });
+			sample.milliseconds[kSweep] = milliseconds(begin);
+		}
+
+		return true;
+	}
+
+	// Least squares slope of log(milliseconds) over log(helices), or NaN with fewer than two measured sizes.
+	double exponent(const std::vector<sample_type> & samples, Stage stage) {
+		double n(0), sx(0), sy(0), sxx(0), sxy(0);
+		for (const sample_type & sample : samples) {
+			if (sample.milliseconds[stage] <= 0)
+				continue;
+
+			const double x(std::log(double(sample.helices))), y(std::log(sample.milliseconds[stage]));
+			n += 1;
+			sx += x;
+			sy += y;
+			sxx += x * x;
+			sxy += x * y;
+		}
+
+		const double denominator(n * sxx - sx * sx);
+		return n >= 2 && denominator > 0 ? (n * sxy - sx * sy) / denominator : std::numeric_limits<double>::quiet_NaN();
+	}
+}
+
+int main(int argc, const char **argv) {
+	seed();
+
+	physics::settings_type physics_settings;
+	scene::settings_type scene_settings;
+	Helix::settings_type helix_settings;
+	relaxation::settings_type relaxation_settings;
+	optimizer::settings_type optimizer_settings;
+	batch::settings_type batch_settings;
+	metrics::settings_type metrics_settings;
+	profiler::settings_type profiler_settings;
+	trace::settings_type trace_settings;
+
+	std::string input_file, output_file;
+	parse_settings::parse(argc, argv, physics_settings, scene_settings, helix_settings, relaxation_settings, optimizer_settings, batch_settings, metrics_settings, profiler_settings, trace_settings, input_file, output_file);
+
+	settings_type settings;
+	parse(argc, argv, physics_settings, settings);
+
+	if (optimizer_settings.seed != 0)
+		srand(optimizer_settings.seed);
+
+	if (!settings.generate.empty()) {
+		generator::mesh_type generated;
+		if (output_file.empty() || !generator::generate(settings.generate, settings.edges, settings.edge_length, generated)) {
+			std::cerr << "Usage: " << argv[0] << " --generate=<icosphere|torus|tube> --edges=<integer> --output=<filename> [ --edge_length=<decimal> ]" << std::endl;
+			return 1;
+		}
+
+		std::ofstream outfile(output_file);
+		generator::write_rmesh(outfile, settings.generate, generated);
+		std::cerr << "Wrote " << settings.generate << " of " << generated.path.size() << " edges to \"" << output_file << "\"" << std::endl;
+		return outfile ? 0 : 1;
+	}
+
+	// Stages are timed by the phase timers. The debugger would dominate the timings.
+	profiler::enabled = true;
+	physics_settings.visual_debugger = false;
+
+	physics phys(physics_settings);
+
+	std::cout << "shape\tprofile\thelices\tsteps";
+	for (const char *name : kStageNames)
+		std::cout << '\t' << name << " ms";
+	std::cout << std::endl;
+
+	for (const std::string & shape : settings.shapes) {
+		std::vector< std::vector<sample_type> > samples(settings.profiles.size());
+
+		// Two sizes per decade.
+		for (double edges = double(settings.min_edges); edges <= settings.max_edges * 1.001; edges *= std::sqrt(10.0)) {
+			generator::mesh_type generated;
+			if (!generator::generate(shape, size_t(edges), settings.edge_length, generated)) {
+				std::cerr << "Unknown shape \"" << shape << "\"" << std::endl;
+				break;
+			}
+
+			std::ostringstream contents;
+			generator::write_rmesh(contents, shape, generated);
+
+			for (size_t profile = 0; profile < settings.profiles.size(); ++profile) {
+				physics::settings_type profile_settings(physics_settings);
+				profile_settings.profile = settings.profiles[profile];
+
+				sample_type best;
+				for (unsigned int i = 0; i < settings.repeat; ++i) {
+					physics job_phys(phys, profile_settings, numcpucores());
+					sample_type sample;
+					if (!run(job_phys, scene_settings, helix_settings, relaxation_settings, settings, contents.str(), sample)) {
+						std::cerr << "Failed to read the generated " << shape << " of " << generated.path.size() << " edges" << std::endl;
+						return 1;
+					}
+
+					if (i == 0)
+						best = sample;
+					else {
+						for (int j = 0; j < kStageCount; ++j)
+							best.milliseconds[j] = std::min(best.milliseconds[j], sample.milliseconds[j]);
+					}
+				}
+
+				std::cout << shape << '\t' << kProfileNames[profile_settings.profile] << '\t' << best.helices << '\t' << best.steps;
+				for (double time : best.milliseconds) {
+					if (time < 0)
+						std::cout << "\t-";
+					else
+						std::cout << '\t' << time;
+				}
+				std::cout << std::endl;
+
+				samples[profile].push_back(best);
+			}
+		}
+
+		for (size_t profile = 0; profile < settings.profiles.size(); ++profile) {
+			std::cout << shape << ' ' << kProfileNames[settings.profiles[profile]] << " scaling exponents:";
+			for (int i = 0; i < kStageCount; ++i) {
+				const double k(exponent(samples[profile], Stage(i)));
+				std::cout << ' ' << kStageNames[i] << ": ";
+				if (k == k)
+					std::cout << k;
+				else
+					std::cout << '-';
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	return 0;
+}
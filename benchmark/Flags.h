@@ -0,0 +1,26 @@
+#ifndef _FLAGS_H_
+#define _FLAGS_H_
+
+#include <cstring>
+#include <string>
+
+/*
+ * Flags of the benchmarks themselves, given as --name=value next to those of the rectification, which parse_settings ignores.
+ */
+
+namespace flags {
+	// The value of --name=value, if given.
+	inline bool get(int argc, const char **argv, const char *name, std::string & value) {
+		const size_t length(strlen(name));
+		for (int i = 1; i < argc; ++i) {
+			if (strncmp(argv[i], "--", 2) == 0 && strncmp(argv[i] + 2, name, length) == 0 && argv[i][length + 2] == '=') {
+				value = argv[i] + length + 3;
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+#endif /* _FLAGS_H_ */
@@ -0,0 +1,320 @@
+#ifndef _MESH_GENERATOR_H_
+#define _MESH_GENERATOR_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Synthetic scaffold meshes of any size for the benchmarks: Subdivided icospheres, tori and open tubes.
+ * A surface is given as polygons, each listed counterclockwise seen from the outside. It is routed by making the midpoints of its edges the vertices of the mesh,
+ * joined around every corner of every polygon, so that every vertex has four edges. The route follows the boundary of a spanning tree of the surface,
+ * thickened into a ribbon: Along the edges of the tree and across the other edges. Such a route is a single closed path taking every edge of the mesh once,
+ * always turning to an adjacent edge at a vertex and never crossing itself, as the rectification requires.
+ */
+
+namespace generator {
+	struct point_type {
+		double x, y, z;
+	};
+
+	struct surface_type {
+		std::vector<point_type> vertices;
+		std::vector< std::vector<unsigned int> > faces;
+	};
+
+	struct mesh_type {
+		std::vector<point_type> vertices;
+		std::vector<unsigned int> path; // Zero based. The last vertex connects back to the first.
+	};
+
+	namespace detail {
+		inline point_type normalized(const point_type & p) {
+			const double length(std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z));
+			const point_type result = { p.x / length, p.y / length, p.z / length };
+			return result;
+		}
+
+		inline unsigned long long pair_key(unsigned int a, unsigned int b) {
+			return (unsigned long long) a << 32 | b;
+		}
+	}
+
+	/*
+	 * The icosahedron with every face split into frequency^2 triangles, projected onto the unit sphere. 30 * frequency^2 edges.
+	 */
+	inline surface_type icosphere(unsigned int frequency) {
+		const double t((1.0 + std::sqrt(5.0)) / 2.0);
+		const point_type corners[12] = {
+			{ -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 }, { 0, -1, t }, { 0, 1, t },
+			{ 0, -1, -t }, { 0, 1, -t }, { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+		};
+		const unsigned int triangles[20][3] = {
+			{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 }, { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+			{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 }, { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+		};
+
+		surface_type surface;
+
+		// Points on the edges of the icosahedron are shared by two faces, so they are identified by their corners and weights in corner order.
+		std::map<std::array<unsigned int, 6>, unsigned int> indices;
+
+		for (const unsigned int (&triangle)[3] : triangles) {
+			const auto index([&](unsigned int i, unsigned int j) {
+				const std::pair<unsigned int, unsigned int> weights[3] = { std::make_pair(triangle[0], frequency - i - j), std::make_pair(triangle[1], i), std::make_pair(triangle[2], j) };
+
+				std::array< std::pair<unsigned int, unsigned int>, 3 > sorted;
+				point_type position = { 0, 0, 0 };
+				for (int k = 0; k < 3; ++k) {
+					sorted[k] = std::make_pair(weights[k].second > 0 ? weights[k].first : 12, weights[k].second); // Corners without weight last.
+					position.x += corners[weights[k].first].x * weights[k].second;
+					position.y += corners[weights[k].first].y * weights[k].second;
+					position.z += corners[weights[k].first].z * weights[k].second;
+				}
+				std::sort(sorted.begin(), sorted.end());
+
+				const std::array<unsigned int, 6> key = { { sorted[0].first, sorted[0].second, sorted[1].first, sorted[1].second, sorted[2].first, sorted[2].second } };
+
+				const std::pair<std::map<std::array<unsigned int, 6>, unsigned int>::iterator, bool> result(indices.insert(std::make_pair(key, static_cast<unsigned int>(surface.vertices.size()))));
+				if (result.second)
+					surface.vertices.push_back(detail::normalized(position));
+				return result.first->second;
+			});
+
+			for (unsigned int i = 0; i < frequency; ++i) {
+				for (unsigned int j = 0; i + j < frequency; ++j) {
+					surface.faces.push_back({ index(i, j), index(i + 1, j), index(i, j + 1) });
+
+					if (i + j + 2 <= frequency)
+						surface.faces.push_back({ index(i + 1, j), index(i + 1, j + 1), index(i, j + 1) });
+				}
+			}
+		}
+
+		return surface;
+	}
+
+	/*
+	 * A torus of quads, with the given number of segments around the tube and around the hole, and the radius of the hole relative to the one of the tube.
+	 * 2 * minor_segments * major_segments edges.
+	 */
+	inline surface_type torus(unsigned int minor_segments, unsigned int major_segments, double ratio) {
+		const double pi(3.14159265358979323846);
+		surface_type surface;
+
+		for (unsigned int i = 0; i < major_segments; ++i) {
+			const double theta(2.0 * pi * i / major_segments);
+
+			for (unsigned int j = 0; j < minor_segments; ++j) {
+				const double phi(2.0 * pi * j / minor_segments);
+				const point_type position = { (ratio + std::cos(phi)) * std::cos(theta), (ratio + std::cos(phi)) * std::sin(theta), std::sin(phi) };
+				surface.vertices.push_back(position);
+			}
+		}
+
+		const auto index([minor_segments, major_segments](unsigned int i, unsigned int j) { return (i % major_segments) * minor_segments + j % minor_segments; });
+
+		for (unsigned int i = 0; i < major_segments; ++i) {
+			for (unsigned int j = 0; j < minor_segments; ++j)
+				surface.faces.push_back({ index(i, j), index(i + 1, j), index(i + 1, j + 1), index(i, j + 1) });
+		}
+
+		return surface;
+	}
+
+	/*
+	 * An open cylinder of square quads, with the given number of segments around it and rings of them along it. Both openings are polygons of the surface.
+	 * segments * (2 * rings + 1) edges.
+	 */
+	inline surface_type tube(unsigned int segments, unsigned int rings) {
+		const double pi(3.14159265358979323846);
+		const double height(2.0 * pi / segments);
+		surface_type surface;
+
+		for (unsigned int k = 0; k <= rings; ++k) {
+			for (unsigned int s = 0; s < segments; ++s) {
+				const point_type position = { std::cos(2.0 * pi * s / segments), std::sin(2.0 * pi * s / segments), height * k };
+				surface.vertices.push_back(position);
+			}
+		}
+
+		const auto index([segments](unsigned int k, unsigned int s) { return k * segments + s % segments; });
+
+		for (unsigned int k = 0; k < rings; ++k) {
+			for (unsigned int s = 0; s < segments; ++s)
+				surface.faces.push_back({ index(k, s), index(k, s + 1), index(k + 1, s + 1), index(k + 1, s) });
+		}
+
+		std::vector<unsigned int> bottom, top;
+		for (unsigned int s = 0; s < segments; ++s) {
+			bottom.push_back(index(0, segments - 1 - s));
+			top.push_back(index(rings, s));
+		}
+
+		surface.faces.push_back(bottom);
+		surface.faces.push_back(top);
+		return surface;
+	}
+
+	/*
+	 * Routes the surface as described at the top, scaled so that the edges of the mesh are edge_length long on average.
+	 * Fails if the polygons do not close the surface with consistent orientations.
+	 */
+	inline bool route(const surface_type & surface, double edge_length, mesh_type & mesh) {
+		struct edge_type {
+			unsigned int vertices[2];
+			int faces[2]; // To the left of the edge from vertices[0] to vertices[1], and of the one back.
+			bool tree;
+		};
+
+		struct corner_type {
+			unsigned int face, vertex, edges[2];
+		};
+
+		std::vector<edge_type> edges;
+		std::unordered_map<unsigned long long, unsigned int> edge_indices; // By the lower and higher vertex.
+		std::vector<corner_type> corners;
+		std::unordered_map<unsigned long long, unsigned int> corner_indices; // By face and vertex.
+
+		for (unsigned int face = 0; face < surface.faces.size(); ++face) {
+			const std::vector<unsigned int> & polygon(surface.faces[face]);
+
+			for (size_t i = 0; i < polygon.size(); ++i) {
+				const unsigned int from(polygon[i]), to(polygon[(i + 1) % polygon.size()]);
+				const std::pair<std::unordered_map<unsigned long long, unsigned int>::iterator, bool> result(edge_indices.insert(std::make_pair(detail::pair_key(std::min(from, to), std::max(from, to)), static_cast<unsigned int>(edges.size()))));
+
+				if (result.second) {
+					const edge_type edge = { { from, to }, { int(face), -1 }, false };
+					edges.push_back(edge);
+				} else {
+					edge_type & edge(edges[result.first->second]);
+					if (edge.vertices[0] != to || edge.faces[1] != -1)
+						return false;
+					edge.faces[1] = int(face);
+				}
+			}
+		}
+
+		for (const edge_type & edge : edges) {
+			if (edge.faces[1] == -1)
+				return false;
+		}
+
+		for (unsigned int face = 0; face < surface.faces.size(); ++face) {
+			const std::vector<unsigned int> & polygon(surface.faces[face]);
+
+			for (size_t i = 0; i < polygon.size(); ++i) {
+				const unsigned int previous(polygon[(i + polygon.size() - 1) % polygon.size()]), vertex(polygon[i]), next(polygon[(i + 1) % polygon.size()]);
+				const corner_type corner = { face, vertex, { edge_indices[detail::pair_key(std::min(previous, vertex), std::max(previous, vertex))], edge_indices[detail::pair_key(std::min(vertex, next), std::max(vertex, next))] } };
+				corner_indices[detail::pair_key(face, vertex)] = static_cast<unsigned int>(corners.size());
+				corners.push_back(corner);
+			}
+		}
+
+		// Spanning tree, breadth first.
+		std::vector< std::vector<unsigned int> > vertex_edges(surface.vertices.size());
+		for (unsigned int i = 0; i < edges.size(); ++i) {
+			for (unsigned int vertex : edges[i].vertices)
+				vertex_edges[vertex].push_back(i);
+		}
+
+		std::vector<bool> visited(surface.vertices.size(), false);
+		std::queue<unsigned int> queue;
+		visited[0] = true;
+		queue.push(0);
+
+		while (!queue.empty()) {
+			const unsigned int vertex(queue.front());
+			queue.pop();
+
+			for (unsigned int i : vertex_edges[vertex]) {
+				const unsigned int other(edges[i].vertices[0] == vertex ? edges[i].vertices[1] : edges[i].vertices[0]);
+				if (!visited[other]) {
+					visited[other] = true;
+					edges[i].tree = true;
+					queue.push(other);
+				}
+			}
+		}
+
+		// Walk the corners: Entering a corner through one of its edges, leave through the other one into the corner following it at that edge.
+		mesh.path.clear();
+		mesh.path.reserve(corners.size());
+
+		unsigned int corner(0), entry(corners[0].edges[0]);
+		do {
+			mesh.path.push_back(entry);
+
+			const corner_type & current(corners[corner]);
+			const unsigned int exit_index(current.edges[0] == entry ? current.edges[1] : current.edges[0]);
+			const edge_type & exit(edges[exit_index]);
+			entry = exit_index;
+
+			if (exit.tree)
+				corner = corner_indices[detail::pair_key(current.face, exit.vertices[0] == current.vertex ? exit.vertices[1] : exit.vertices[0])];
+			else
+				corner = corner_indices[detail::pair_key(static_cast<unsigned int>(exit.faces[0] == int(current.face) ? exit.faces[1] : exit.faces[0]), current.vertex)];
+		} while ((corner != 0 || entry != corners[0].edges[0]) && mesh.path.size() <= corners.size());
+
+		if (mesh.path.size() != corners.size())
+			return false;
+
+		mesh.vertices.clear();
+		mesh.vertices.reserve(edges.size());
+		for (const edge_type & edge : edges) {
+			const point_type & a(surface.vertices[edge.vertices[0]]), & b(surface.vertices[edge.vertices[1]]);
+			const point_type midpoint = { (a.x + b.x) / 2, (a.y + b.y) / 2, (a.z + b.z) / 2 };
+			mesh.vertices.push_back(midpoint);
+		}
+
+		double length(0);
+		for (size_t i = 0; i < mesh.path.size(); ++i) {
+			const point_type & a(mesh.vertices[mesh.path[i]]), & b(mesh.vertices[mesh.path[(i + 1) % mesh.path.size()]]);
+			length += std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) + (a.z - b.z) * (a.z - b.z));
+		}
+
+		const double scaling(edge_length * mesh.path.size() / length);
+		for (point_type & vertex : mesh.vertices) {
+			vertex.x *= scaling;
+			vertex.y *= scaling;
+			vertex.z *= scaling;
+		}
+
+		return true;
+	}
+
+	/*
+	 * A routed mesh of the named shape, "icosphere", "torus" or "tube", with about the given number of edges, each becoming a helix. Fails on an unknown shape.
+	 */
+	inline bool generate(const std::string & shape, size_t edges, double edge_length, mesh_type & mesh) {
+		// Every edge of the surface gives two edges of the mesh.
+		if (shape == "icosphere")
+			return route(icosphere(std::max(1u, static_cast<unsigned int>(std::sqrt(edges / 60.0) + 0.5))), edge_length, mesh);
+		else if (shape == "torus") {
+			const unsigned int segments(std::max(3u, static_cast<unsigned int>(std::sqrt(edges / 12.0) + 0.5)));
+			return route(torus(segments, segments * 3, 3.0), edge_length, mesh);
+		} else if (shape == "tube") {
+			const unsigned int segments(std::max(3u, static_cast<unsigned int>(std::sqrt(edges / 4.0) + 0.5)));
+			return route(tube(segments, segments), edge_length, mesh);
+		}
+
+		return false;
+	}
+
+	// In the .rmsh format read by scene::read_rmesh.
+	inline void write_rmesh(std::ostream & out, const std::string & name, const mesh_type & mesh) {
+		out << "g " << name << std::endl;
+		for (const point_type & vertex : mesh.vertices)
+			out << "v " << vertex.x << ' ' << vertex.y << ' ' << vertex.z << std::endl;
+		for (unsigned int vertex : mesh.path)
+			out << "e " << vertex + 1 << std::endl;
+	}
+}
+
+#endif /* _MESH_GENERATOR_H_ */
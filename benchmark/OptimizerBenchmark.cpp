@@ -0,0 +1,176 @@
+#include <Batch.h>
+#include <Checkpoint.h>
+#include <Optimizer.h>
+#include <ParseSettings.h>
+#include <Relaxation.h>
+#include <Scene.h>
+#include <Utility.h>
+
+#include "Flags.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+/*
+ * Quality against time of the optimizers: Runs each of --optimizers on every design of a corpus, listed in a manifest as for --batch,
+ * and writes the best separation found over wall clock time as CSV to --output, or to the standard output.
+ * Every run starts from the design as read, stops after --time_limit seconds (60 by default) or when the optimizer is done, and is seeded by --seed unless 0.
+ * A row is written at the start of a run, for every improvement and at its end, with the relaxations and steps taken so far and the best separations.
+ * The settings of the rectification, such as --engine, --workers or --iterations, apply to every run.
+ */
+
+namespace {
+	volatile bool running = true;
+
+	void handle_exit() {
+		running = false;
+	}
+
+	// Quoted if needed.
+	std::string csv_field(const std::string & str) {
+		if (str.find_first_of(",\"\n") == std::string::npos)
+			return str;
+
+		std::string quoted("\"");
+		for (char c : str) {
+			if (c == '"')
+				quoted += '"';
+			quoted += c;
+		}
+		return quoted + '"';
+	}
+
+	class curve_writer {
+	public:
+		inline curve_writer(std::ostream & out, const relaxation & relax, const std::string & design, optimizer::Algorithm algorithm) :
+			out(out), relax(relax), design(csv_field(design)), algorithm(optimizer::algorithm_name(algorithm)), start(std::chrono::steady_clock::now()), initial(relax.getStatistics()) {}
+
+		inline double elapsed() const {
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		void write(const char *event, physics::real_type min, physics::real_type max, physics::real_type average, physics::real_type total) {
+			const relaxation::statistics_type statistics(relax.getStatistics());
+			out << design << ',' << algorithm << ',' << event << ',' << elapsed() << ',' << (statistics.relaxations - initial.relaxations) << ',' << (statistics.steps - initial.steps)
+				<< ',' << min << ',' << max << ',' << average << ',' << total << '\n';
+		}
+
+	private:
+		std::ostream & out;
+		const relaxation & relax;
+		const std::string design;
+		const char *algorithm;
+		const std::chrono::steady_clock::time_point start;
+		const relaxation::statistics_type initial;
+	};
+}
+
+int main(int argc, const char **argv) {
+	seed();
+
+	physics::settings_type physics_settings;
+	scene::settings_type scene_settings;
+	Helix::settings_type helix_settings;
+	relaxation::settings_type relaxation_settings;
+	optimizer::settings_type optimizer_settings;
+	batch::settings_type batch_settings;
+	metrics::settings_type metrics_settings;
+	profiler::settings_type profiler_settings;
+	trace::settings_type trace_settings;
+
+	std::string input_file, output_file;
+	parse_settings::parse(argc, argv, physics_settings, scene_settings, helix_settings, relaxation_settings, optimizer_settings, batch_settings, metrics_settings, profiler_settings, trace_settings, input_file, output_file);
+
+	std::vector<optimizer::Algorithm> algorithms;
+	std::string value("gradient_descent,simulated_annealing,simulated_rectification");
+	flags::get(argc, argv, "optimizers", value);
+	std::istringstream names(value);
+	while (std::getline(names, value, ',')) {
+		algorithms.push_back(optimizer::algorithm_by_name(value.c_str()));
+
+		if (algorithms.back() == optimizer::kUnknownAlgorithm) {
+			std::cerr << "Unknown optimizer \"" << value << "\", use gradient_descent, simulated_annealing or simulated_rectification" << std::endl;
+			return 1;
+		}
+	}
+
+	double time_limit(60);
+	if (flags::get(argc, argv, "time_limit", value))
+		time_limit = atof(value.c_str());
+
+	std::vector<batch::job_type> jobs;
+	std::ifstream manifest(batch_settings.manifest);
+	if (batch_settings.manifest.empty() || !batch::read_manifest(manifest, jobs) || jobs.empty()) {
+		std::cerr << "Usage: " << argv[0] << " --batch=<manifest> [ --output=<filename> ] [ --optimizers=<name>,... ] [ --time_limit=<seconds> ]" << std::endl;
+		return 1;
+	}
+
+	std::ofstream outfile;
+	if (!output_file.empty())
+		outfile.open(output_file);
+	std::ostream & out(output_file.empty() ? std::cout : outfile);
+
+	// The debugger would slow down every run.
+	physics_settings.visual_debugger = false;
+	optimizer_settings.checkpoint_interval = 0;
+
+	physics phys(physics_settings);
+
+	setinterrupthandler<handle_exit>();
+
+	out << "design,optimizer,event,seconds,relaxations,steps,min,max,average,total" << std::endl;
+
+	for (const batch::job_type & job : jobs) {
+		for (optimizer::Algorithm algorithm : algorithms) {
+			if (!running)
+				break;
+
+			if (optimizer_settings.seed != 0)
+				srand(optimizer_settings.seed);
+
+			// Every run relaxes with a configuration cache of its own, which would otherwise serve the next optimizer configurations relaxed by the previous.
+			const relaxation relax(relaxation_settings);
+			physics job_phys(phys, numcpucores());
+			scene mesh(scene_settings, helix_settings);
+
+			try {
+				if (!mesh.read(job_phys, job.input_file)) {
+					std::cerr << "Failed to read scene \"" << job.input_file << "\"" << std::endl;
+					break;
+				}
+			}
+			catch (const std::runtime_error & e) {
+				std::cerr << "Failed to read scene \"" << job.input_file << "\": " << e.what() << std::endl;
+				break;
+			}
+
+			optimizer::settings_type settings(optimizer_settings);
+			settings.algorithm = algorithm;
+
+			curve_writer curve(out, relax, job.input_file, algorithm);
+			physics::real_type min, max, average, total;
+			mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+			curve.write("start", min, max, average, total);
+
+			checkpointer checkpoints(std::string(), 0);
+			optimizer::optimize(mesh, job_phys, relax, settings, 7, checkpoints,
+				[&](scene &, physics::real_type min_, physics::real_type max_, physics::real_type average_, physics::real_type total_) {
+					min = min_;
+					max = max_;
+					average = average_;
+					total = total_;
+					curve.write("best", min, max, average, total);
+				},
+				[&curve, time_limit]() { return running && curve.elapsed() < time_limit; });
+
+			curve.write("end", min, max, average, total);
+			out.flush();
+
+			std::cerr << job.input_file << ": " << optimizer::algorithm_name(algorithm) << ": total: " << total << " nm, max: " << max << " nm after " << curve.elapsed() << " s" << std::endl;
+		}
+	}
+
+	return out ? 0 : 1;
+}
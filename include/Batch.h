@@ -0,0 +1,49 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <Physics.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Batch mode rectifies every design listed in a manifest in one process, sharing the PhysX SDK between jobs that each get a scene of their own.
+ * The manifest holds one job per line: The input file and, optionally, the output file, separated by whitespace.
+ * Without an output file, the input file name with its extension replaced by .rpoly is used. Empty lines and lines starting with # are ignored.
+ */
+
+namespace batch {
+	struct settings_type {
+		std::string manifest; // Empty unless in batch mode.
+		std::string summary; // Defaults to the manifest file name with .summary appended.
+		unsigned int jobs; // Number of jobs in flight. 0 uses one per core.
+	};
+
+	struct job_type {
+		std::string input_file, output_file;
+	};
+
+	struct summary_type {
+		enum Status {
+			kSucceeded = 0,
+			kFailed = 1,
+			kInterrupted = 2
+		} status;
+
+		std::string message; // Why a job failed.
+		size_t helices;
+		physics::real_type initial_total, min, max, average, total;
+		double seconds;
+	};
+
+	bool read_manifest(std::istream & manifest, std::vector<job_type> & jobs);
+
+	// "succeeded", "failed" or "interrupted".
+	const char *status_name(summary_type::Status status);
+
+	// Tab separated, one line per job, with a header.
+	void write_summary(std::ostream & out, const std::vector<job_type> & jobs, const std::vector<summary_type> & summaries);
+}
+
+#endif /* _BATCH_H_ */
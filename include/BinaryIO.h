@@ -0,0 +1,63 @@
+#ifndef _BINARY_IO_H_
+#define _BINARY_IO_H_
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+
+/*
+ * Little endian encoding of the binary file formats, independent of the endianness of the machine.
+ * Values are appended to a buffer written out in one go, and read back from a stream.
+ */
+
+namespace binary {
+	template<typename T>
+	inline void put(std::string & buffer, T value) {
+		for (size_t i = 0; i < sizeof(T); ++i)
+			buffer.push_back(char((value >> (8 * i)) & 0xff));
+	}
+
+	inline void put_float(std::string & buffer, float value) {
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		put(buffer, bits);
+	}
+
+	inline void put_string(std::string & buffer, const std::string & str) {
+		put(buffer, uint32_t(str.size()));
+		buffer.append(str);
+	}
+
+	template<typename T>
+	inline bool get(std::istream & in, T & value) {
+		unsigned char bytes[sizeof(T)];
+		if (!in.read(reinterpret_cast<char *>(bytes), sizeof(T)))
+			return false;
+
+		value = 0;
+		for (size_t i = 0; i < sizeof(T); ++i)
+			value |= T(bytes[i]) << (8 * i);
+		return true;
+	}
+
+	inline bool get_float(std::istream & in, float & value) {
+		uint32_t bits;
+		if (!get(in, bits))
+			return false;
+
+		memcpy(&value, &bits, sizeof(value));
+		return true;
+	}
+
+	inline bool get_string(std::istream & in, std::string & str) {
+		uint32_t size;
+		if (!get(in, size))
+			return false;
+
+		str.resize(size);
+		return size == 0 || bool(in.read(&str[0], size));
+	}
+}
+
+#endif /* _BINARY_IO_H_ */
@@ -0,0 +1,79 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <Physics.h>
+#include <Scene.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*
+ * Checkpoints let a long optimization continue after the process was stopped. They hold the best configuration found so far and where the optimizer was,
+ * which for parallel tempering includes the configuration, temperature and random number generator state of every chain.
+ * A checkpoint is written to a temporary file which then replaces the previous one, so that a process killed while writing leaves the previous checkpoint intact.
+ */
+
+struct checkpoint_type {
+	enum Optimizer {
+		kGradientDescent = 0,
+		kParallelTempering = 1
+	};
+
+	struct chain_type {
+		std::vector<int> bases;
+		physics::real_type total;
+		unsigned int temperature; // Index into the temperatures.
+		std::string generator; // As written by operator<<.
+	};
+
+	Optimizer optimizer;
+	unsigned long long position; // Next trial of the gradient descent, or moves done by every chain.
+
+	SceneDescription best;
+	physics::real_type min, max, average, total; // Of best.
+
+	std::vector<chain_type> chains;
+	std::string generator; // Of the exchanges.
+
+	inline checkpoint_type() : optimizer(kGradientDescent), position(0), min(0), max(0), average(0), total(0) {}
+
+	bool write(std::ostream & out) const;
+	bool read(std::istream & in);
+};
+
+class checkpointer {
+public:
+	// Checkpoints are written to filename every interval seconds. Disabled if the filename is empty or the interval is not positive.
+	inline checkpointer(const std::string & filename, double interval) : filename(filename), interval(interval), last(std::chrono::steady_clock::now()), resume(NULL) {}
+
+	inline bool isEnabled() const {
+		return !filename.empty() && interval > 0;
+	}
+
+	inline bool isDue() const {
+		return isEnabled() && std::chrono::duration<double>(std::chrono::steady_clock::now() - last).count() >= interval;
+	}
+
+	// Writes the checkpoint if enabled, and restarts the interval.
+	bool save(const checkpoint_type & checkpoint);
+
+	static bool load(const std::string & filename, checkpoint_type & checkpoint);
+
+	// The checkpoint the optimizer continues from, or NULL to start over.
+	inline const checkpoint_type *getResume() const {
+		return resume;
+	}
+
+	inline void setResume(const checkpoint_type *checkpoint) {
+		resume = checkpoint;
+	}
+
+private:
+	const std::string filename;
+	const double interval;
+	std::chrono::steady_clock::time_point last;
+	const checkpoint_type *resume;
+};
+
+#endif /* _CHECKPOINT_H_ */
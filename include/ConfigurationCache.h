@@ -0,0 +1,79 @@
+#ifndef _CONFIGURATION_CACHE_H_
+#define _CONFIGURATION_CACHE_H_
+
+#include <Physics.h>
+#include <Scene.h>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Relaxed configurations already evaluated, keyed by the base counts of all helices, so that an optimizer proposing a configuration it has seen before,
+ * such as a move followed by its reverse, does not have to relax the scene again. Holds the total separation of the relaxed scene and, optionally, its state.
+ * The least recently used configuration is evicted when full. Shared by all threads of a parallel optimizer.
+ */
+
+class configuration_cache {
+public:
+	typedef std::vector<int> key_type;
+
+	struct entry_type {
+		physics::real_type min, max, average, total;
+		scene::snapshot_type snapshot; // Empty unless poses are cached.
+	};
+
+	struct statistics_type {
+		unsigned long long hits, misses, evictions;
+		size_t size;
+	};
+
+	// A capacity of 0 disables the cache.
+	inline configuration_cache(size_t capacity, bool store_poses) : capacity(capacity), store_poses(store_poses), statistics() {}
+
+	configuration_cache(const configuration_cache &) = delete;
+	configuration_cache & operator=(const configuration_cache &) = delete;
+
+	inline bool isEnabled() const {
+		return capacity > 0;
+	}
+
+	inline bool storesPoses() const {
+		return store_poses;
+	}
+
+	enum Lookup {
+		kMissing = 0,
+		kRejected = 1, // Found, but its total separation is not below the threshold.
+		kFound = 2
+	};
+
+	// Marks the entry as the most recently used if found, and copies it only if its total separation is below threshold.
+	Lookup find(const key_type & key, physics::real_type threshold, entry_type & entry);
+
+	// Replaces any entry with the same key.
+	void insert(const key_type & key, const entry_type & entry);
+
+	statistics_type getStatistics() const;
+
+private:
+	// FNV-1a over the base counts.
+	struct hash_type {
+		size_t operator()(const key_type & key) const;
+	};
+
+	typedef std::list<std::pair<key_type, entry_type>> EntryContainer; // Most recently used first.
+
+	const size_t capacity;
+	const bool store_poses;
+
+	EntryContainer entries;
+	std::unordered_map<key_type, EntryContainer::iterator, hash_type> lookup;
+	statistics_type statistics;
+
+	mutable std::mutex mutex;
+};
+
+#endif /* _CONFIGURATION_CACHE_H_ */
@@ -20,6 +20,11 @@
 #include <cstdlib>
 #include <cmath> // Needed by PxPhysicsAPI.h under Linux.
 
+#ifndef _WINDOWS
+#include <strings.h>
+#define stricmp strcasecmp
+#endif /* N _WINDOWS */
+
 #include <Physics.h>
 
 namespace Debug {
@@ -4,7 +4,9 @@
 #include <Utility.h>
 
 #include <array>
+#include <numeric>
 #include <utility>
+#include <vector>
 
 class Helix {
 public:
@@ -30,6 +32,15 @@ public:
 		kNoAttachmentPoint = 4
 	};
 
+	// Shapes of the helix taking part in collisions. The shapes stay attached, so switching is cheap.
+	enum Geometry {
+		kFullGeometry = 0, // The capsule and the four end spheres.
+		kCapsuleGeometry = 1, // Only the capsule, or the end spheres of a helix too short for one.
+		kNoGeometry = 2 // No collisions at all, only springs.
+	};
+
+	static const unsigned int kMaxShapeCount = 5; // A capsule and four end spheres.
+
 	struct settings_type {
 		physics::real_type density, spring_stiffness, fixed_spring_stiffness, spring_damping;
 		bool attach_fixed;
@@ -39,18 +50,37 @@ public:
 		createRigidBody(phys, bases, transform);
 	}
 
-	void recreateRigidBody(physics & phys, int bases, const physics::transform_type & transform);
+	// The new rigid body is put at pose. Like resize, its fixed spring is anchored at the initial transform.
+	void recreateRigidBody(physics & phys, int bases, const physics::transform_type & pose);
+
+	/*
+	 * Changes the number of bases of the helix, keeping its rigid body and joints. The shapes, mass properties and joint attachment frames are updated in place,
+	 * and the helix is put at rest at pose. Falls back to recreateRigidBody when the helix gains or loses its capsule.
+	 * Whatever the pose, the fixed spring stays anchored at the initial transform, so that the structure is held to the input geometry.
+	 */
+	void resize(physics & phys, int bases, const physics::transform_type & pose);
 
 	inline physics::transform_type getTransform() const {
-		return rigidBody->getGlobalPose();
+		return physics::world_transform(*rigidBody);
 	}
 
 	inline void setTransform(const physics::transform_type & transform) {
-		rigidBody->setGlobalPose(transform);
+		physics::set_world_transform(*rigidBody, transform);
+	}
+
+	inline physics::body_state_type getState(const physics & phys) const {
+		return phys.get_state(*rigidBody);
+	}
+
+	inline void setState(const physics & phys, const physics::body_state_type & state) {
+		phys.set_state(*rigidBody, state);
 	}
 
 	void attach(physics & phys, Helix & other, AttachmentPoint thisPoint, AttachmentPoint otherPoint);
 
+	// A recreated rigid body has the full geometry. Getting it back wakes a helix that is not frozen up, so that its new contacts are resolved.
+	void setGeometry(physics & phys, Geometry geometry);
+
 	physics::real_type getSeparation(AttachmentPoint atPoint) const;
 
 	inline unsigned int getBaseCount() const {
@@ -74,11 +104,49 @@ public:
 	}
 
 	inline bool isSleeping() const {
-		return rigidBody->isSleeping();
+		return physics::is_sleeping(*rigidBody);
+	}
+
+	inline physics::real_type getKineticEnergy(const physics & phys) const {
+		return phys.get_kinetic_energy(*rigidBody);
+	}
+
+	// Potential energy of the springs attached to the helix, including the one holding it to its initial position.
+	inline physics::real_type getSpringEnergy(const physics & phys) const {
+		return std::accumulate(joints.begin(), joints.end(), fixedJoint ? phys.get_spring_energy(*fixedJoint) : physics::real_type(0), [&phys](physics::real_type energy, const Connection & connection) { return energy + (connection ? phys.get_spring_energy(*connection.joint) : physics::real_type(0)); });
+	}
+
+	// Sum of the lengths of the springs attached to the helix.
+	inline physics::real_type getTotalSeparation() const {
+		return std::accumulate(joints.begin(), joints.end(), physics::real_type(0), [](physics::real_type separation, const Connection & connection) { return separation + (connection ? physics::get_spring_distance(*connection.joint) : physics::real_type(0)); });
+	}
+
+	inline void wakeUp() {
+		physics::wake_up(*rigidBody);
+	}
+
+	inline physics::rigid_body_type *getRigidBody() const {
+		return rigidBody;
+	}
+
+	// Appends the springs attached to the helix, including the one holding it to its initial position.
+	inline void getSprings(std::vector<physics::spring_joint_type *> & springs) const {
+		if (fixedJoint)
+			springs.push_back(fixedJoint);
+
+		for (const Connection & connection : joints) {
+			if (connection)
+				springs.push_back(connection.joint);
+		}
+	}
+
+	// A frozen helix is kinematic: it keeps its transform and is not moved by its joints.
+	inline void setFrozen(physics & phys, bool frozen) {
+		phys.set_kinematic(*rigidBody, frozen);
 	}
 
 private:
-	void createRigidBody(physics & phys, int bases, const physics::transform_type & transform);
+	void createRigidBody(physics & phys, int bases, const physics::transform_type & pose);
 	void destroyRigidBody(physics & phys);
 
 	AttachmentPoint otherPoint(AttachmentPoint point, const Helix & other) const;
@@ -0,0 +1,48 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Read only memory mapping of a whole file, for parsing large files without copying them into buffers first.
+ */
+
+class mapped_file {
+public:
+	explicit mapped_file(const std::string & filename);
+	~mapped_file();
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file & operator=(const mapped_file &) = delete;
+
+	// False if the file could not be opened or mapped.
+	inline bool is_open() const {
+		return open;
+	}
+
+	inline const char *begin() const {
+		return data;
+	}
+
+	inline const char *end() const {
+		return data + size;
+	}
+
+	inline size_t length() const {
+		return size;
+	}
+
+private:
+	const char *data; // NULL for an empty file.
+	size_t size;
+	bool open;
+
+#ifdef _WINDOWS
+	void *file, *mapping;
+#else
+	int descriptor;
+#endif /* _WINDOWS */
+};
+
+#endif /* _MAPPED_FILE_H_ */
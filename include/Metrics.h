@@ -0,0 +1,84 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <Physics.h>
+#include <Relaxation.h>
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+/*
+ * Machine readable progress: One JSON object per line, written to a file or FIFO and flushed after every record, so that a scheduler can follow running jobs.
+ * Every job writes a "progress" record every interval seconds, a "best" record whenever a better configuration is stored and a "finished" record with its status.
+ * Records hold the job, the event, the seconds since the job started, the best min, max, average and total separation (null until the first is stored),
+ * the relaxations and simulation steps done, and the steps per relaxation, relaxations per second and steps per second since the previous progress record of the job.
+ * Relaxations and steps are those of the relaxation given to the reporter since it was created. Every job of a batch has a relaxation of its own, so they are those of the job.
+ */
+
+namespace metrics {
+	struct settings_type {
+		std::string filename; // Empty disables the stream.
+		double interval; // Seconds between progress records.
+	};
+
+	class stream {
+	public:
+		explicit stream(const settings_type & settings);
+
+		stream(const stream &) = delete;
+		stream & operator=(const stream &) = delete;
+
+		inline bool isOpen() const {
+			return out.is_open();
+		}
+
+		inline double getInterval() const {
+			return interval;
+		}
+
+		// Writes a record, which must not contain a newline. Safe to call from several jobs.
+		void write(const std::string & record);
+
+	private:
+		std::ofstream out;
+		std::mutex mutex;
+		const double interval;
+	};
+
+	class reporter {
+	public:
+		reporter(stream & out, const relaxation & relax, const std::string & job);
+
+		reporter(const reporter &) = delete;
+		reporter & operator=(const reporter &) = delete;
+
+		// With every better configuration stored.
+		void best(physics::real_type min, physics::real_type max, physics::real_type average, physics::real_type total);
+
+		// Writes a progress record when due. Cheap enough to call from the running functor of the optimizer, from any thread.
+		void poll();
+
+		void finish(const char *status);
+
+	private:
+		// With the mutex locked. Rates are measured from the last record that restarted the interval, as best records can follow each other closely.
+		void write(const char *event, const char *status, bool restart);
+
+		stream & out;
+		const relaxation & relax;
+		const std::string job; // Escaped.
+
+		std::mutex mutex;
+		const std::chrono::steady_clock::time_point start;
+		std::chrono::steady_clock::time_point last;
+		const relaxation::statistics_type first; // When the reporter was created.
+		relaxation::statistics_type previous; // At the last record.
+
+		bool stored;
+		physics::real_type min, max, average, total;
+	};
+}
+
+#endif /* _METRICS_H_ */
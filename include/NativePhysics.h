@@ -0,0 +1,265 @@
+#ifndef _NATIVEPHYSICS_H_
+#define _NATIVEPHYSICS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+ * Stand-ins for the PhysX math types, rigid bodies, shapes and distance joints, used by physics when built with WITHOUT_PHYSX.
+ * Only the native and minimizer engines can then be used, and nothing is simulated by these types themselves, they only hold the state the spring network reads and writes.
+ * Members are named as their PhysX counterparts, so that the code using physics reads the same with either.
+ */
+
+namespace native {
+	typedef float real_type;
+
+	struct vec3 {
+		real_type x, y, z;
+
+		inline vec3() {}
+		inline vec3(real_type x, real_type y, real_type z) : x(x), y(y), z(z) {}
+		inline explicit vec3(real_type a) : x(a), y(a), z(a) {}
+
+		inline vec3 operator+(const vec3 & v) const { return vec3(x + v.x, y + v.y, z + v.z); }
+		inline vec3 operator-(const vec3 & v) const { return vec3(x - v.x, y - v.y, z - v.z); }
+		inline vec3 operator-() const { return vec3(-x, -y, -z); }
+		inline vec3 operator*(real_type s) const { return vec3(x * s, y * s, z * s); }
+		inline vec3 operator/(real_type s) const { return vec3(x / s, y / s, z / s); }
+		inline vec3 & operator+=(const vec3 & v) { x += v.x; y += v.y; z += v.z; return *this; }
+		inline vec3 & operator-=(const vec3 & v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+		inline vec3 & operator*=(real_type s) { x *= s; y *= s; z *= s; return *this; }
+		inline vec3 & operator/=(real_type s) { x /= s; y /= s; z /= s; return *this; }
+		inline bool operator==(const vec3 & v) const { return x == v.x && y == v.y && z == v.z; }
+		inline bool operator!=(const vec3 & v) const { return !(*this == v); }
+
+		inline real_type & operator[](unsigned int i) { return (&x)[i]; }
+		inline const real_type & operator[](unsigned int i) const { return (&x)[i]; }
+
+		inline real_type dot(const vec3 & v) const { return x * v.x + y * v.y + z * v.z; }
+		inline vec3 cross(const vec3 & v) const { return vec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); }
+		inline vec3 multiply(const vec3 & v) const { return vec3(x * v.x, y * v.y, z * v.z); }
+		inline vec3 minimum(const vec3 & v) const { return vec3(std::min(x, v.x), std::min(y, v.y), std::min(z, v.z)); }
+		inline vec3 maximum(const vec3 & v) const { return vec3(std::max(x, v.x), std::max(y, v.y), std::max(z, v.z)); }
+
+		inline real_type magnitudeSquared() const { return dot(*this); }
+		inline real_type magnitude() const { return std::sqrt(magnitudeSquared()); }
+		inline bool isZero() const { return x == 0 && y == 0 && z == 0; }
+
+		// Returns the previous magnitude. The zero vector is left as is.
+		inline real_type normalize() {
+			const real_type m(magnitude());
+			if (m > 0)
+				*this /= m;
+			return m;
+		}
+
+		inline vec3 getNormalized() const {
+			const real_type m(magnitude());
+			return m > 0 ? *this / m : vec3(0, 0, 0);
+		}
+	};
+
+	inline vec3 operator*(real_type s, const vec3 & v) { return v * s; }
+
+	struct quaternion {
+		real_type x, y, z, w;
+
+		inline quaternion() {}
+		inline quaternion(real_type x, real_type y, real_type z, real_type w) : x(x), y(y), z(z), w(w) {}
+
+		// Rotation of angle radians around the unit axis.
+		inline quaternion(real_type angle, const vec3 & axis) {
+			const real_type s(std::sin(angle / 2));
+			x = axis.x * s; y = axis.y * s; z = axis.z * s;
+			w = std::cos(angle / 2);
+		}
+
+		inline quaternion operator*(const quaternion & q) const {
+			return quaternion(w * q.x + q.w * x + y * q.z - q.y * z, w * q.y + q.w * y + z * q.x - q.z * x, w * q.z + q.w * z + x * q.y - q.x * y, w * q.w - x * q.x - y * q.y - z * q.z);
+		}
+
+		inline real_type dot(const quaternion & q) const { return x * q.x + y * q.y + z * q.z + w * q.w; }
+		inline real_type magnitude() const { return std::sqrt(dot(*this)); }
+		inline quaternion getConjugate() const { return quaternion(-x, -y, -z, w); }
+
+		inline real_type normalize() {
+			const real_type m(magnitude());
+			if (m > 0) {
+				x /= m; y /= m; z /= m; w /= m;
+			}
+			return m;
+		}
+
+		inline quaternion getNormalized() const {
+			quaternion q(*this);
+			q.normalize();
+			return q;
+		}
+
+		// Assumes a unit quaternion.
+		inline vec3 rotate(const vec3 & v) const {
+			const vec3 u(x, y, z);
+			return v * (w * w * 2 - 1) + u.cross(v) * (w * 2) + u * (u.dot(v) * 2);
+		}
+
+		inline vec3 rotateInv(const vec3 & v) const {
+			return getConjugate().rotate(v);
+		}
+	};
+
+	struct rigid_transform {
+		vec3 p;
+		quaternion q;
+
+		inline rigid_transform() {}
+		inline explicit rigid_transform(const vec3 & p) : p(p), q(0, 0, 0, 1) {}
+		inline explicit rigid_transform(const quaternion & q) : p(0, 0, 0), q(q) {}
+		inline rigid_transform(const vec3 & p, const quaternion & q) : p(p), q(q) {}
+
+		inline vec3 transform(const vec3 & v) const { return q.rotate(v) + p; }
+		inline vec3 transformInv(const vec3 & v) const { return q.rotateInv(v - p); }
+		inline rigid_transform transform(const rigid_transform & t) const { return rigid_transform(q.rotate(t.p) + p, q * t.q); }
+		inline rigid_transform getInverse() const { return rigid_transform(q.rotateInv(-p), q.getConjugate()); }
+		inline rigid_transform operator*(const rigid_transform & t) const { return transform(t); }
+	};
+
+	struct sphere_geometry {
+		real_type radius;
+
+		inline sphere_geometry() {}
+		inline explicit sphere_geometry(real_type radius) : radius(radius) {}
+	};
+
+	// Extends along its local x axis, like those of PhysX.
+	struct capsule_geometry {
+		real_type radius, halfHeight;
+
+		inline capsule_geometry() {}
+		inline capsule_geometry(real_type radius, real_type halfHeight) : radius(radius), halfHeight(halfHeight) {}
+	};
+
+	class shape {
+	public:
+		inline explicit shape(const sphere_geometry & geometry, const rigid_transform & local_pose) : simulated(true), capsule(false), radius(geometry.radius), halfHeight(0), local_pose(local_pose) {}
+		inline explicit shape(const capsule_geometry & geometry, const rigid_transform & local_pose) : simulated(true), capsule(true), radius(geometry.radius), halfHeight(geometry.halfHeight), local_pose(local_pose) {}
+
+		// The geometry must be of the type the shape was created with.
+		inline void setGeometry(const sphere_geometry & geometry) { radius = geometry.radius; }
+		inline void setGeometry(const capsule_geometry & geometry) { radius = geometry.radius; halfHeight = geometry.halfHeight; }
+
+		inline bool getSphereGeometry(sphere_geometry & geometry) const {
+			if (capsule)
+				return false;
+			geometry = sphere_geometry(radius);
+			return true;
+		}
+
+		inline bool getCapsuleGeometry(capsule_geometry & geometry) const {
+			if (!capsule)
+				return false;
+			geometry = capsule_geometry(radius, halfHeight);
+			return true;
+		}
+
+		inline void setLocalPose(const rigid_transform & pose) { local_pose = pose; }
+		inline rigid_transform getLocalPose() const { return local_pose; }
+
+		bool simulated;
+
+	private:
+		bool capsule;
+		real_type radius, halfHeight;
+		rigid_transform local_pose;
+	};
+
+	class spring_joint;
+
+	/*
+	 * Sleeping is left to the engine: A body is put to sleep when the spring network brings it to rest, and woken up by anything moving it.
+	 */
+	class rigid_body {
+	public:
+		inline explicit rigid_body(const rigid_transform & pose) : kinematic(false), pose(pose), linear_velocity(0, 0, 0), angular_velocity(0, 0, 0), mass(1), inertia(1, 1, 1), mass_local_pose(vec3(0, 0, 0)), sleeping(false) {
+			vertices[0] = vertices[1] = 0;
+		}
+
+		rigid_body(const rigid_body &) = delete;
+		rigid_body & operator=(const rigid_body &) = delete;
+
+		template<typename GeometryT>
+		inline void createShape(const GeometryT & geometry, const rigid_transform & local_pose) {
+			shapes.push_back(shape(geometry, local_pose));
+		}
+
+		inline unsigned int getShapes(shape **buffer, unsigned int count, unsigned int start = 0) const {
+			unsigned int written(0);
+			for (unsigned int i = start; i < shapes.size() && written < count; ++i)
+				buffer[written++] = const_cast<shape *>(&shapes[i]);
+			return written;
+		}
+
+		inline rigid_transform getGlobalPose() const { return pose; }
+		inline void setGlobalPose(const rigid_transform & pose, bool autowake = true) { this->pose = pose; if (autowake) wakeUp(); }
+
+		inline vec3 getLinearVelocity() const { return linear_velocity; }
+		inline vec3 getAngularVelocity() const { return angular_velocity; }
+		inline void setLinearVelocity(const vec3 & velocity) { linear_velocity = velocity; wakeUp(); }
+		inline void setAngularVelocity(const vec3 & velocity) { angular_velocity = velocity; wakeUp(); }
+
+		inline real_type getMass() const { return mass; }
+		inline void setMass(real_type mass) { this->mass = mass; }
+		inline vec3 getMassSpaceInertiaTensor() const { return inertia; }
+		inline void setMassSpaceInertiaTensor(const vec3 & inertia) { this->inertia = inertia; }
+		inline rigid_transform getCMassLocalPose() const { return mass_local_pose; }
+		inline void setCMassLocalPose(const rigid_transform & pose) { mass_local_pose = pose; }
+
+		inline bool isSleeping() const { return sleeping; }
+		inline void wakeUp() { sleeping = false; }
+		inline void putToSleep() { sleeping = true; linear_velocity = angular_velocity = vec3(0, 0, 0); }
+
+		bool kinematic;
+		unsigned int vertices[2]; // For the collision filtering of PhysX, plus one, zero if not set. Kept so that they survive recreating the rigid body.
+		std::vector<spring_joint *> joints; // Attached to the rigid body, released along with it.
+
+	private:
+		std::vector<shape> shapes; // Never reallocated once the rigid body is created, as they are handed out by pointer.
+		rigid_transform pose;
+		vec3 linear_velocity, angular_velocity;
+		real_type mass;
+		vec3 inertia;
+		rigid_transform mass_local_pose;
+		bool sleeping;
+	};
+
+	// A spring pulling when stretched beyond the maximum distance. A NULL rigid body is the world.
+	class spring_joint {
+	public:
+		inline spring_joint(rigid_body *rigid_body0, const rigid_transform & frame0, rigid_body *rigid_body1, const rigid_transform & frame1, real_type stiffness, real_type damping) : stiffness(stiffness), damping(damping), max_distance(0) {
+			rigid_bodies[0] = rigid_body0;
+			rigid_bodies[1] = rigid_body1;
+			frames[0] = frame0;
+			frames[1] = frame1;
+		}
+
+		inline real_type getDistance() const {
+			return (end(1) - end(0)).magnitude();
+		}
+
+		inline real_type getStiffness() const { return stiffness; }
+		inline real_type getDamping() const { return damping; }
+		inline real_type getMaxDistance() const { return max_distance; }
+
+		rigid_body *rigid_bodies[2];
+		rigid_transform frames[2];
+
+	private:
+		inline vec3 end(unsigned int i) const {
+			return rigid_bodies[i] ? rigid_bodies[i]->getGlobalPose().transform(frames[i].p) : frames[i].p;
+		}
+
+		real_type stiffness, damping, max_distance;
+	};
+}
+
+#endif /* _NATIVEPHYSICS_H_ */
@@ -0,0 +1,657 @@
+#ifndef _OPTIMIZER_H_
+#define _OPTIMIZER_H_
+
+#include <Checkpoint.h>
+#include <Definition.h>
+#include <Physics.h>
+#include <Relaxation.h>
+#include <Scene.h>
+#include <SimulatedAnnealing.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * The optimizers modify the base counts of the helices in a scene and search for the configuration with the lowest total separation.
+ */
+
+namespace optimizer {
+	enum Algorithm {
+		kGradientDescent = 0, // Becomes parallel with several workers, and parallel tempering with chains.
+		kSimulatedAnnealing = 1,
+		kSimulatedRectification = 2, // Only relaxes the design as given.
+		kUnknownAlgorithm = 3 // Given by algorithm_by_name for names not listed above. Never run.
+	};
+
+	struct settings_type {
+		Algorithm algorithm;
+		unsigned int workers; // Number of scenes evaluating gradient descent trials concurrently. 1 runs the serial version, 0 uses one worker per core.
+
+		// Parallel tempering.
+		unsigned int chains; // Number of chains, each with a scene of its own. 0 runs gradient descent instead.
+		unsigned int iterations; // Moves per chain, and of simulated annealing.
+		unsigned int exchange_interval; // Moves per chain between exchanges of temperatures.
+		float min_temperature, max_temperature; // Per helix, as in simulated_annealing.
+		unsigned int seed; // Of the random number generators. 0 draws one from rand().
+
+		double checkpoint_interval; // Seconds between checkpoints, written next to the output file. 0 disables them.
+		std::string resume; // Checkpoint to continue from.
+	};
+
+	inline const char *algorithm_name(Algorithm algorithm) {
+		static const char *names[] = { "gradient_descent", "simulated_annealing", "simulated_rectification", "unknown" };
+		return names[algorithm];
+	}
+
+	// Unknown names give kUnknownAlgorithm, to be rejected by the caller.
+	inline Algorithm algorithm_by_name(const char *name) {
+		if (stricmp("gradient_descent", name) == 0)
+			return kGradientDescent;
+		else if (stricmp("simulated_annealing", name) == 0)
+			return kSimulatedAnnealing;
+		else if (stricmp("simulated_rectification", name) == 0)
+			return kSimulatedRectification;
+		else
+			return kUnknownAlgorithm;
+	}
+
+	/*
+	 * Copies of a relaxed scene for optimizers working on several configurations concurrently, each in its own physics instance sharing the SDK of phys.
+	 * Index 0 is the given mesh and phys. The replicas start from the relaxed state instead of being relaxed again.
+	 */
+	struct replica_set {
+		std::vector<std::unique_ptr<physics>> replica_physics;
+		std::vector<std::unique_ptr<scene>> replica_scenes;
+		std::vector<scene *> scenes;
+		std::vector<physics *> physicses;
+
+		inline replica_set(scene & mesh, physics & phys, unsigned int count) : scenes(1, &mesh), physicses(1, &phys) {
+			for (unsigned int i = 1; i < count; ++i) {
+				replica_physics.push_back(std::unique_ptr<physics>(new physics(phys, std::max(1u, numcpucores() / count))));
+				replica_scenes.push_back(std::unique_ptr<scene>(new scene(mesh, *replica_physics.back())));
+				scenes.push_back(replica_scenes.back().get());
+				physicses.push_back(replica_physics.back().get());
+
+				for (scene::HelixContainer::size_type j = 0; j < mesh.getHelixCount(); ++j) {
+					const Helix & helix(mesh.getHelices()[j]);
+					Helix & replica(scenes.back()->getHelices()[j]);
+
+					if (replica.getBaseCount() != helix.getBaseCount())
+						replica.resize(*physicses.back(), int(helix.getBaseCount()), helix.getTransform());
+
+					replica.setTransform(helix.getTransform());
+				}
+			}
+		}
+
+		replica_set(const replica_set &) = delete;
+		replica_set & operator=(const replica_set &) = delete;
+	};
+
+	// Resizes the helices whose base count differs at their initial transforms, to continue from a checkpoint.
+	inline void set_base_counts(scene & mesh, physics & phys, const std::vector<int> & bases) {
+		scene::HelixContainer & helices(mesh.getHelices());
+
+		for (scene::HelixContainer::size_type i = 0; i < helices.size(); ++i) {
+			if (int(helices[i].getBaseCount()) != bases[i])
+				helices[i].resize(phys, bases[i], helices[i].getInitialTransform());
+		}
+	}
+
+	/*
+	 * Saves a checkpoint of a gradient descent about to evaluate the trial at position, if enabled. The mesh must hold the accepted configuration, which is also the best.
+	 */
+	inline void save_gradient_descent(checkpointer & checkpoints, scene & mesh, size_t position, physics::real_type min, physics::real_type max, physics::real_type average, physics::real_type total) {
+		if (!checkpoints.isEnabled())
+			return;
+
+		checkpoint_type checkpoint;
+		checkpoint.optimizer = checkpoint_type::kGradientDescent;
+		checkpoint.position = position;
+		checkpoint.best = SceneDescription(mesh);
+		checkpoint.min = min;
+		checkpoint.max = max;
+		checkpoint.average = average;
+		checkpoint.total = total;
+		checkpoints.save(checkpoint);
+	}
+
+	/*
+	 * Increases/decreases the base counts of individual helices with min(minbasecount, basecount + [ -baserange, baserange ]), and evaluates the new energy level of the system by simulated annealing.
+	 */
+	template<typename StoreBestFunctorT, typename RunningFunctorT>
+	void simulated_annealing(scene & mesh, physics & phys, const relaxation & relax, int kmax, float emax, unsigned int minbasecount, int baserange,
+			StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
+
+		relaxation::move_type move;
+
+		scene::HelixContainer & helices(mesh.getHelices());
+		const scene::HelixContainer::size_type helixCount(helices.size());
+
+		// Moves are measured against the relaxed design, not the one given.
+		relax.relax(mesh, phys, running_functor);
+		relax.begin(mesh, phys);
+
+		::simulated_annealing(mesh,
+			[](scene & mesh) { return mesh.getTotalSeparation(); },
+			[&helixCount](float k) { return float(std::max(0., (exp(-k) - 1 / M_E) / (1 - 1 / M_E))) * helixCount; },
+			[&move, &helices, &helixCount, &phys, &relax, &minbasecount, &baserange, &running_functor](scene & mesh) {
+				const scene::HelixContainer::size_type modifiedHelix(rand() % helixCount);
+				const int bases(int(helices[modifiedHelix].getInitialBaseCount()) + (rand() % 2 * 2 - 1) * (1 + rand() % (baserange)));
+
+				physics::real_type min, max, average, total;
+				relax.evaluate(mesh, phys, modifiedHelix, std::max(int(minbasecount), bases), std::numeric_limits<physics::real_type>::infinity(), move, min, max, average, total, running_functor);
+			},
+			probability_functor<float, float>(),
+			[&move, &phys, &relax](scene & mesh) {
+				relax.revert(mesh, phys, move);
+			},
+			store_best_functor,
+			running_functor,
+			kmax, emax);
+
+		relax.end(mesh, phys, running_functor);
+	}
+
+	/*
+	 * Simple gradient descent implementation: Energy lower? Choose it, if not don't.
+	 * Trials are numbered by helix index * 2 + direction. Checkpoints hold the accepted configuration and the next trial, and are also saved when interrupted.
+	 */
+	template<typename StoreBestFunctorT, typename RunningFunctorT>
+	void gradient_descent(scene & mesh, physics & phys, const relaxation & relax, int minbasecount, checkpointer & checkpoints, StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
+		scene::HelixContainer & helices(mesh.getHelices());
+		const checkpoint_type *resume(checkpoints.getResume());
+		const size_t first(resume ? size_t(resume->position) : 0);
+
+		if (resume) {
+			std::vector<int> bases;
+			resume->best.getBaseCounts(bases);
+			set_base_counts(mesh, phys, bases);
+		}
+
+		relax.relax(mesh, phys, running_functor);
+
+		//physics::real_type separation(mesh.getTotalSeparation());
+		physics::real_type min, max, average, total;
+		mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+		store_best_functor(mesh, min, max, average, total);
+
+		relax.begin(mesh, phys);
+
+		relaxation::move_type move;
+
+		for (scene::HelixContainer::size_type index = first / 2; index < helices.size(); ++index) {
+			for (int i = (index == first / 2 ? int(first % 2) : 0); i < 2; ++i) {
+				if (!running_functor() || checkpoints.isDue()) {
+					save_gradient_descent(checkpoints, mesh, index * 2 + i, min, max, average, total);
+
+					if (!running_functor())
+						return;
+				}
+
+				//const physics::real_type newseparation(mesh.getTotalSeparation());
+				physics::real_type newmin, newmax, newaverage, newtotal;
+				const bool evaluated(relax.evaluate(mesh, phys, index, std::max(minbasecount, int(helices[index].getInitialBaseCount() + (i * 2 - 1))), total, move, newmin, newmax, newaverage, newtotal, running_functor));
+
+				// An interrupted relaxation is reverted, and the checkpoint points at its trial, so that it is evaluated again when resuming.
+				if (!running_functor()) {
+					if (evaluated)
+						relax.revert(mesh, phys, move);
+
+					save_gradient_descent(checkpoints, mesh, index * 2 + i, min, max, average, total);
+					return;
+				}
+
+				if (!evaluated)
+					continue;
+
+				if (newtotal < total) {
+					min = newmin;
+					max = newmax;
+					average = newaverage;
+					total = newtotal;
+					store_best_functor(mesh, min, max, average, total);
+				} else
+					relax.revert(mesh, phys, move);
+			}
+		}
+
+		if (relax.end(mesh, phys, running_functor)) {
+			mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+			store_best_functor(mesh, min, max, average, total);
+		}
+	}
+
+	/*
+	 * Gradient descent evaluating the trials concurrently, one per worker, each in its own replica of the scene sharing the SDK of phys.
+	 * Trials are evaluated in batches of one trial per worker, all starting from the configuration accepted before the batch.
+	 * If several trials of a batch lower the total separation, those of different helices, the better direction of each, are applied together and verified
+	 * by one more relaxation. They are all accepted if that beats the best single trial. Otherwise the trial lowering the total separation the most is accepted,
+	 * ties broken by trial order, so the result does not depend on thread timing.
+	 * Worker 0 uses the given mesh and phys, which will hold the accepted base counts on return, also when interrupted.
+	 * Checkpoints hold the accepted configuration and the first trial of the next batch, and are also saved when interrupted.
+	 */
+	template<typename StoreBestFunctorT, typename RunningFunctorT>
+	void parallel_gradient_descent(scene & mesh, physics & phys, const relaxation & relax, unsigned int workers, int minbasecount, checkpointer & checkpoints, StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
+		struct trial_type {
+			scene::HelixContainer::size_type helix;
+			int bases;
+		};
+
+		struct result_type {
+			bool evaluated;
+			relaxation::move_type move;
+			physics::real_type min, max, average, total;
+		};
+
+		const checkpoint_type *resume(checkpoints.getResume());
+
+		if (resume) {
+			std::vector<int> bases;
+			resume->best.getBaseCounts(bases);
+			set_base_counts(mesh, phys, bases);
+		}
+
+		relax.relax(mesh, phys, running_functor);
+
+		physics::real_type min, max, average, total;
+		mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+		store_best_functor(mesh, min, max, average, total);
+
+		replica_set replicas(mesh, phys, workers);
+		std::vector<scene *> & scenes(replicas.scenes);
+		std::vector<physics *> & physicses(replicas.physicses);
+
+		for (unsigned int i = 0; i < workers; ++i)
+			relax.begin(*scenes[i], *physicses[i]);
+
+		std::vector<trial_type> trials;
+		trials.reserve(mesh.getHelixCount() * 2);
+		for (scene::HelixContainer::size_type i = 0; i < mesh.getHelixCount(); ++i) {
+			for (int j = 0; j < 2; ++j) {
+				const trial_type trial = { i, std::max(minbasecount, int(mesh.getHelices()[i].getInitialBaseCount() + (j * 2 - 1))) };
+				trials.push_back(trial);
+			}
+		}
+
+		std::vector<result_type> results(workers);
+		relaxation::combined_move_type combined;
+		thread_pool pool(workers);
+
+		// An interrupted batch is reverted in every replica, and the checkpoint points at it, so that it is evaluated again when resuming.
+		for (size_t batch = resume ? size_t(resume->position) : 0; batch < trials.size(); batch += workers) {
+			if (!running_functor() || checkpoints.isDue()) {
+				save_gradient_descent(checkpoints, mesh, batch, min, max, average, total);
+
+				if (!running_functor())
+					return;
+			}
+
+			pool.run([&](unsigned int worker) {
+				result_type & result(results[worker]);
+				result.evaluated = false;
+				if (batch + worker >= trials.size())
+					return;
+
+				const trial_type & trial(trials[batch + worker]);
+				result.evaluated = relax.evaluate(*scenes[worker], *physicses[worker], trial.helix, trial.bases, total, result.move, result.min, result.max, result.average, result.total, running_functor);
+			});
+
+			if (!running_functor()) {
+				pool.run([&](unsigned int worker) {
+					if (results[worker].evaluated)
+						relax.revert(*scenes[worker], *physicses[worker], results[worker].move);
+				});
+
+				save_gradient_descent(checkpoints, mesh, batch, min, max, average, total);
+				return;
+			}
+
+			unsigned int best(workers);
+			for (unsigned int worker = 0; worker < workers; ++worker) {
+				if (results[worker].evaluated && results[worker].total < (best == workers ? total : results[best].total))
+					best = worker;
+			}
+
+			// The improving trials, in trial order. The two trials of a helix are adjacent, and only the better one is kept.
+			combined.changes.clear();
+			for (unsigned int worker = 0; worker < workers; ++worker) {
+				if (!results[worker].evaluated || results[worker].total >= total)
+					continue;
+
+				const trial_type & trial(trials[batch + worker]);
+				if (!combined.changes.empty() && combined.changes.back().first == trial.helix) {
+					if (results[worker].total < results[worker - 1].total)
+						combined.changes.back().second = trial.bases;
+				} else
+					combined.changes.push_back(std::make_pair(trial.helix, trial.bases));
+			}
+
+			// Bring every replica but the best back to the accepted configuration.
+			pool.run([&](unsigned int worker) {
+				if (worker != best && results[worker].evaluated)
+					relax.revert(*scenes[worker], *physicses[worker], results[worker].move);
+			});
+
+			// Verified in a replica other than the best.
+			bool merged(false);
+			if (combined.changes.size() > 1) {
+				const unsigned int verifier(best == 0 ? 1 : 0);
+				relax.apply(*scenes[verifier], *physicses[verifier], combined, running_functor);
+
+				physics::real_type newmin, newmax, newaverage, newtotal;
+				scenes[verifier]->getTotalSeparationMinMaxAverage(newmin, newmax, newaverage, newtotal);
+
+				if (!running_functor()) {
+					relax.revert(*scenes[verifier], *physicses[verifier], combined);
+					relax.revert(*scenes[best], *physicses[best], results[best].move);
+
+					save_gradient_descent(checkpoints, mesh, batch, min, max, average, total);
+					return;
+				}
+
+				if (newtotal < results[best].total) {
+					relax.revert(*scenes[best], *physicses[best], results[best].move);
+
+					min = newmin;
+					max = newmax;
+					average = newaverage;
+					total = newtotal;
+					store_best_functor(*scenes[verifier], min, max, average, total);
+
+					pool.run([&](unsigned int worker) {
+						if (worker != verifier)
+							relax.replicate(*scenes[worker], *physicses[worker], *scenes[verifier], combined);
+					});
+					merged = true;
+				} else
+					relax.revert(*scenes[verifier], *physicses[verifier], combined);
+			}
+
+			if (!merged && best != workers) {
+				min = results[best].min;
+				max = results[best].max;
+				average = results[best].average;
+				total = results[best].total;
+				store_best_functor(*scenes[best], min, max, average, total);
+
+				pool.run([&](unsigned int worker) {
+					if (worker != best)
+						relax.replicate(*scenes[worker], *physicses[worker], *scenes[best], results[best].move);
+				});
+			}
+		}
+
+		if (relax.end(mesh, phys, running_functor)) {
+			mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+			store_best_functor(mesh, min, max, average, total);
+		}
+	}
+
+	/*
+	 * Parallel tempering: Chains of the simulated annealing moves, each at a fixed temperature, in its own replica of the scene and drawing from its own random number generator.
+	 * The temperatures are spaced geometrically between settings.min_temperature and settings.max_temperature. Every settings.exchange_interval moves, the chains
+	 * synchronize and chains at neighboring temperatures exchange them by the Metropolis criterion, alternating between even and odd pairs.
+	 * The hot chains cross barriers the cold ones can not, and pass good configurations down the ladder. Every configuration lower than the best found by any chain is stored.
+	 * As the chains only interact at the exchanges, a given seed gives the same trajectories regardless of thread timing.
+	 * In local mode, mesh is brought to the best configuration before the final relaxation.
+	 */
+	template<typename StoreBestFunctorT, typename RunningFunctorT>
+	void parallel_tempering(scene & mesh, physics & phys, const relaxation & relax, const settings_type & settings, int minbasecount, int baserange,
+			checkpointer & checkpoints, StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
+		struct chain_type {
+			std::mt19937_64 generator;
+			relaxation::move_type move;
+			physics::real_type total; // Of the current configuration.
+			unsigned int temperature; // Index into the temperatures.
+		};
+
+		const unsigned int chainCount(std::max(1u, settings.chains));
+		const unsigned int exchangeInterval(std::max(1u, settings.exchange_interval));
+		const unsigned int seed(settings.seed == 0 ? static_cast<unsigned int>(rand()) : settings.seed);
+		const checkpoint_type *resume(checkpoints.getResume());
+
+		relax.relax(mesh, phys, running_functor);
+
+		physics::real_type min, max, average, total;
+
+		// The best configuration of a checkpoint is already stored, and usually not the one the chains continue from.
+		if (resume) {
+			min = resume->min;
+			max = resume->max;
+			average = resume->average;
+			total = resume->total;
+		} else {
+			mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+			store_best_functor(mesh, min, max, average, total);
+		}
+
+		std::cerr << "Parallel tempering with " << chainCount << " chains, seed: " << seed << std::endl;
+
+		replica_set replicas(mesh, phys, chainCount);
+
+		std::vector<physics::real_type> temperatures(chainCount);
+		std::vector<unsigned int> chain_at(chainCount); // The chain at every temperature.
+		std::vector<chain_type> chains(chainCount);
+
+		for (unsigned int i = 0; i < chainCount; ++i) {
+			const float t(chainCount == 1 ? settings.min_temperature : settings.min_temperature * std::pow(settings.max_temperature / settings.min_temperature, float(i) / (chainCount - 1)));
+			temperatures[i] = physics::real_type(t * mesh.getHelixCount());
+			chain_at[i] = i;
+
+			if (resume) {
+				const checkpoint_type::chain_type & saved(resume->chains[i]);
+				scene & chain_mesh(*replicas.scenes[i]);
+				physics & chain_phys(*replicas.physicses[i]);
+
+				set_base_counts(chain_mesh, chain_phys, saved.bases);
+				relax.relax(chain_mesh, chain_phys, running_functor);
+
+				std::istringstream(saved.generator) >> chains[i].generator;
+				chains[i].total = chain_mesh.getTotalSeparation();
+				chains[i].temperature = saved.temperature;
+				chain_at[saved.temperature] = i;
+			} else {
+				std::seed_seq sequence = { seed, i + 1 };
+				chains[i].generator.seed(sequence);
+				chains[i].total = total;
+				chains[i].temperature = i;
+			}
+
+			relax.begin(*replicas.scenes[i], *replicas.physicses[i]);
+		}
+
+		std::mt19937_64 exchange_generator(seed);
+		std::uniform_real_distribution<double> exchange_distribution;
+
+		if (resume)
+			std::istringstream(resume->generator) >> exchange_generator;
+
+		std::vector<int> best_bases;
+		SceneDescription best; // Kept for the checkpoints, as the stored one belongs to the caller.
+
+		if (resume) {
+			resume->best.getBaseCounts(best_bases);
+
+			if (checkpoints.isEnabled())
+				best = SceneDescription(resume->best);
+		} else {
+			mesh.getBaseCounts(best_bases);
+
+			if (checkpoints.isEnabled())
+				best = SceneDescription(mesh);
+		}
+
+		std::mutex best_mutex;
+		thread_pool pool(chainCount);
+
+		const unsigned int first(resume ? static_cast<unsigned int>(resume->position) : 0);
+
+		for (unsigned int done = first, round = first / exchangeInterval; done < settings.iterations && running_functor(); done += exchangeInterval, ++round) {
+			const unsigned int moves(std::min(exchangeInterval, settings.iterations - done));
+
+			// Between rounds every chain is in an accepted configuration. An interrupted round is not saved, so it is done again when resuming.
+			if (checkpoints.isDue()) {
+				checkpoint_type checkpoint;
+				checkpoint.optimizer = checkpoint_type::kParallelTempering;
+				checkpoint.position = done;
+				checkpoint.best = SceneDescription(best);
+				checkpoint.min = min;
+				checkpoint.max = max;
+				checkpoint.average = average;
+				checkpoint.total = total;
+
+				for (unsigned int i = 0; i < chainCount; ++i) {
+					checkpoint_type::chain_type chain;
+					replicas.scenes[i]->getBaseCounts(chain.bases);
+					chain.total = chains[i].total;
+					chain.temperature = chains[i].temperature;
+
+					std::ostringstream generator;
+					generator << chains[i].generator;
+					chain.generator = generator.str();
+					checkpoint.chains.push_back(chain);
+				}
+
+				std::ostringstream generator;
+				generator << exchange_generator;
+				checkpoint.generator = generator.str();
+
+				checkpoints.save(checkpoint);
+			}
+
+			pool.run([&](unsigned int worker) {
+				chain_type & chain(chains[worker]);
+				scene & chain_mesh(*replicas.scenes[worker]);
+				physics & chain_phys(*replicas.physicses[worker]);
+				scene::HelixContainer & helices(chain_mesh.getHelices());
+				const physics::real_type temperature(temperatures[chain.temperature]);
+
+				std::uniform_int_distribution<scene::HelixContainer::size_type> helix_distribution(0, helices.size() - 1);
+				std::uniform_int_distribution<int> offset_distribution(1, std::max(1, baserange));
+				std::bernoulli_distribution sign_distribution;
+				std::uniform_real_distribution<float> acceptance_distribution;
+
+				for (unsigned int k = 0; k < moves && running_functor(); ++k) {
+					const scene::HelixContainer::size_type modifiedHelix(helix_distribution(chain.generator));
+					const int bases(int(helices[modifiedHelix].getInitialBaseCount()) + (sign_distribution(chain.generator) ? 1 : -1) * offset_distribution(chain.generator));
+
+					// The Metropolis criterion, accepting the move with probability exp((total - newtotal) / temperature), expressed as a threshold so that the cache can skip it.
+					const physics::real_type threshold(chain.total - temperature * std::log(std::max(acceptance_distribution(chain.generator), std::numeric_limits<float>::min())));
+
+					physics::real_type newmin, newmax, newaverage, newtotal;
+					if (!relax.evaluate(chain_mesh, chain_phys, modifiedHelix, std::max(minbasecount, bases), threshold, chain.move, newmin, newmax, newaverage, newtotal, running_functor))
+						continue;
+
+					if (newtotal >= threshold) {
+						relax.revert(chain_mesh, chain_phys, chain.move);
+						continue;
+					}
+
+					chain.total = newtotal;
+
+					std::lock_guard<std::mutex> lock(best_mutex);
+					if (newtotal < total) {
+						min = newmin;
+						max = newmax;
+						average = newaverage;
+						total = newtotal;
+						store_best_functor(chain_mesh, min, max, average, total);
+						chain_mesh.getBaseCounts(best_bases);
+
+						if (checkpoints.isEnabled())
+							best = SceneDescription(chain_mesh);
+					}
+				}
+			});
+
+			if (!running_functor())
+				break;
+
+			for (unsigned int i = round % 2; i + 1 < chainCount; i += 2) {
+				chain_type & cold(chains[chain_at[i]]), & hot(chains[chain_at[i + 1]]);
+				const double exponent((1.0 / temperatures[i] - 1.0 / temperatures[i + 1]) * (double(cold.total) - double(hot.total)));
+
+				if (exponent >= 0 || exchange_distribution(exchange_generator) < std::exp(exponent)) {
+					std::swap(chain_at[i], chain_at[i + 1]);
+					std::swap(cold.temperature, hot.temperature);
+				}
+			}
+		}
+
+		if (relax.isLocal()) {
+			scene::HelixContainer & helices(mesh.getHelices());
+
+			for (scene::HelixContainer::size_type i = 0; i < helices.size(); ++i) {
+				if (int(helices[i].getBaseCount()) != best_bases[i]) {
+					helices[i].setFrozen(phys, false);
+					helices[i].resize(phys, best_bases[i], helices[i].getTransform());
+				}
+			}
+		}
+
+		if (relax.end(mesh, phys, running_functor)) {
+			mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+			store_best_functor(mesh, min, max, average, total);
+		}
+	}
+
+	/*
+	 * Does a simple rectification of the structure without modification.
+	 */
+	template<typename StoreBestFunctorT, typename RunningFunctorT>
+	void simulated_rectification(scene & mesh, physics & phys, const relaxation & relax, StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
+		relax.relax(mesh, phys, running_functor);
+
+		physics::real_type min, max, average, total;
+		mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+		store_best_functor(mesh, min, max, average, total);
+	}
+
+	/*
+	 * Runs the optimizer selected by settings.algorithm. The best configuration found is passed to store_best_functor with its min, max, average and total separation.
+	 * Only gradient descent and parallel tempering write checkpoints.
+	 */
+	template<typename StoreBestFunctorT, typename RunningFunctorT>
+	void optimize(scene & mesh, physics & phys, const relaxation & relax, const settings_type & settings, int minbasecount, checkpointer & checkpoints, StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
+		switch (settings.algorithm) {
+		case kSimulatedRectification:
+			simulated_rectification(mesh, phys, relax, store_best_functor, running_functor);
+			break;
+		case kSimulatedAnnealing:
+			simulated_annealing(mesh, phys, relax, int(settings.iterations), 0, static_cast<unsigned int>(minbasecount), 1,
+				[&store_best_functor](scene & mesh, float) {
+					physics::real_type min, max, average, total;
+					mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+					store_best_functor(mesh, min, max, average, total);
+				}, running_functor);
+			break;
+		case kUnknownAlgorithm:
+			throw std::runtime_error("Unknown optimizer");
+		default:
+			{
+				const unsigned int workers(settings.workers == 0 ? numcpucores() : settings.workers);
+
+				if (settings.chains > 0)
+					parallel_tempering(mesh, phys, relax, settings, minbasecount, 1, checkpoints, store_best_functor, running_functor);
+				else if (workers > 1)
+					parallel_gradient_descent(mesh, phys, relax, workers, minbasecount, checkpoints, store_best_functor, running_functor);
+				else
+					gradient_descent(mesh, phys, relax, minbasecount, checkpoints, store_best_functor, running_functor);
+			}
+			break;
+		}
+	}
+}
+
+#endif /* _OPTIMIZER_H_ */
@@ -1,7 +1,12 @@
 #ifndef _PARSE_SETTINGS_H_
 #define _PARSE_SETTINGS_H_
 
+#include <Batch.h>
 #include <Helix.h>
+#include <Metrics.h>
+#include <Optimizer.h>
+#include <Profiler.h>
+#include <Relaxation.h>
 #include <Scene.h>
 
 #include <cassert>
@@ -20,6 +25,39 @@ private:
 		}
 	};
 
+	struct string_to_engine : public std::unary_function<const char *, physics::Engine> {
+		inline physics::Engine operator()(const char *str) const {
+			if (stricmp("native", str) == 0)
+				return physics::kNative;
+			else if (stricmp("minimizer", str) == 0)
+				return physics::kMinimizer;
+			else
+				return physics::kPhysX;
+		}
+	};
+
+	struct string_to_profile : public std::unary_function<const char *, physics::Profile> {
+		inline physics::Profile operator()(const char *str) const {
+			if (stricmp("fast", str) == 0)
+				return physics::kFast;
+			else if (stricmp("accurate", str) == 0)
+				return physics::kAccurate;
+			else
+				return physics::kBalanced;
+		}
+	};
+
+	struct string_to_geometry : public std::unary_function<const char *, Helix::Geometry> {
+		inline Helix::Geometry operator()(const char *str) const {
+			if (stricmp("capsule", str) == 0)
+				return Helix::kCapsuleGeometry;
+			else if (stricmp("none", str) == 0)
+				return Helix::kNoGeometry;
+			else
+				return Helix::kFullGeometry;
+		}
+	};
+
 	template<typename T>
 	struct identity : public std::unary_function<T, T> {
 		inline T operator()(T && t) const {
@@ -29,24 +67,62 @@ private:
 
 public:
 
-	static void parse(int argc, const char **argv, physics::settings_type & physics_settings, scene::settings_type & scene_settings, Helix::settings_type & helix_settings, std::string & input_file, std::string & output_file) {
+	static void parse(int argc, const char **argv, physics::settings_type & physics_settings, scene::settings_type & scene_settings, Helix::settings_type & helix_settings, relaxation::settings_type & relaxation_settings, optimizer::settings_type & optimizer_settings, batch::settings_type & batch_settings, metrics::settings_type & metrics_settings, profiler::settings_type & profiler_settings, trace::settings_type & trace_settings, std::string & input_file, std::string & output_file) {
 
 		physics_settings.kStaticFriction = physics::real_type(0.5);
 		physics_settings.kDynamicFriction = physics::real_type(0.5);
 		physics_settings.kRestitution = physics::real_type(1.0);
 		physics_settings.kRigidBodySleepThreshold = physics::real_type(0.001);
 		physics_settings.visual_debugger = true;
+#ifdef WITHOUT_PHYSX
+		physics_settings.engine = physics::kNative;
+#else
+		physics_settings.engine = physics::kPhysX;
+#endif /* N WITHOUT_PHYSX */
+		physics_settings.contact_stiffness = physics::real_type(1000);
+		physics_settings.profile = physics::kBalanced;
+		physics_settings.filter_adjacent = true;
 		scene_settings.initial_scaling = physics::real_type(1.0);
 		scene_settings.discretize_lengths = true;
+		scene_settings.separation_epsilon = physics::real_type(0);
 		helix_settings.attach_fixed = true;
 		helix_settings.density = physics::real_type(10);
 		helix_settings.spring_stiffness = physics::real_type(100);
 		helix_settings.fixed_spring_stiffness = physics::real_type(1000);
 		helix_settings.spring_damping = physics::real_type(100);
+		relaxation_settings.hops = 0;
+		relaxation_settings.global_relaxation = true;
+		relaxation_settings.warm_start = false;
+		relaxation_settings.max_steps = 0;
+		relaxation_settings.convergence_window = 60;
+		relaxation_settings.separation_tolerance = physics::real_type(0.0001);
+		relaxation_settings.kinetic_energy_threshold = physics::real_type(0.001);
+		relaxation_settings.report_convergence = false;
+		relaxation_settings.min_timestep = physics::real_type(1.0 / 60.0);
+		relaxation_settings.max_timestep = physics::real_type(1.0 / 60.0);
+		relaxation_settings.stability_threshold = physics::real_type(0.1);
+		relaxation_settings.substeps = 1;
+		relaxation_settings.coarse_geometry = Helix::kFullGeometry;
+		relaxation_settings.gradient_tolerance = physics::real_type(0.1);
+		relaxation_settings.cache_size = 256;
+		relaxation_settings.cache_poses = true;
+		optimizer_settings.algorithm = optimizer::kGradientDescent;
+		optimizer_settings.workers = 1;
+		optimizer_settings.chains = 0;
+		optimizer_settings.iterations = 1000;
+		optimizer_settings.exchange_interval = 10;
+		optimizer_settings.min_temperature = 0.01f;
+		optimizer_settings.max_temperature = 0.5f;
+		optimizer_settings.seed = 0;
+		optimizer_settings.checkpoint_interval = 0;
+		batch_settings.jobs = 1;
+		metrics_settings.interval = 1;
+		profiler_settings.enabled = false;
 
 		parse_settings parser( {
 			make_argument("scaling", scene_settings.initial_scaling, std::ptr_fun(&atof)),
 			make_argument("discretize_lengths", scene_settings.discretize_lengths, string_to_bool()),
+			make_argument("separation_epsilon", scene_settings.separation_epsilon, std::ptr_fun(&atof)),
 
 			make_argument("density", helix_settings.density, std::ptr_fun(&atof)),
 			make_argument("spring_stiffness", helix_settings.spring_stiffness, std::ptr_fun(&atof)),
@@ -59,6 +135,47 @@ public:
 			make_argument("restitution", physics_settings.kRestitution, std::ptr_fun(&atof)),
 			make_argument("rigid_body_sleep_threshold", physics_settings.kRigidBodySleepThreshold, std::ptr_fun(&atof)),
 			make_argument("visual_debugger", physics_settings.visual_debugger, string_to_bool()),
+			make_argument("engine", physics_settings.engine, string_to_engine()),
+			make_argument("contact_stiffness", physics_settings.contact_stiffness, std::ptr_fun(&atof)),
+			make_argument("sim_profile", physics_settings.profile, string_to_profile()),
+			make_argument("filter_adjacent", physics_settings.filter_adjacent, string_to_bool()),
+
+			make_argument("relaxation_hops", relaxation_settings.hops, std::ptr_fun(&atoi)),
+			make_argument("global_relaxation", relaxation_settings.global_relaxation, string_to_bool()),
+			make_argument("warm_start", relaxation_settings.warm_start, string_to_bool()),
+			make_argument("max_steps", relaxation_settings.max_steps, std::ptr_fun(&atoi)),
+			make_argument("convergence_window", relaxation_settings.convergence_window, std::ptr_fun(&atoi)),
+			make_argument("separation_tolerance", relaxation_settings.separation_tolerance, std::ptr_fun(&atof)),
+			make_argument("kinetic_energy_threshold", relaxation_settings.kinetic_energy_threshold, std::ptr_fun(&atof)),
+			make_argument("report_convergence", relaxation_settings.report_convergence, string_to_bool()),
+			make_argument("min_timestep", relaxation_settings.min_timestep, std::ptr_fun(&atof)),
+			make_argument("max_timestep", relaxation_settings.max_timestep, std::ptr_fun(&atof)),
+			make_argument("stability_threshold", relaxation_settings.stability_threshold, std::ptr_fun(&atof)),
+			make_argument("substeps", relaxation_settings.substeps, std::ptr_fun(&atoi)),
+			make_argument("coarse_geometry", relaxation_settings.coarse_geometry, string_to_geometry()),
+			make_argument("gradient_tolerance", relaxation_settings.gradient_tolerance, std::ptr_fun(&atof)),
+			make_argument("cache_size", relaxation_settings.cache_size, std::ptr_fun(&atoi)),
+			make_argument("cache_poses", relaxation_settings.cache_poses, string_to_bool()),
+
+			make_argument("optimizer", optimizer_settings.algorithm, std::ptr_fun(&optimizer::algorithm_by_name)),
+			make_argument("workers", optimizer_settings.workers, std::ptr_fun(&atoi)),
+			make_argument("chains", optimizer_settings.chains, std::ptr_fun(&atoi)),
+			make_argument("iterations", optimizer_settings.iterations, std::ptr_fun(&atoi)),
+			make_argument("exchange_interval", optimizer_settings.exchange_interval, std::ptr_fun(&atoi)),
+			make_argument("min_temperature", optimizer_settings.min_temperature, std::ptr_fun(&atof)),
+			make_argument("max_temperature", optimizer_settings.max_temperature, std::ptr_fun(&atof)),
+			make_argument("seed", optimizer_settings.seed, std::ptr_fun(&atoi)),
+			make_argument("checkpoint_interval", optimizer_settings.checkpoint_interval, std::ptr_fun(&atof)),
+			make_argument("resume", optimizer_settings.resume, identity<std::string>()),
+
+			make_argument("batch", batch_settings.manifest, identity<std::string>()),
+			make_argument("jobs", batch_settings.jobs, std::ptr_fun(&atoi)),
+			make_argument("summary", batch_settings.summary, identity<std::string>()),
+
+			make_argument("metrics", metrics_settings.filename, identity<std::string>()),
+			make_argument("metrics_interval", metrics_settings.interval, std::ptr_fun(&atof)),
+			make_argument("profile", profiler_settings.enabled, string_to_bool()),
+			make_argument("trace", trace_settings.filename, identity<std::string>()),
 
 			make_argument("input", input_file, identity<std::string>()),
 			make_argument("output", output_file, identity<std::string>())
@@ -71,8 +188,14 @@ public:
 		ss << "Usage: " << name << std::endl
 			<< "\t--input=<filename>" << std::endl
 			<< "\t--output=<filename>" << std::endl
+			<< "or" << std::endl
+			<< "\t--batch=<filename>" << std::endl
+			<< "\t[ --jobs=<integer> ]" << std::endl
+			<< "\t[ --summary=<filename> ]" << std::endl
+			<< "with" << std::endl
 			<< "\t[ --scaling=<decimal> ]" << std::endl
 			<< "\t[ --discretize_lengths=<true|false> ]" << std::endl
+			<< "\t[ --separation_epsilon=<decimal> ]" << std::endl
 			<< "\t[ --density=<decimal> ]" << std::endl
 			<< "\t[ --spring_stiffness=<decimal> ]" << std::endl
 			<< "\t[ --fixed_spring_stiffness=<decimal> ]" << std::endl
@@ -82,7 +205,41 @@ public:
 			<< "\t[ --dynamic_friction=<decimal> ]" << std::endl
 			<< "\t[ --restitution=<decimal> ]" << std::endl
 			<< "\t[ --rigid_body_sleep_threshold=<decimal> ]" << std::endl
-			<< "\t[ --visual_debugger=<true|false> ] " << std::endl;
+			<< "\t[ --visual_debugger=<true|false> ] " << std::endl
+			<< "\t[ --engine=<physx|native|minimizer> ]" << std::endl
+			<< "\t[ --contact_stiffness=<decimal> ]" << std::endl
+			<< "\t[ --sim_profile=<fast|balanced|accurate> ]" << std::endl
+			<< "\t[ --filter_adjacent=<true|false> ]" << std::endl
+			<< "\t[ --relaxation_hops=<integer> ]" << std::endl
+			<< "\t[ --global_relaxation=<true|false> ]" << std::endl
+			<< "\t[ --warm_start=<true|false> ]" << std::endl
+			<< "\t[ --max_steps=<integer> ]" << std::endl
+			<< "\t[ --convergence_window=<integer> ]" << std::endl
+			<< "\t[ --separation_tolerance=<decimal> ]" << std::endl
+			<< "\t[ --kinetic_energy_threshold=<decimal> ]" << std::endl
+			<< "\t[ --report_convergence=<true|false> ]" << std::endl
+			<< "\t[ --min_timestep=<decimal> ]" << std::endl
+			<< "\t[ --max_timestep=<decimal> ]" << std::endl
+			<< "\t[ --stability_threshold=<decimal> ]" << std::endl
+			<< "\t[ --substeps=<integer> ]" << std::endl
+			<< "\t[ --coarse_geometry=<full|capsule|none> ]" << std::endl
+			<< "\t[ --gradient_tolerance=<decimal> ]" << std::endl
+			<< "\t[ --cache_size=<integer> ]" << std::endl
+			<< "\t[ --cache_poses=<true|false> ]" << std::endl
+			<< "\t[ --optimizer=<gradient_descent|simulated_annealing|simulated_rectification> ]" << std::endl
+			<< "\t[ --workers=<integer> ]" << std::endl
+			<< "\t[ --chains=<integer> ]" << std::endl
+			<< "\t[ --iterations=<integer> ]" << std::endl
+			<< "\t[ --exchange_interval=<integer> ]" << std::endl
+			<< "\t[ --min_temperature=<decimal> ]" << std::endl
+			<< "\t[ --max_temperature=<decimal> ]" << std::endl
+			<< "\t[ --seed=<integer> ]" << std::endl
+			<< "\t[ --checkpoint_interval=<decimal> ]" << std::endl
+			<< "\t[ --resume=<filename> ]" << std::endl
+			<< "\t[ --metrics=<filename> ]" << std::endl
+			<< "\t[ --metrics_interval=<decimal> ]" << std::endl
+			<< "\t[ --profile=<true|false> ]" << std::endl
+			<< "\t[ --trace=<filename> ]" << std::endl;
 		return ss.str();
 	}
 
@@ -118,7 +275,8 @@ private:
 			const char *equal(strchr(argv[i], '='));
 			if (equal && argv[i][0] == '-' && argv[i][1] == '-') {
 				for (argument *arg : args) {
-					if (strncmp(arg->name, argv[i] + 2, equal - argv[i] - 2) == 0)
+					// The whole name must match, as some are prefixes of others.
+					if (strlen(arg->name) == size_t(equal - argv[i] - 2) && strncmp(arg->name, argv[i] + 2, equal - argv[i] - 2) == 0)
 						arg->parse(equal + 1);
 				}
 			}
@@ -1,20 +1,49 @@
 #ifndef _PHYSICS_H_
 #define _PHYSICS_H_
 
+#ifdef WITHOUT_PHYSX
+#include <NativePhysics.h>
+#else
 #include <PxPhysicsAPI.h>
+#endif /* N WITHOUT_PHYSX */
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <functional>
 #include <initializer_list>
+#include <memory>
+#include <unordered_set>
+#include <vector>
 
 /*
  * All NVIDIA PhysX stuff should reside in here. For easy switching of physics engines in the future.
+ * Defining WITHOUT_PHYSX builds without the PhysX SDK, using the types of NativePhysics.h. Only the native and minimizer engines are available then.
  */
 
 #define PVD_HOST "127.0.0.1"
 #define PVD_PORT 5425
 
+class spring_network;
+
+namespace trace {
+	class zone_recorder;
+}
+
 class physics {
 public:
+#ifdef WITHOUT_PHYSX
+	typedef native::quaternion quaternion_type;
+	typedef native::real_type real_type;
+	typedef native::rigid_transform transform_type;
+	typedef native::vec3 vec3_type;
+
+	typedef native::rigid_body rigid_body_type;
+	typedef native::spring_joint spring_joint_type;
+	typedef native::sphere_geometry sphere_geometry_type;
+	typedef native::capsule_geometry capsule_geometry_type;
+	typedef native::shape shape_type;
+#else
 	typedef physx::PxQuat quaternion_type;
 	typedef physx::PxReal real_type;
 	typedef physx::PxTransform transform_type;
@@ -24,52 +53,271 @@ public:
 	typedef physx::PxDistanceJoint spring_joint_type;
 	typedef physx::PxSphereGeometry sphere_geometry_type;
 	typedef physx::PxCapsuleGeometry capsule_geometry_type;
+	typedef physx::PxShape shape_type;
+#endif /* N WITHOUT_PHYSX */
 
 	static const quaternion_type quaternion_identity;
 
+	// Everything needed to put a rigid body back into a previous state of the simulation.
+	struct body_state_type {
+		transform_type pose;
+		vec3_type linear_velocity, angular_velocity;
+	};
+
+	// Mass, principal moments of inertia and the frame they are given in, relative to the rigid body.
+	struct mass_properties_type {
+		real_type mass;
+		vec3_type inertia;
+		transform_type local_pose;
+	};
+
+	enum Engine {
+		kPhysX = 0,
+		kNative = 1, // The spring network of SpringNetwork.h. PhysX still holds the scene, if built with it, but does not simulate it.
+		kMinimizer = 2 // The same spring network, minimizing its energy instead of simulating it.
+	};
+
+	// Configurations of the PhysX scene, applied by prepare_scene. Only the scene limits and the scratch block matter to the spring network engines.
+	enum Profile {
+		kFast = 0, // 2 position and 1 velocity solver iterations, multi box pruning over regions covering the structure.
+		kBalanced = 1, // The solver iterations and sweep and prune broadphase of PhysX by default.
+		kAccurate = 2 // 8 position and 2 velocity solver iterations, persistent contact manifolds.
+	};
+
+	// Why minimize stopped.
+	enum Minimization {
+		kMinimum = 0, // No force or torque exceeds the gradient tolerance.
+		kStalled = 1, // The energy could not be lowered any further, while the gradient tolerance was not reached.
+		kIterationCap = 2,
+		kStopped = 3 // By the running functor.
+	};
+
 	struct settings_type {
 		real_type kStaticFriction, kDynamicFriction, kRestitution;
 		real_type kRigidBodySleepThreshold;
 
 		bool visual_debugger;
+
+		Engine engine;
+		real_type contact_stiffness; // Native engine only. Stiffness of the penalty springs pushing overlapping helices apart, 0 disables collisions.
+
+		Profile profile;
+		bool filter_adjacent; // PhysX engine only. Bodies sharing exactly one vertex do not collide, see set_collision_vertices.
 	};
 
-	physics(const settings_type & settings); // throws exceptions.
-	~physics();
+	physics(const settings_type & settings); // throws exceptions, also for the PhysX engine when built without PhysX.
+
+	/*
+	 * Creates a new, empty scene sharing the foundation, SDK and material of an existing physics instance. Useful for evaluating several configurations concurrently.
+	 * The shared instance must outlive the replica. threads is the number of worker threads used by the scene's dispatcher.
+	 */
+	physics(physics & shared, unsigned int threads);
+	physics(physics & shared, const settings_type & settings, unsigned int threads); // As above, with other settings for the scene. The friction and restitution of the shared material apply.
+	~physics(); // Out of line, as spring_network and trace::zone_recorder are incomplete here.
+
+	physics(const physics &) = delete;
+	physics & operator=(const physics &) = delete;
 
 	/*
 	 * Creates a rigid body with the given geometries as variadic template arguments.
 	 * For every geometry argument, std::get<0> will be used to get the PxGeometry, std::get<1> will be used to obtain the PxTransform. Use std::pair or std::tuple.
 	 */
 	template<typename GeometryT, typename... GeometryListT>
-	rigid_body_type *create_rigid_body(const transform_type & transform, real_type density, const GeometryT & geometry, GeometryListT &... geometries) {
+	rigid_body_type *create_rigid_body(const transform_type & transform, real_type density, const GeometryT & geometry, const GeometryListT &... geometries) {
+#ifdef WITHOUT_PHYSX
+		rigid_body_type *rigid_body(new rigid_body_type(transform));
+		rigid_body->createShape(std::get<0>(geometry), std::get<1>(geometry));
+		set_mass(*rigid_body, density, std::get<0>(geometry), std::get<1>(geometry));
+
+		internal_rigid_body_attach_geometry(*rigid_body, geometries...);
+
+		rigid_bodies.insert(rigid_body);
+#else
 		physx::PxRigidDynamic *rigid_body(physx::PxCreateDynamic(*pxphysics, transform, std::get<0>(geometry), *material, density, std::get<1>(geometry)));
 		assert(rigid_body != nullptr);
 
 		rigid_body->setSleepThreshold(settings.kRigidBodySleepThreshold);
+		rigid_body->setSolverIterationCounts(position_iterations, velocity_iterations);
 
 		internal_rigid_body_attach_geometry(*rigid_body, geometries...);
 
 		scene->addActor(*rigid_body);
+#endif /* N WITHOUT_PHYSX */
 		return rigid_body;
 	}
 
+	/*
+	 * Recreates the empty scene as configured by the profile of the settings, sized for the given number of rigid bodies, their shapes and spring joints,
+	 * placed within lower and upper. Call before creating the rigid bodies of a structure. A scene already holding rigid bodies is left as is.
+	 */
+	void prepare_scene(const vec3_type & lower, const vec3_type & upper, unsigned int rigid_bodies, unsigned int shapes, unsigned int spring_joints);
+
 	sphere_geometry_type create_sphere_geometry(real_type radius);
 	capsule_geometry_type create_x_axis_capsule(real_type radius, real_type half_height);
 
 	spring_joint_type *create_spring_joint(rigid_body_type *rigid_body1, const transform_type & transform1, rigid_body_type *rigid_body2, const transform_type & transform2, real_type stiffness, real_type damping);
 
 	inline void destroy_spring_joint(spring_joint_type *) {} // physx takes care of joints. Note that this does not detach the spring from the rigid body when called!
-	inline void destroy_rigid_body(rigid_body_type *rigid_body) const { scene->removeActor(*rigid_body); rigid_body->release(); }
+	void destroy_rigid_body(rigid_body_type *rigid_body); // Without PhysX, the springs attached to the rigid body are destroyed along with it.
+
+	/*
+	 * In place modification of existing rigid bodies and joints. Cheaper than destroying and recreating them, as the actor stays in the broadphase and the joints are kept.
+	 */
+
+	// Fills shapes with at most count shapes of the rigid body, in the order they were attached, and returns the number written.
+	inline unsigned int get_shapes(const rigid_body_type & rigid_body, shape_type **shapes, unsigned int count) const {
+		return rigid_body.getShapes(shapes, count);
+	}
+
+	// A shape not simulated is ignored by the collision detection, but stays attached.
+	inline void set_shape_simulated(shape_type & shape, bool simulated) const {
+#ifdef WITHOUT_PHYSX
+		shape.simulated = simulated;
+#else
+		shape.setFlag(physx::PxShapeFlag::eSIMULATION_SHAPE, simulated);
+#endif /* N WITHOUT_PHYSX */
+	}
+
+	// The geometry must be of the same type as the shape was created with.
+	template<typename GeometryT>
+	inline void set_shape_geometry(shape_type & shape, const GeometryT & geometry, const transform_type & local_pose) const {
+		shape.setGeometry(geometry);
+		shape.setLocalPose(local_pose);
+	}
+
+	// Set the mass properties as create_rigid_body does, that is from the first geometry only, with the given density.
+	void set_mass(rigid_body_type & rigid_body, real_type density, const capsule_geometry_type & geometry, const transform_type & local_pose) const;
+	void set_mass(rigid_body_type & rigid_body, real_type density, const sphere_geometry_type & geometry, const transform_type & local_pose) const;
+
+	// Moves the attachment point of the joint on the given rigid body, or the world attachment point if rigid_body is NULL.
+	void set_spring_joint_local_frame(spring_joint_type *joint, const rigid_body_type *rigid_body, const transform_type & transform) const;
+
+	// Moves the rigid body to the transform, puts it at rest and wakes it up.
+	void reset_rigid_body(rigid_body_type & rigid_body, const transform_type & transform) const;
+
+	inline body_state_type get_state(const rigid_body_type & rigid_body) const {
+		const body_state_type state = { rigid_body.getGlobalPose(), rigid_body.getLinearVelocity(), rigid_body.getAngularVelocity() };
+		return state;
+	}
+
+	// The rigid body is woken up.
+	inline void set_state(rigid_body_type & rigid_body, const body_state_type & state) const {
+		rigid_body.setGlobalPose(state.pose);
+		rigid_body.setLinearVelocity(state.linear_velocity);
+		rigid_body.setAngularVelocity(state.angular_velocity);
+	}
+
+	// Translational plus rotational kinetic energy divided by the mass, the measure PhysX compares to the sleep threshold.
+	inline real_type get_kinetic_energy(const rigid_body_type & rigid_body) const {
+		const real_type mass(rigid_body.getMass());
+		const vec3_type angular_velocity((rigid_body.getGlobalPose() * rigid_body.getCMassLocalPose()).q.rotateInv(rigid_body.getAngularVelocity()));
+		const real_type rotational(mass > 0 ? angular_velocity.dot(rigid_body.getMassSpaceInertiaTensor().multiply(angular_velocity)) / mass : real_type(0));
+
+		return real_type(0.5) * (rigid_body.getLinearVelocity().magnitudeSquared() + rotational);
+	}
+
+	// Potential energy of a spring joint. The spring pulls when stretched beyond the maximum distance of the joint.
+	inline real_type get_spring_energy(const spring_joint_type & joint) const {
+		const real_type stretch(std::max(real_type(0), joint.getDistance() - joint.getMaxDistance()));
+		return real_type(0.5) * joint.getStiffness() * stretch * stretch;
+	}
+
+	/*
+	 * Collision filtering of the PhysX engine: With filter_adjacent, the rigid body does not collide with any other sharing exactly one of the vertices,
+	 * as helices meeting at a vertex overlap there by design. Helices sharing both vertices run side by side and still collide. Set before simulating.
+	 */
+	void set_collision_vertices(rigid_body_type & rigid_body, unsigned int vertex1, unsigned int vertex2) const;
+
+	// False if none were set.
+	bool get_collision_vertices(const rigid_body_type & rigid_body, unsigned int & vertex1, unsigned int & vertex2) const;
+
+	// Kinematic bodies are not simulated. A body made dynamic again is woken up.
+	void set_kinematic(rigid_body_type & rigid_body, bool kinematic) const;
+
+	inline bool is_kinematic(const rigid_body_type & rigid_body) const {
+#ifdef WITHOUT_PHYSX
+		return rigid_body.kinematic;
+#else
+		return rigid_body.getRigidBodyFlags() & physx::PxRigidBodyFlag::eKINEMATIC;
+#endif /* N WITHOUT_PHYSX */
+	}
+
+	inline mass_properties_type get_mass_properties(const rigid_body_type & rigid_body) const {
+		const mass_properties_type properties = { rigid_body.getMass(), rigid_body.getMassSpaceInertiaTensor(), rigid_body.getCMassLocalPose() };
+		return properties;
+	}
+
+	// Moves the rigid body to the pose and puts it to sleep, which also stops it.
+	inline void put_to_sleep(rigid_body_type & rigid_body, const transform_type & pose) const {
+		rigid_body.setGlobalPose(pose, false);
+		rigid_body.putToSleep();
+	}
+
+	// Capsule bounding the first shape of the rigid body along its local x axis. A sphere is returned as a capsule with zero half height.
+	void get_bounding_capsule(const rigid_body_type & rigid_body, transform_type & local_pose, real_type & radius, real_type & half_height) const;
+
+	// The rigid bodies connected by the joint, NULL for the world, and the frames the joint is attached at, relative to them.
+	static void get_spring_joint_frames(const spring_joint_type & joint, rigid_body_type *(&rigid_bodies)[2], transform_type (&local_frames)[2]);
+
+	inline void get_spring_joint_parameters(const spring_joint_type & joint, real_type & stiffness, real_type & damping, real_type & max_distance) const {
+		stiffness = joint.getStiffness();
+		damping = joint.getDamping();
+		max_distance = joint.getMaxDistance();
+	}
+
+	/*
+	 * Advances the simulation by timestep, split into substeps equal steps.
+	 * With the native engine, only the rigid bodies and springs last passed to select_simulated are simulated.
+	 */
+	void simulate(real_type timestep, unsigned int substeps = 1);
+
+	// True for both engines using the spring network.
+	inline bool is_native() const {
+		return bool(network);
+	}
+
+	inline bool is_minimizer() const {
+		return settings.engine == kMinimizer;
+	}
+
+	// Minimizer engine only. Moves the rigid bodies last passed to select_simulated to rest at a minimum of the energy. See spring_network::minimize.
+	unsigned int minimize(unsigned int max_iterations, real_type gradient_tolerance, const std::function<bool()> & running, Minimization & outcome);
+
+	// Native engine only. The springs are given once each, and may be attached to rigid bodies that are not simulated, which then hold on to them where they are.
+	void select_simulated(const std::vector<rigid_body_type *> & rigid_bodies, const std::vector<spring_joint_type *> & springs);
 
 	inline static vec3_type transform(const transform_type & transform, const vec3_type & vec) {
-		return physx::PxMat44(transform).transform(vec);
+		return transform.transform(vec);
 	}
 
 	inline static transform_type world_transform(const rigid_body_type & rigid_body) {
 		return rigid_body.getGlobalPose();
 	}
 
+	// Wakes the rigid body up.
+	inline static void set_world_transform(rigid_body_type & rigid_body, const transform_type & transform) {
+		rigid_body.setGlobalPose(transform);
+	}
+
+	inline static bool is_sleeping(const rigid_body_type & rigid_body) {
+		return rigid_body.isSleeping();
+	}
+
+	inline static void wake_up(rigid_body_type & rigid_body) {
+		rigid_body.wakeUp();
+	}
+
+	// Distance between the attachment points of a spring joint.
+	inline static real_type get_spring_distance(const spring_joint_type & joint) {
+		return joint.getDistance();
+	}
+
+#ifdef WITHOUT_PHYSX
+	const settings_type settings;
+
+private:
+	std::unordered_set<rigid_body_type *> rigid_bodies; // Created and not yet destroyed, as there is no scene releasing them.
+#else
 public: // DEBUG make private.
 	physx::PxDefaultAllocator allocator;
 	physx::PxDefaultErrorCallback errorCallback;
@@ -86,10 +334,28 @@ public: // DEBUG make private.
 	const settings_type settings;
 
 private:
+	void create_scene(unsigned int threads);
+	physx::PxScene *create_scene(const physx::PxSceneLimits & limits, physx::PxBroadPhaseType::Enum broadphase) const;
+
+	physx::PxU32 position_iterations, velocity_iterations; // Of the rigid bodies, given by the profile.
+	mutable std::atomic<unsigned int> filtered_pairs; // Killed by the filter shader since last read, for the profiler.
+	void *scratch; // Handed to PhysX for the temporary data of a step, NULL until prepare_scene.
+	physx::PxU32 scratch_size;
+
+	const bool owns_sdk; // False for replicas sharing the SDK of another instance.
+#endif /* N WITHOUT_PHYSX */
+	std::unique_ptr<spring_network> network; // NULL unless using the native engine.
+#ifndef WITHOUT_PHYSX
+	std::unique_ptr<trace::zone_recorder> recorder; // NULL unless tracing, or not owning the SDK.
+#endif /* N WITHOUT_PHYSX */
 
 	template<typename GeometryT, typename... GeometryListT>
-	inline void internal_rigid_body_attach_geometry(rigid_body_type & rigid_body, const GeometryT & geometry, GeometryListT &... geometries) {
+	inline void internal_rigid_body_attach_geometry(rigid_body_type & rigid_body, const GeometryT & geometry, const GeometryListT &... geometries) {
+#ifdef WITHOUT_PHYSX
+		rigid_body.createShape(std::get<0>(geometry), std::get<1>(geometry));
+#else
 		rigid_body.createShape(std::get<0>(geometry), *material)->setLocalPose(std::get<1>(geometry));
+#endif /* N WITHOUT_PHYSX */
 		internal_rigid_body_attach_geometry(rigid_body, geometries...);
 	}
 
@@ -0,0 +1,19 @@
+#ifndef _PLY_H_
+#define _PLY_H_
+
+#include <Physics.h>
+
+#include <vector>
+
+/*
+ * Reader of the vertices of .ply files, in the ascii, binary_little_endian and binary_big_endian formats.
+ * Only the x, y and z properties of the vertex element are used. They may have any scalar type, and the vertex element may have other properties, including lists.
+ * Elements before the vertex element are skipped. Binary data is read in place, typically from a memory mapped file.
+ */
+
+namespace ply {
+	// Appends the vertices. Returns false if the header is malformed, lacks a vertex element with x, y and z, or the data ends before the vertices do.
+	bool read_vertices(const char *begin, const char *end, std::vector<physics::vec3_type> & vertices);
+}
+
+#endif /* _PLY_H_ */
@@ -0,0 +1,85 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <Trace.h>
+
+#include <iostream>
+
+/*
+ * Phase timers for finding out where a run spends its time, enabled by --profile=true. Disabled, a timer costs a test of two flags.
+ * With --trace, every timed phase is also recorded as a span of the trace. See Trace.h.
+ * Every phase gets its count, total, mean, 99th percentile and maximum time. Percentiles are taken from a histogram with eight buckets per power of two,
+ * so they are within 12.5% of the actual value. Phases nest: A rigid body created while setting up the helices counts towards both.
+ * The report at exit also holds the peak resident set size of the process and, with the PhysX engine, the simulation statistics of the steps.
+ */
+
+namespace profiler {
+	enum Phase {
+		kParse = 0, // Reading the input, excluding the set up of the helices.
+		kSetupHelices = 1,
+		kCreateRigidBody = 2,
+		kRecreateRigidBody = 3,
+		kSimulate = 4, // A step of the selected engine, excluding the PhysX fetchResults.
+		kFetchResults = 5, // Waiting for PhysX to finish a step, or writing back the native engine.
+		kMinimize = 6,
+		kEnergy = 7, // Measuring the separations.
+		kOutput = 8,
+		kTrial = 9, // Evaluating a move of an optimizer.
+		kRelaxation = 10, // Stepping until converged.
+		kPhaseCount = 11
+	};
+
+	struct settings_type {
+		bool enabled;
+	};
+
+	// Per step, as given by PxSimulationStatistics.
+	struct simulation_statistics_type {
+		unsigned int active_bodies, constraints, pairs, contact_pairs, new_pairs, lost_pairs;
+		unsigned int filtered_pairs; // Killed by the filter shader, see physics::set_collision_vertices.
+	};
+
+	extern bool enabled; // Set before any timer runs.
+
+	// Of a timed phase, in ticks of trace::now.
+	void record(Phase phase, unsigned long long begin, unsigned long long end);
+	void record(const simulation_statistics_type & statistics);
+
+	void report(std::ostream & out);
+
+	// Total time of a phase so far, in nanoseconds.
+	unsigned long long total(Phase phase);
+
+	// Clears every phase and the simulation statistics. Not while timers run.
+	void reset();
+
+	class scoped_timer {
+	public:
+		explicit inline scoped_timer(Phase phase) : phase(phase), running(enabled || trace::enabled) {
+			if (running)
+				start = trace::now();
+		}
+
+		inline ~scoped_timer() {
+			stop();
+		}
+
+		scoped_timer(const scoped_timer &) = delete;
+		scoped_timer & operator=(const scoped_timer &) = delete;
+
+		// Records the time so far, leaving out whatever follows in the scope.
+		inline void stop() {
+			if (running) {
+				record(phase, start, trace::now());
+				running = false;
+			}
+		}
+
+	private:
+		const Phase phase;
+		bool running;
+		unsigned long long start;
+	};
+}
+
+#endif /* _PROFILER_H_ */
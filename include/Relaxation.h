@@ -0,0 +1,477 @@
+#ifndef _RELAXATION_H_
+#define _RELAXATION_H_
+
+#include <ConfigurationCache.h>
+#include <Definition.h>
+#include <Helix.h>
+#include <Physics.h>
+#include <Profiler.h>
+#include <Scene.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+/*
+ * Relaxation of a scene after the base count of a helix has been changed.
+ * By default the whole scene is reset to its initial transforms and simulated until it comes to rest. With settings.warm_start, the whole scene is instead simulated
+ * starting from the last accepted relaxed state, which is captured in a snapshot so that a rejected move can be reverted in bulk.
+ * In local mode, only the helices at most settings.hops joints away from the modified helix are simulated, starting from their last relaxed transforms,
+ * while the rest of the structure is frozen as kinematic bodies.
+ * Both warm started and local relaxations resize the modified helix at its relaxed pose, while its fixed spring stays anchored at its initial transform.
+ *
+ * A relaxation stops when all simulated helices are sleeping, when it has converged or when it reaches settings.max_steps.
+ * Every settings.convergence_window steps, the total separation of the simulated helices is compared to the one at the previous check. The relaxation has converged
+ * if it changed by less than settings.separation_tolerance relative to its value, and the average mass normalized kinetic energy is below settings.kinetic_energy_threshold.
+ *
+ * If settings.min_timestep < settings.max_timestep, the step size is adaptive: A relaxation starts at the minimum step size, which grows while the spring energy of
+ * the simulated helices does not increase by more than settings.stability_threshold relative to its value in one step, and is halved when it does.
+ * Every step is simulated as settings.substeps equal substeps.
+ *
+ * Unless settings.coarse_geometry is the full geometry, the simulated helices collide only through their capsules, or not at all, until the relaxation
+ * has converged, they are sleeping or it has taken half of settings.max_steps. Then they get their full geometry back and are relaxed further, within the same settings.max_steps.
+ *
+ * Optimizers evaluate moves through evaluate, which consults a cache of the configurations already relaxed. A cached configuration whose separation would not be accepted
+ * is skipped altogether, and with settings.cache_poses, an accepted one is restored from its relaxed state instead of being relaxed again. The cache holds the configurations
+ * of a single structure, as it is keyed by base counts only, and is not used in local mode or when warm starting.
+ */
+
+class relaxation {
+public:
+	typedef std::vector<scene::HelixContainer::size_type> region_type;
+
+	struct settings_type {
+		unsigned int hops; // Radius of the simulated neighborhood in joints. 0 relaxes the whole scene after every move.
+		bool global_relaxation; // In local mode, finish the optimization by relaxing the whole scene.
+		bool warm_start; // Outside local mode, start every relaxation from the last accepted relaxed state instead of the initial transforms.
+
+		unsigned int max_steps; // Maximum number of simulation steps of a relaxation. 0 means no limit.
+		unsigned int convergence_window; // Number of steps between convergence checks. 0 disables them, only waiting for the helices to fall asleep.
+		physics::real_type separation_tolerance; // Relative change of the total separation over a window.
+		physics::real_type kinetic_energy_threshold; // Per helix, mass normalized.
+		bool report_convergence; // Print the number of steps taken by every relaxation.
+
+		physics::real_type min_timestep, max_timestep; // Seconds. Equal values give a fixed step size.
+		physics::real_type stability_threshold; // Relative increase of the spring energy in one step considered unstable.
+		unsigned int substeps; // Number of simulate calls per step.
+		Helix::Geometry coarse_geometry; // PhysX engine only. Of the simulated helices until close to equilibrium.
+
+		physics::real_type gradient_tolerance; // Minimizer engine only. Largest remaining force or torque on a helix at a minimum.
+
+		unsigned int cache_size; // Number of relaxed configurations remembered. 0 disables the cache.
+		bool cache_poses; // Remember the relaxed state of every helix, not only the separation.
+	};
+
+	// Why a relaxation stopped.
+	enum Outcome {
+		kAsleep = 0,
+		kConverged = 1,
+		kCapped = 2,
+		kInterrupted = 3,
+		kStalled = 4, // Minimizer engine only. The energy could not be lowered any further before reaching the gradient tolerance.
+		kOutcomeCount = 5
+	};
+
+	struct statistics_type {
+		unsigned long long relaxations, steps;
+		unsigned int max_steps; // Of a single relaxation.
+		unsigned long long outcomes[kOutcomeCount];
+	};
+
+	/*
+	 * A change of base count of a single helix, with what is needed to revert it.
+	 */
+	struct move_type {
+		scene::HelixContainer::size_type helix;
+		int previous_bases;
+		region_type region; // The simulated helices. Empty unless in local mode.
+		std::vector<physics::transform_type> previous_transforms; // Transforms of the region before the move.
+		scene::snapshot_type snapshot; // State of the scene before the move. Empty unless warm starting.
+		configuration_cache::key_type configuration; // Base counts after the move.
+		configuration_cache::entry_type cached; // Buffer for cache lookups.
+	};
+
+	/*
+	 * Changes of base count of several helices, applied together and relaxed once, with what is needed to revert them.
+	 */
+	struct combined_move_type {
+		std::vector< std::pair<scene::HelixContainer::size_type, int> > changes; // Helix and base count, given by the caller.
+		std::vector<int> previous_bases; // Of the changes.
+		region_type region; // The simulated helices, sorted. Empty unless in local mode.
+		std::vector<physics::transform_type> previous_transforms; // Transforms of the region before the move.
+		scene::snapshot_type snapshot; // State of the scene before the move. Empty unless warm starting.
+	};
+
+	// In local mode and when warm starting, the relaxed state of a configuration depends on the state it is relaxed from, so the cache is disabled.
+	explicit inline relaxation(const settings_type & settings) : settings(settings), statistics(), cache(settings.hops > 0 || settings.warm_start ? 0 : settings.cache_size, settings.cache_poses) {}
+
+	inline bool isLocal() const {
+		return settings.hops > 0;
+	}
+
+	inline bool isAdaptive() const {
+		return settings.min_timestep < settings.max_timestep;
+	}
+
+	/*
+	 * Steps the simulation until the whole scene has come to rest. Returns the number of steps taken.
+	 */
+	template<typename RunningFunctorT>
+	unsigned int relax(scene & mesh, physics & phys, RunningFunctorT running_functor) const {
+		if (phys.is_native())
+			select(mesh, phys, NULL);
+
+		if (phys.is_minimizer())
+			return minimize(phys, running_functor);
+
+		return converge(phys, mesh.getHelixCount(),
+			[&mesh]() { return mesh.isSleeping(); },
+			[&mesh, &phys]() { return mesh.getKineticEnergy(phys); },
+			[&mesh]() { return mesh.getTotalSeparation(); },
+			[&mesh, &phys]() { return mesh.getSpringEnergy(phys); },
+			[&mesh, &phys](Helix::Geometry geometry) { for (Helix & helix : mesh.getHelices()) helix.setGeometry(phys, geometry); },
+			running_functor);
+	}
+
+	/*
+	 * Steps the simulation until all helices of the region have come to rest. Returns the number of steps taken.
+	 */
+	template<typename RunningFunctorT>
+	unsigned int relax(scene & mesh, physics & phys, const region_type & region, RunningFunctorT running_functor) const {
+		scene::HelixContainer & helices(mesh.getHelices());
+
+		if (phys.is_native())
+			select(mesh, phys, &region);
+
+		if (phys.is_minimizer())
+			return minimize(phys, running_functor);
+
+		return converge(phys, region.size(),
+			[&helices, &region]() { return std::all_of(region.begin(), region.end(), [&helices](scene::HelixContainer::size_type index) { return helices[index].isSleeping(); }); },
+			[&helices, &region, &phys]() { return std::accumulate(region.begin(), region.end(), physics::real_type(0), [&helices, &phys](physics::real_type energy, scene::HelixContainer::size_type index) { return energy + helices[index].getKineticEnergy(phys); }); },
+			[&helices, &region]() { return std::accumulate(region.begin(), region.end(), physics::real_type(0), [&helices](physics::real_type separation, scene::HelixContainer::size_type index) { return separation + helices[index].getTotalSeparation(); }); },
+			[&helices, &region, &phys]() { return std::accumulate(region.begin(), region.end(), physics::real_type(0), [&helices, &phys](physics::real_type energy, scene::HelixContainer::size_type index) { return energy + helices[index].getSpringEnergy(phys); }); },
+			[&helices, &region, &phys](Helix::Geometry geometry) { for (scene::HelixContainer::size_type index : region) helices[index].setGeometry(phys, geometry); },
+			running_functor);
+	}
+
+	// Totals over all relaxations done so far, by all threads.
+	statistics_type getStatistics() const;
+
+	/*
+	 * In local mode, freezes every helix. Must be called after the initial relaxation and before the first move.
+	 */
+	void begin(scene & mesh, physics & phys) const;
+
+	/*
+	 * In local mode, unfreezes every helix and, if requested by the settings, relaxes the whole scene. Call after the last move.
+	 * Returns true if the scene was relaxed.
+	 */
+	template<typename RunningFunctorT>
+	bool end(scene & mesh, physics & phys, RunningFunctorT running_functor) const {
+		if (!isLocal())
+			return false;
+
+		for (Helix & helix : mesh.getHelices())
+			helix.setFrozen(phys, false);
+
+		if (!settings.global_relaxation)
+			return false;
+
+		relax(mesh, phys, running_functor);
+		return true;
+	}
+
+	/*
+	 * Changes the base count of the helix and relaxes the scene. What is needed to revert the change is stored in move, whose buffers are reused.
+	 */
+	template<typename RunningFunctorT>
+	void apply(scene & mesh, physics & phys, scene::HelixContainer::size_type index, int bases, move_type & move, RunningFunctorT running_functor) const {
+		apply(mesh, phys, index, bases, move, NULL, running_functor);
+	}
+
+	/*
+	 * Applies the move and measures the separation of the relaxed scene, unless the cache tells that its total separation is not below threshold.
+	 * Returns false if the move was skipped, in which case the scene is unchanged and the move must not be reverted.
+	 */
+	template<typename RunningFunctorT>
+	bool evaluate(scene & mesh, physics & phys, scene::HelixContainer::size_type index, int bases, physics::real_type threshold, move_type & move,
+			physics::real_type & min, physics::real_type & max, physics::real_type & average, physics::real_type & total, RunningFunctorT running_functor) const {
+		profiler::scoped_timer timer(profiler::kTrial);
+
+		if (!cache.isEnabled()) {
+			apply(mesh, phys, index, bases, move, NULL, running_functor);
+			mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+			return true;
+		}
+
+		move.configuration.clear();
+		for (const Helix & helix : mesh.getHelices())
+			move.configuration.push_back(int(helix.getBaseCount()));
+		move.configuration[index] = bases;
+
+		switch (cache.find(move.configuration, threshold, move.cached)) {
+		case configuration_cache::kRejected:
+			return false;
+		case configuration_cache::kFound:
+			if (!move.cached.snapshot.empty()) {
+				apply(mesh, phys, index, bases, move, &move.cached.snapshot, running_functor);
+				mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+				return true;
+			}
+			break;
+		default:
+			break;
+		}
+
+		apply(mesh, phys, index, bases, move, NULL, running_functor);
+		mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
+
+		// An interrupted relaxation is not representative of the configuration.
+		if (running_functor()) {
+			move.cached.min = min;
+			move.cached.max = max;
+			move.cached.average = average;
+			move.cached.total = total;
+
+			if (cache.storesPoses())
+				mesh.getSnapshot(phys, move.cached.snapshot);
+			else
+				move.cached.snapshot.clear();
+
+			cache.insert(move.configuration, move.cached);
+		}
+
+		return true;
+	}
+
+	/*
+	 * Applies all changes of the move and relaxes the scene once, as apply does for a single change. In local mode, the union of the neighborhoods is simulated.
+	 * The cache is not consulted.
+	 */
+	template<typename RunningFunctorT>
+	void apply(scene & mesh, physics & phys, combined_move_type & move, RunningFunctorT running_functor) const {
+		scene::HelixContainer & helices(mesh.getHelices());
+
+		move.previous_bases.clear();
+		for (const std::pair<scene::HelixContainer::size_type, int> & change : move.changes)
+			move.previous_bases.push_back(int(helices[change.first].getBaseCount()));
+
+		if (isLocal()) {
+			move.region.clear();
+			region_type neighborhood;
+			for (const std::pair<scene::HelixContainer::size_type, int> & change : move.changes) {
+				mesh.getNeighborhood(change.first, settings.hops, neighborhood);
+				move.region.insert(move.region.end(), neighborhood.begin(), neighborhood.end());
+			}
+			std::sort(move.region.begin(), move.region.end());
+			move.region.erase(std::unique(move.region.begin(), move.region.end()), move.region.end());
+
+			move.previous_transforms.clear();
+			move.previous_transforms.reserve(move.region.size());
+			for (scene::HelixContainer::size_type i : move.region) {
+				move.previous_transforms.push_back(helices[i].getTransform());
+				helices[i].setFrozen(phys, false);
+			}
+
+			for (const std::pair<scene::HelixContainer::size_type, int> & change : move.changes)
+				helices[change.first].resize(phys, change.second, helices[change.first].getTransform());
+
+			relax(mesh, phys, move.region, running_functor);
+
+			for (scene::HelixContainer::size_type i : move.region)
+				helices[i].setFrozen(phys, true);
+		} else if (settings.warm_start) {
+			mesh.getSnapshot(phys, move.snapshot);
+
+			for (const std::pair<scene::HelixContainer::size_type, int> & change : move.changes)
+				helices[change.first].resize(phys, change.second, helices[change.first].getTransform());
+
+			mesh.wakeUp();
+			relax(mesh, phys, running_functor);
+		} else {
+			for (Helix & helix : helices)
+				helix.setTransform(helix.getInitialTransform());
+
+			for (const std::pair<scene::HelixContainer::size_type, int> & change : move.changes)
+				helices[change.first].resize(phys, change.second, helices[change.first].getInitialTransform());
+
+			relax(mesh, phys, running_functor);
+		}
+	}
+
+	/*
+	 * Restores the base count and, in local or warm start mode, the state from before the move.
+	 */
+	void revert(scene & mesh, physics & phys, const move_type & move) const;
+	void revert(scene & mesh, physics & phys, const combined_move_type & move) const;
+
+	/*
+	 * Repeats a move done in a replica of the scene, copying the resulting base count and, in local or warm start mode, the relaxed state from the replica.
+	 */
+	void replicate(scene & mesh, physics & phys, const scene & source, const move_type & move) const;
+	void replicate(scene & mesh, physics & phys, const scene & source, const combined_move_type & move) const;
+
+	inline configuration_cache::statistics_type getCacheStatistics() const {
+		return cache.getStatistics();
+	}
+
+private:
+	/*
+	 * Applies the move, restoring the relaxed state from a cached snapshot instead of relaxing if relaxed is not NULL.
+	 */
+	template<typename RunningFunctorT>
+	void apply(scene & mesh, physics & phys, scene::HelixContainer::size_type index, int bases, move_type & move, const scene::snapshot_type *relaxed, RunningFunctorT running_functor) const {
+		scene::HelixContainer & helices(mesh.getHelices());
+		Helix & helix(helices[index]);
+
+		move.helix = index;
+		move.previous_bases = int(helix.getBaseCount());
+
+		if (isLocal()) {
+			mesh.getNeighborhood(index, settings.hops, move.region);
+
+			move.previous_transforms.clear();
+			move.previous_transforms.reserve(move.region.size());
+			for (scene::HelixContainer::size_type i : move.region) {
+				move.previous_transforms.push_back(helices[i].getTransform());
+				helices[i].setFrozen(phys, false);
+			}
+
+			helix.resize(phys, bases, move.previous_transforms.front());
+
+			// There is no cache in local mode.
+			assert(!relaxed);
+			relax(mesh, phys, move.region, running_functor);
+
+			for (scene::HelixContainer::size_type i : move.region)
+				helices[i].setFrozen(phys, true);
+		} else if (settings.warm_start) {
+			mesh.getSnapshot(phys, move.snapshot);
+
+			helix.resize(phys, bases, helix.getTransform());
+
+			// Nor when warm starting.
+			assert(!relaxed);
+			mesh.wakeUp();
+			relax(mesh, phys, running_functor);
+		} else {
+			for (Helix & helix : helices)
+				helix.setTransform(helix.getInitialTransform());
+
+			helix.resize(phys, bases, helix.getInitialTransform());
+
+			if (relaxed)
+				mesh.setSnapshot(phys, *relaxed);
+			else
+				relax(mesh, phys, running_functor);
+		}
+	}
+
+	/*
+	 * The convergence detector and step size controller shared by the relax methods, in one or, coarse to fine, two passes.
+	 * The functors tell whether all simulated helices are sleeping, their total kinetic energy, their total separation and their total spring energy,
+	 * and set the geometry of the simulated helices.
+	 */
+	template<typename IsSleepingFunctorT, typename KineticEnergyFunctorT, typename SeparationFunctorT, typename SpringEnergyFunctorT, typename SetGeometryFunctorT, typename RunningFunctorT>
+	unsigned int converge(physics & phys, size_t helixCount, IsSleepingFunctorT is_sleeping_functor, KineticEnergyFunctorT kinetic_energy_functor, SeparationFunctorT separation_functor,
+			SpringEnergyFunctorT spring_energy_functor, SetGeometryFunctorT set_geometry_functor, RunningFunctorT running_functor) const {
+		profiler::scoped_timer timer(profiler::kRelaxation);
+
+		unsigned int steps(0);
+		Outcome outcome(kConverged);
+
+		// The coarse pass takes at most half of settings.max_steps, so that the fine pass always has steps left. The native engine only collides the capsules anyway.
+		const unsigned int coarseSteps(settings.max_steps / 2);
+		if (settings.coarse_geometry != Helix::kFullGeometry && !phys.is_native() && (settings.max_steps == 0 || coarseSteps > 0)) {
+			set_geometry_functor(settings.coarse_geometry);
+			outcome = converge_pass(phys, helixCount, is_sleeping_functor, kinetic_energy_functor, separation_functor, spring_energy_functor, running_functor, coarseSteps, steps);
+			set_geometry_functor(Helix::kFullGeometry);
+		}
+
+		// A coarse pass capped by its share of the steps is refined like a converged one.
+		if (outcome != kInterrupted)
+			outcome = converge_pass(phys, helixCount, is_sleeping_functor, kinetic_energy_functor, separation_functor, spring_energy_functor, running_functor, settings.max_steps, steps);
+
+		record(steps, outcome);
+		return steps;
+	}
+
+	// One pass of converge, counting on from the steps already taken until maxSteps in total, 0 meaning no limit.
+	template<typename IsSleepingFunctorT, typename KineticEnergyFunctorT, typename SeparationFunctorT, typename SpringEnergyFunctorT, typename RunningFunctorT>
+	Outcome converge_pass(physics & phys, size_t helixCount, IsSleepingFunctorT is_sleeping_functor, KineticEnergyFunctorT kinetic_energy_functor, SeparationFunctorT separation_functor,
+			SpringEnergyFunctorT spring_energy_functor, RunningFunctorT running_functor, unsigned int maxSteps, unsigned int & steps) const {
+		static const physics::real_type kTimestepGrowth(physics::real_type(1.25));
+
+		Outcome outcome(kInterrupted);
+		physics::real_type separation(settings.convergence_window > 0 ? separation_functor() : physics::real_type(0));
+		physics::real_type timestep(isAdaptive() ? settings.min_timestep : settings.max_timestep);
+		physics::real_type springEnergy(isAdaptive() ? spring_energy_functor() : physics::real_type(0));
+		const unsigned int first_step(steps);
+
+		while (running_functor()) {
+			if (is_sleeping_functor()) {
+				outcome = kAsleep;
+				break;
+			}
+
+			if (maxSteps > 0 && steps >= maxSteps) {
+				outcome = kCapped;
+				break;
+			}
+
+			step(phys, timestep);
+			++steps;
+
+			if (isAdaptive()) {
+				const physics::real_type previousSpringEnergy(springEnergy);
+				springEnergy = spring_energy_functor();
+
+				if (springEnergy > previousSpringEnergy * (1 + settings.stability_threshold))
+					timestep = std::max(settings.min_timestep, timestep / 2);
+				else
+					timestep = std::min(settings.max_timestep, timestep * kTimestepGrowth);
+			}
+
+			if (settings.convergence_window > 0 && (steps - first_step) % settings.convergence_window == 0) {
+				const physics::real_type previousSeparation(separation);
+				separation = separation_functor();
+
+				if (std::abs(separation - previousSeparation) <= settings.separation_tolerance * std::max(std::abs(previousSeparation), std::numeric_limits<physics::real_type>::min())
+						&& kinetic_energy_functor() <= settings.kinetic_energy_threshold * physics::real_type(helixCount)) {
+					outcome = kConverged;
+					break;
+				}
+			}
+		}
+
+		return outcome;
+	}
+
+	void record(unsigned int steps, Outcome outcome) const;
+
+	// Relaxes the selected helices with the minimizer engine instead of stepping the simulation. Iterations count as steps, and settings.max_steps caps them.
+	unsigned int minimize(physics & phys, const std::function<bool()> & running) const;
+
+	// Hands the helices of the region, or all helices if NULL, and their springs to the native engine.
+	void select(const scene & mesh, physics & phys, const region_type *region) const;
+
+	inline void step(physics & phys, physics::real_type timestep) const {
+		phys.simulate(timestep, std::max(1u, settings.substeps));
+	}
+
+	const settings_type settings;
+
+	// Relaxations run concurrently in parallel optimizers.
+	mutable std::mutex statistics_mutex;
+	mutable statistics_type statistics;
+
+	mutable configuration_cache cache;
+};
+
+#endif /* _RELAXATION_H_ */
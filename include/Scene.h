@@ -1,8 +1,11 @@
 #ifndef _H_SCENE_H_
 #define _H_SCENE_H_
 
+#include <MappedFile.h>
+#include <Profiler.h>
 #include <Utility.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <fstream>
@@ -13,121 +16,129 @@
 #include <vector>
 
 #include <Helix.h>
+#include <SeparationTracker.h>
 
 class scene {
 	friend class SceneDescription;
 public:
 	typedef std::vector<Helix> HelixContainer;
+	typedef std::vector<physics::body_state_type> snapshot_type; // Indexed as the helices.
 
 	struct settings_type {
 		physics::real_type initial_scaling;
 		bool discretize_lengths;
+		physics::real_type separation_epsilon; // Movement of a helix below which its springs are not measured again. See separation_tracker.
 	};
 
-	inline scene(const settings_type & settings, const ::Helix::settings_type & helix_settings) : settings(settings), helix_settings(helix_settings) {}
+	inline scene(const settings_type & settings, const ::Helix::settings_type & helix_settings) : settings(settings), helix_settings(helix_settings), tracker(settings.separation_epsilon) {}
+
+	// Creates a replica of an already loaded scene in another physics instance. Only the vertices and the path are copied, the helices are set up again from them.
+	scene(const scene & other, physics & phys); // throws exceptions.
 
 	// Distinguish the file type by its file ending and parses either a rmesh or a ply file.
 	inline bool read(physics & phys, const std::string & filename) {
-		if (ends_with(filename, ".ply"))
-			return read_ply(phys, std::ifstream(filename), std::ifstream(strip_trailing_string(filename, ".ply") + ".ntrail"));
-		else if (ends_with(filename, ".ntrail"))
-			return read_ply(phys, std::ifstream(strip_trailing_string(filename, ".ntrail") + ".ply"), std::ifstream(filename));
-		else
-			return read_rmesh(phys, std::ifstream(filename));
+		if (ends_with(filename, ".ply") || ends_with(filename, ".ntrail")) {
+			const std::string stem(ends_with(filename, ".ply") ? strip_trailing_string(filename, ".ply") : strip_trailing_string(filename, ".ntrail"));
+			const mapped_file ply_file(stem + ".ply"), ntrail_file(stem + ".ntrail");
+			return ply_file.is_open() && ntrail_file.is_open() && read_ply(phys, ply_file.begin(), ply_file.end(), ntrail_file.begin(), ntrail_file.end());
+		} else {
+			const mapped_file file(filename);
+			return file.is_open() && read_rmesh(phys, file.begin(), file.end());
+		}
 	}
 
 	// Reads a mesh in the .rmsh "Routed mesh" text based format from the scaffold-routing Maya exporter project.
 	// TODO: Move to SceneDescription?
 	bool read_rmesh(physics & phys, std::istream & ifile);
 
+	// As above, from a buffer such as a memory mapped file. Large buffers are parsed in chunks of lines concurrently.
+	bool read_rmesh(physics & phys, const char *begin, const char *end);
+
 	// Read a mesh using the .ply and .ntrail formats
 	bool read_ply(physics &phys, std::istream & ply_file, std::istream & ntrail_file);
 
+	// As above, from buffers such as memory mapped files. The .ply file may be ascii or binary.
+	bool read_ply(physics & phys, const char *ply_begin, const char *ply_end, const char *ntrail_begin, const char *ntrail_end);
+
 	inline HelixContainer & getHelices() {
 		return helices;
 	}
 
+	inline const HelixContainer & getHelices() const {
+		return helices;
+	}
+
 	inline HelixContainer::size_type getHelixCount() const {
 		return helices.size();
 	}
 
-	// TODO: Move to SceneDescription when Scene can be constructed from a SceneDescription.
-	inline physics::real_type getTotalSeparation() const {
-		physics::real_type totalSeparation(0);
+	inline void getBaseCounts(std::vector<int> & bases) const {
+		bases.clear();
 		for (const Helix & helix : helices)
-			totalSeparation += std::accumulate(helix.getJoints().begin(), helix.getJoints().end(), physics::real_type(0), [](physics::real_type & separation, const Helix::Connection & connection) { return separation + (connection ? connection.joint->getDistance() : physics::real_type(0)); });
+			bases.push_back(int(helix.getBaseCount()));
+	}
+
+	// Indices of the helices at most hops joints away from the given helix in breadth first order, starting with the helix itself.
+	void getNeighborhood(HelixContainer::size_type helix, unsigned int hops, std::vector<HelixContainer::size_type> & neighborhood) const;
 
-		return totalSeparation / 2;
+	// TODO: Move to SceneDescription when Scene can be constructed from a SceneDescription.
+	inline physics::real_type getTotalSeparation() const {
+		profiler::scoped_timer timer(profiler::kEnergy);
+		tracker.update(helices);
+		return tracker.getTotal();
 	}
 
 	// TODO: Move to SceneDescription when Scene...
 	void getTotalSeparationMinMaxAverage(physics::real_type & min, physics::real_type & max, physics::real_type & average, physics::real_type & total) const;
 
-	inline bool isSleeping() const {
-		return std::find_if(helices.begin(), helices.end(), std::mem_fun_ref(&Helix::isSleeping)) != helices.end();
+	// Captures the state of every helix.
+	inline void getSnapshot(const physics & phys, snapshot_type & snapshot) const {
+		snapshot.resize(helices.size());
+		for (HelixContainer::size_type i = 0; i < helices.size(); ++i)
+			snapshot[i] = helices[i].getState(phys);
 	}
 
-private:
-	bool setupHelices(physics & phys);
-
-	struct Vertex {
-		physics::vec3_type position, normal;
-		struct Edge {
-			unsigned int index;
-			physics::real_type angle; // In RADIANS!
-
-			inline explicit Edge(unsigned int index, physics::real_type angle = physics::real_type(0)) : index(index), angle(angle) {}
-			inline bool operator< (const Edge & edge) const { return angle < edge.angle; }
-			inline bool operator==(unsigned int index) const { return this->index == index; }
-		};
-		typedef std::vector<Edge> NeighborContainer;
-		NeighborContainer neighbor_edges; // Edge indices. TODO: Change name to edges.
-		std::unordered_map<unsigned int, NeighborContainer::const_iterator> edges_lookup;
-
-		// TODO: Rename to optimize_edges or something more suitable.
-		inline void generate_lookup() {
-			std::sort(neighbor_edges.begin(), neighbor_edges.end());
-
-			edges_lookup.clear();
-			edges_lookup.reserve(neighbor_edges.size());
-			for (NeighborContainer::const_iterator it(neighbor_edges.begin()); it != neighbor_edges.end(); ++it)
-				edges_lookup.insert(std::make_pair(it->index, it));
-		}
-
-		inline Vertex(const physics::vec3_type & position) : position(position) {}
-	};
-
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> path;
-	HelixContainer helices;
-
-	struct Edge {
-		std::array<unsigned int, 2> vertices;
+	// Puts every helix back into the captured state.
+	inline void setSnapshot(const physics & phys, const snapshot_type & snapshot) {
+		assert(snapshot.size() == helices.size());
+		for (HelixContainer::size_type i = 0; i < helices.size(); ++i)
+			helices[i].setState(phys, snapshot[i]);
+	}
 
-		static std::hash<unsigned int> hasher;
+	inline void wakeUp() {
+		std::for_each(helices.begin(), helices.end(), std::mem_fun_ref(&Helix::wakeUp));
+	}
 
-		// Visual C++ support for initializer_list is awful.
-		inline Edge(unsigned int vertices_[2]) : vertices{ { vertices_[0], vertices_[1] } } {}
-		inline Edge(unsigned int vertex1, unsigned int vertex2) : vertices{ { vertex1, vertex2 } } {}
+	// Sum of the mass normalized kinetic energies of the helices.
+	inline physics::real_type getKineticEnergy(const physics & phys) const {
+		return std::accumulate(helices.begin(), helices.end(), physics::real_type(0), [&phys](physics::real_type energy, const Helix & helix) { return energy + helix.getKineticEnergy(phys); });
+	}
 
-		inline bool operator==(const Edge & e) const {
-			return (e.vertices[0] == vertices[0] && e.vertices[1] == vertices[1]) || (e.vertices[0] == vertices[1] && e.vertices[1] == vertices[0]);
-		}
+	// Springs between helices are shared, and thus counted twice.
+	inline physics::real_type getSpringEnergy(const physics & phys) const {
+		return std::accumulate(helices.begin(), helices.end(), physics::real_type(0), [&phys](physics::real_type energy, const Helix & helix) { return energy + helix.getSpringEnergy(phys); });
+	}
 
-		inline std::hash<unsigned int>::result_type hash() const {
-			return hasher(vertices[0]) + hasher(vertices[1]);
-		}
+	// True when every helix is sleeping.
+	inline bool isSleeping() const {
+		return std::all_of(helices.begin(), helices.end(), std::mem_fun_ref(&Helix::isSleeping));
+	}
 
-		inline unsigned int other(unsigned int vertex) const {
-			assert(vertex == vertices[0] || vertex == vertices[1]);
-			return vertex == vertices[0] ? vertices[1] : vertices[0];
-		}
-	};
+private:
+	/*
+	 * Creates a helix for every edge of the path, and connects them. The topology needed is built in flat arrays that only live during the set up:
+	 * Every vertex gets its incident edges as a slice of one array, sorted by their angle around the vertex normal.
+	 */
+	bool setupHelices(physics & phys);
 
-	std::vector<Edge> edges;
+	std::vector<physics::vec3_type> vertices;
+	std::vector<unsigned int> path;
+	HelixContainer helices;
 
 	const settings_type settings;
 	const ::Helix::settings_type helix_settings;
+
+	mutable separation_tracker tracker; // Measuring does not modify the scene.
 };
 
 /*
@@ -139,17 +150,36 @@ class SceneDescription {
 public:
 	explicit SceneDescription(scene & scene);
 	inline SceneDescription() : totalSeparation(0) {}
-	SceneDescription(const SceneDescription & scene) = delete; // Only allow rvalue move operator. The lookup pointer table will not work if we allow copies.
+	SceneDescription(const SceneDescription & scene); // Remaps the connections to the copied helices.
 	SceneDescription(SceneDescription && scene) { totalSeparation = scene.totalSeparation; helices = std::move(scene.helices); }
-	SceneDescription & operator=(const SceneDescription & scene) = delete;
+	SceneDescription & operator=(const SceneDescription & scene) = delete; // Helices are not assignable.
 	inline SceneDescription & operator=(SceneDescription && scene) { totalSeparation = scene.totalSeparation; helices = std::move(scene.helices); return *this; }
 
+	// Writes the .rpoly text format. Helices are named by their index.
 	bool write(std::ostream & out) const;
 
+	/*
+	 * The compact .rpolyb binary format: The magic "RPOLYB", a 16 bit version and a 32 bit helix count, followed by every helix as its 32 bit base count,
+	 * position and orientation quaternion (x, y, z, w) as 32 bit floats, and the indices of the helices connected to its four attachment points as 32 bit integers.
+	 * Everything is little endian. It can be converted to the text format by reading it back and writing it.
+	 */
+	bool write_binary(std::ostream & out) const;
+	bool read_binary(std::istream & in);
+
 	const physics::real_type getTotalSeparation() const {
 		return totalSeparation;
 	}
 
+	inline size_t getHelixCount() const {
+		return helices.size();
+	}
+
+	inline void getBaseCounts(std::vector<int> & bases) const {
+		bases.clear();
+		for (const Helix & helix : helices)
+			bases.push_back(int(helix.baseCount));
+	}
+
 private:
 	physics::real_type totalSeparation;
 
@@ -0,0 +1,77 @@
+#ifndef _SEPARATION_TRACKER_H_
+#define _SEPARATION_TRACKER_H_
+
+#include <Helix.h>
+#include <Physics.h>
+
+#include <array>
+#include <limits>
+#include <vector>
+
+/*
+ * Keeps the separations of the springs between helices in a flat array, with a running sum and segment trees over it for the minimum and maximum,
+ * so that measuring a scene only costs as much as the helices that moved since it was last measured. Every spring is counted once.
+ * A helix has moved if its base count changed, or if any of its attachment points may have moved by more than epsilon. Only the poses of the helices are compared
+ * to find those, which is much cheaper than measuring their springs. With an epsilon of 0, only helices at exactly the same pose are skipped and the separations are exact.
+ */
+
+class separation_tracker {
+public:
+	explicit inline separation_tracker(physics::real_type epsilon) : epsilon(epsilon), leaves(0), sum(0), base(NULL) {}
+
+	// Measures the springs of the helices that moved since the last update. Starts over when the helices or their springs have been replaced.
+	void update(const std::vector<Helix> & helices);
+
+	inline size_t getSpringCount() const {
+		return separations.size();
+	}
+
+	inline physics::real_type getMin() const {
+		return leaves > 0 ? min_tree[1] : std::numeric_limits<physics::real_type>::infinity();
+	}
+
+	inline physics::real_type getMax() const {
+		return leaves > 0 ? max_tree[1] : physics::real_type(0);
+	}
+
+	inline physics::real_type getTotal() const {
+		return physics::real_type(sum);
+	}
+
+private:
+	struct helix_state {
+		const physics::rigid_body_type *rigid_body;
+		unsigned int bases;
+		physics::transform_type pose; // When its springs were last measured.
+		physics::real_type reach; // Largest distance from the origin of the rigid body to an attachment point.
+		std::array<const physics::spring_joint_type *, 4> joints;
+	};
+
+	void rebuild(const std::vector<Helix> & helices);
+	void measure_reach(const Helix & helix, helix_state & state) const;
+
+	// Recomputes the inner nodes of the trees above every leaf, or only those above the given leaves.
+	void update_trees();
+	void update_trees(const std::vector<unsigned int> & springs);
+
+	physics::real_type epsilon;
+
+	std::vector<helix_state> states;
+	std::vector<unsigned int> spring_offsets, spring_indices; // Springs of every helix, in compressed rows.
+
+	std::vector<physics::spring_joint_type *> springs;
+	std::vector<physics::real_type> separations;
+
+	// Implicit binary trees with the leaves at [leaves, 2 * leaves), padded with values not affecting the result.
+	std::vector<physics::real_type> min_tree, max_tree;
+	size_t leaves;
+
+	double sum; // Kept in double precision, as it is updated by differences.
+
+	std::vector<unsigned int> dirty; // Springs to measure, reused between updates.
+	std::vector<char> marked;
+
+	const Helix *base; // Detects reallocation of the helices.
+};
+
+#endif /* _SEPARATION_TRACKER_H_ */
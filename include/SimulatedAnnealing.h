@@ -67,7 +67,7 @@ void simulated_annealing(
 template<typename EnergyT, typename TemperatureT>
 struct probability_functor : std::function<float(EnergyT, EnergyT, TemperatureT)> {
 	inline float operator()(const EnergyT & e, const EnergyT & enew, const TemperatureT & T) const {
-		return enew < e ? result_type(1) : exp(result_type(e - enew) / T);
+		return enew < e ? 1.0f : exp(float(e - enew) / T);
 	}
 };
 
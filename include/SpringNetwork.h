@@ -0,0 +1,118 @@
+#ifndef _SPRING_NETWORK_H_
+#define _SPRING_NETWORK_H_
+
+#include <Physics.h>
+#include <ThreadPool.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*
+ * The native engine, selected by --engine=native. A relaxation only involves rigid bodies pulled together by distance springs, which does not need a general purpose solver.
+ * The selected rigid bodies and springs are copied from the PhysX actors and joints into structure of arrays buffers, integrated with semi-implicit Euler steps,
+ * and written back to the actors after every call to physics::simulate, so that everything measuring the scene through PhysX keeps working.
+ * Bodies are integrated about their center of mass. The per spring and per body passes are split over a thread pool for large networks,
+ * and the spring forces are evaluated eight at a time with AVX2 when available.
+ * Helices collide as capsules bounding their first shape, found through a uniform grid and pushed apart by penalty springs. As in PhysX, connected bodies do not collide.
+ *
+ * With --engine=minimizer, the network is not integrated but moved straight to a minimum of its potential energy by L-BFGS over the rigid poses.
+ * The negative gradient of the energy is the force and torque on every body, the same the integrator uses, with the damping vanishing at zero velocity.
+ */
+
+class spring_network {
+public:
+	spring_network(const physics & phys, unsigned int threads);
+
+	spring_network(const spring_network &) = delete;
+	spring_network & operator=(const spring_network &) = delete;
+
+	// See physics::select_simulated.
+	void load(const std::vector<physics::rigid_body_type *> & rigid_bodies, const std::vector<physics::spring_joint_type *> & springs);
+
+	void step(physics::real_type timestep);
+
+	/*
+	 * Minimizes the energy of the springs, plus the overlap penalty unless the contact stiffness is 0. Stops when no force or torque on a body exceeds gradient_tolerance,
+	 * when the energy can not be lowered any further at single precision, after max_iterations, or when running returns false, which is checked once per iteration.
+	 * The energy ceasing to decrease counts as the minimum if the largest force or torque is below gradient_tolerance, or small against the force of a spring of average stiffness
+	 * holding an equal share of the energy, which is where single precision stops making progress.
+	 * Returns the number of iterations, and why it stopped in outcome. Velocities are cleared and the bodies put to sleep by the next store.
+	 */
+	unsigned int minimize(unsigned int max_iterations, physics::real_type gradient_tolerance, const std::function<bool()> & running, physics::Minimization & outcome);
+
+	// Writes the poses and velocities back to the rigid bodies. Bodies that have been at rest for a while are put to sleep, as PhysX would.
+	void store() const;
+
+private:
+	typedef physics::real_type real_type;
+	typedef std::vector<real_type> buffer_type;
+
+	// Calls functor(begin, end) over [0, count), split over the thread pool if large enough.
+	template<typename FunctorT>
+	void for_each_range(size_t count, FunctorT functor);
+
+	void compute_spring_points(size_t begin, size_t end);
+	void compute_body_forces(size_t begin, size_t end);
+	double compute_contacts(); // Returns the energy of the penalty springs.
+	void integrate(size_t begin, size_t end, real_type timestep);
+
+	// The energy of the network at zero velocity. Leaves its negative gradient in the force and torque buffers.
+	double evaluate();
+
+	// Sets the poses to the saved ones displaced by step * direction, which holds a translation and a world space rotation vector per body.
+	void displace(double step, const std::vector<double> & direction);
+
+	const physics & phys;
+	std::unique_ptr<thread_pool> pool; // NULL when single threaded.
+
+	/*
+	 * Bodies. Positions are those of the centers of mass, orientations those of the rigid bodies.
+	 * The inertia is diagonal in the frame rotated by (mqx, mqy, mqz, mqw) relative to the rigid body. Kinematic bodies have zero inverse mass and inertia.
+	 */
+	std::vector<physics::rigid_body_type *> bodies;
+	buffer_type px, py, pz, qx, qy, qz, qw, vx, vy, vz, wx, wy, wz;
+	buffer_type fx, fy, fz, tx, ty, tz; // Accumulated force and torque.
+	buffer_type inverse_mass, ix, iy, iz, mqx, mqy, mqz, mqw;
+	buffer_type cmx, cmy, cmz; // Center of mass relative to the rigid body.
+	buffer_type rest_time; // Seconds spent below the sleep threshold.
+
+	// Bounding capsules, centers relative to the center of mass and axes in the frame of the rigid body.
+	buffer_type ccx, ccy, ccz, cax, cay, caz, radius, half_height;
+	real_type cell_size;
+
+	/*
+	 * Springs. An end with a negative body index is attached to a fixed point, which its local point holds in world space.
+	 * Local points are relative to the center of mass, in the frame of the rigid body.
+	 */
+	std::vector<int> body0, body1;
+	buffer_type l0x, l0y, l0z, l1x, l1y, l1z, stiffness, damping, max_distance;
+	buffer_type r0x, r0y, r0z, r1x, r1y, r1z; // World space arms from the centers of mass to the ends.
+	buffer_type dx, dy, dz, dvx, dvy, dvz; // Separation and relative velocity of the ends.
+	buffer_type sfx, sfy, sfz; // Force pulling end 0 towards end 1.
+
+	// Springs attached to every body, as index * 2 + end, in compressed rows.
+	std::vector<unsigned int> spring_offsets, spring_ends;
+
+	// Pairs of bodies that do not collide, as (min << 32) | max, sorted.
+	std::vector<unsigned long long> connected_pairs;
+
+	struct cell_entry {
+		int x, y, z;
+		unsigned int body;
+
+		inline bool operator<(const cell_entry & other) const {
+			return x != other.x ? x < other.x : (y != other.y ? y < other.y : (z != other.z ? z < other.z : body < other.body));
+		}
+	};
+
+	std::vector<cell_entry> cells;
+
+	// Minimizer state. Vectors hold six values per body.
+	buffer_type spx, spy, spz, sqx, sqy, sqz, sqw; // Poses at the start of a line search.
+	std::vector<double> gradient, previous_gradient, direction, preconditioner;
+	std::vector<std::vector<double>> history_steps, history_gradients; // L-BFGS (s, y) pairs, used as a ring buffer.
+	std::vector<double> history_rho, history_alpha;
+};
+
+#endif /* _SPRING_NETWORK_H_ */
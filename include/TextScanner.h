@@ -0,0 +1,151 @@
+#ifndef _TEXT_SCANNER_H_
+#define _TEXT_SCANNER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Allocation free scanning of numbers in text buffers, for the file parsers. Every function advances it past what it read on success and leaves it untouched on failure.
+ * Numbers are read as by sscanf, except that an unsigned integer may not be negative, and that any blanks, but not line breaks, are skipped before them.
+ */
+
+namespace scan {
+	inline bool is_blank(char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	inline bool is_digit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	inline void skip_blanks(const char *& it, const char *end) {
+		while (it != end && is_blank(*it))
+			++it;
+	}
+
+	// The beginning of the next line, or end.
+	inline const char *next_line(const char *it, const char *end) {
+		const char *newline(static_cast<const char *>(memchr(it, '\n', end - it)));
+		return newline ? newline + 1 : end;
+	}
+
+	// Skips the literal if it is next, not skipping any blanks before it.
+	inline bool literal(const char *& it, const char *end, const char *str) {
+		const size_t length(strlen(str));
+		if (size_t(end - it) < length || memcmp(it, str, length) != 0)
+			return false;
+
+		it += length;
+		return true;
+	}
+
+	inline bool unsigned_integer(const char *& it, const char *end, unsigned int & value) {
+		const char *position(it);
+		skip_blanks(position, end);
+
+		if (position != end && *position == '+')
+			++position;
+
+		if (position == end || !is_digit(*position))
+			return false;
+
+		unsigned int result(0);
+		for (; position != end && is_digit(*position); ++position)
+			result = result * 10 + static_cast<unsigned int>(*position - '0');
+
+		value = result;
+		it = position;
+		return true;
+	}
+
+	/*
+	 * Decimal numbers with an optional fraction and exponent are converted directly, which covers what the exporters write.
+	 * Anything else, such as inf, nan or hexadecimal floats, is handed to strtod.
+	 */
+	template<typename RealT>
+	inline bool real(const char *& it, const char *end, RealT & value) {
+		static const double kPowersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		static const int kMaxExactPower(22), kMaxDigits(19);
+
+		const char *position(it);
+		skip_blanks(position, end);
+
+		const char *start(position);
+		bool negative(false);
+		if (position != end && (*position == '+' || *position == '-'))
+			negative = *position++ == '-';
+
+		unsigned long long mantissa(0);
+		int digits(0), exponent(0);
+		bool any(false);
+
+		for (; position != end && is_digit(*position); ++position, any = true) {
+			if (digits < kMaxDigits) {
+				mantissa = mantissa * 10 + static_cast<unsigned int>(*position - '0');
+				digits += mantissa > 0;
+			} else
+				++exponent;
+		}
+
+		if (position != end && *position == '.') {
+			for (++position; position != end && is_digit(*position); ++position, any = true) {
+				if (digits < kMaxDigits) {
+					mantissa = mantissa * 10 + static_cast<unsigned int>(*position - '0');
+					digits += mantissa > 0;
+					--exponent;
+				}
+			}
+		}
+
+		if (!any || (position != end && (*position == 'x' || *position == 'X' || *position == 'n' || *position == 'N' || *position == 'i' || *position == 'I'))) {
+			// Not a plain decimal number. strtod needs a terminated string, and numbers are short.
+			char buffer[64];
+			const size_t length(std::min(size_t(end - start), sizeof(buffer) - 1));
+			memcpy(buffer, start, length);
+			buffer[length] = '\0';
+
+			char *parsed_end;
+			const double result(strtod(buffer, &parsed_end));
+			if (parsed_end == buffer)
+				return false;
+
+			value = RealT(result);
+			it = start + (parsed_end - buffer);
+			return true;
+		}
+
+		if (position != end && (*position == 'e' || *position == 'E')) {
+			const char *exponent_position(position + 1);
+			bool negative_exponent(false);
+			if (exponent_position != end && (*exponent_position == '+' || *exponent_position == '-'))
+				negative_exponent = *exponent_position++ == '-';
+
+			if (exponent_position != end && is_digit(*exponent_position)) {
+				int written(0);
+				for (; exponent_position != end && is_digit(*exponent_position); ++exponent_position)
+					written = std::min(written * 10 + (*exponent_position - '0'), 100000);
+
+				exponent += negative_exponent ? -written : written;
+				position = exponent_position;
+			}
+		}
+
+		double result(static_cast<double>(mantissa));
+		if (mantissa != 0) {
+			if (exponent >= 0 && exponent <= kMaxExactPower)
+				result *= kPowersOfTen[exponent];
+			else if (exponent < 0 && exponent >= -kMaxExactPower)
+				result /= kPowersOfTen[-exponent];
+			else
+				result *= std::pow(10.0, double(exponent));
+		}
+
+		value = RealT(negative ? -result : result);
+		it = position;
+		return true;
+	}
+}
+
+#endif /* _TEXT_SCANNER_H_ */
@@ -0,0 +1,101 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads. Work is handed out one generation at a time: run() calls the functor once on every worker, passing the index of the worker,
+ * and blocks until all of them have returned. Workers are identified by index so that they can own per thread resources such as a physics scene replica.
+ */
+
+class thread_pool {
+public:
+	explicit inline thread_pool(unsigned int threads) : generation(0), pending(0), stopping(false) {
+		workers.reserve(threads);
+		for (unsigned int i = 0; i < threads; ++i)
+			workers.push_back(std::thread(&thread_pool::worker_main, this, i));
+	}
+
+	inline ~thread_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		work_available.notify_all();
+
+		for (std::thread & worker : workers)
+			worker.join();
+	}
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool & operator=(const thread_pool &) = delete;
+
+	inline unsigned int size() const {
+		return static_cast<unsigned int>(workers.size());
+	}
+
+	// Calls functor(worker) once on every worker and waits for all of them to finish.
+	template<typename FunctorT>
+	void run(FunctorT functor) {
+		std::unique_lock<std::mutex> lock(mutex);
+		job = functor;
+		pending = size();
+		++generation;
+		work_available.notify_all();
+		work_done.wait(lock, [this]() { return pending == 0; });
+		job = nullptr;
+	}
+
+	// Calls functor(worker, index) for every index in [0, count). Indices are handed out dynamically, so this also serves as a simple job queue.
+	template<typename FunctorT>
+	void parallel_for(size_t count, FunctorT functor) {
+		std::atomic<size_t> next(0);
+		run([&next, count, &functor](unsigned int worker) {
+			for (size_t index = next++; index < count; index = next++)
+				functor(worker, index);
+		});
+	}
+
+private:
+	void worker_main(unsigned int worker) {
+		unsigned long long seen_generation(0);
+
+		for (;;) {
+			std::function<void(unsigned int)> current_job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				work_available.wait(lock, [this, &seen_generation]() { return stopping || generation != seen_generation; });
+
+				if (stopping)
+					return;
+
+				seen_generation = generation;
+				current_job = job;
+			}
+
+			current_job(worker);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0)
+					work_done.notify_all();
+			}
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable work_available, work_done;
+	std::function<void(unsigned int)> job;
+	unsigned long long generation;
+	unsigned int pending;
+	bool stopping;
+};
+
+#endif /* _THREAD_POOL_H_ */
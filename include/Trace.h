@@ -0,0 +1,80 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <Physics.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Timelines in the Chrome trace event format, for chrome://tracing or Perfetto, enabled by --trace=<filename>. Works without the visual debugger.
+ * The spans of the phase timers of Profiler.h are recorded per thread under the process "rectification". The profile zones of PhysX,
+ * which include the tasks run by the CPU dispatcher threads, are recorded under the process "PhysX". Only checked and profile builds of PhysX emit them.
+ * Both are timed by the counter PhysX uses: The performance counter on Windows, and the nanoseconds of the real time clock elsewhere.
+ * Events are kept in memory and the file is written by trace::write at exit.
+ */
+
+namespace trace {
+	struct settings_type {
+		std::string filename; // Empty disables tracing.
+	};
+
+	extern bool enabled; // Set before any physics is created.
+
+	// The current value of the counter, in ticks.
+	unsigned long long now();
+
+	// Ticks per second.
+	unsigned long long frequency();
+
+	// A span of the calling thread.
+	void span(const char *name, unsigned long long begin, unsigned long long end);
+
+	bool write(const std::string & filename);
+
+#ifndef WITHOUT_PHYSX
+	/*
+	 * Receives the events of every profile zone of a PhysX SDK, created by the physics owning it when tracing.
+	 * The zones are flushed and the clients removed before the SDK is released.
+	 */
+	class zone_recorder : public physx::PxProfileZoneHandler {
+	public:
+		explicit zone_recorder(physx::PxProfileZoneManager & manager);
+		~zone_recorder();
+
+		zone_recorder(const zone_recorder &) = delete;
+		zone_recorder & operator=(const zone_recorder &) = delete;
+
+		void onZoneAdded(physx::PxProfileZone & zone);
+		void onZoneRemoved(physx::PxProfileZone & zone);
+
+	private:
+		class zone_client : public physx::PxProfileZoneClient, public physx::PxProfileEventHandler {
+		public:
+			explicit inline zone_client(physx::PxProfileZone & zone) : zone(zone) {}
+
+			void handleEventAdded(const physx::PxProfileEventName & name);
+			void handleBufferFlush(const physx::PxU8 *data, physx::PxU32 length);
+			inline void handleClientRemoved() {}
+
+			void onStartEvent(const physx::PxProfileEventId & id, physx::PxU32 threadId, physx::PxU64 contextId, physx::PxU8 cpuId, physx::PxU8 threadPriority, physx::PxU64 timestamp);
+			void onStopEvent(const physx::PxProfileEventId & id, physx::PxU32 threadId, physx::PxU64 contextId, physx::PxU8 cpuId, physx::PxU8 threadPriority, physx::PxU64 timestamp);
+			inline void onEventValue(const physx::PxProfileEventId &, physx::PxU32, physx::PxU64, physx::PxI64) {}
+			inline void onCUDAProfileBuffer(physx::PxU64, physx::PxF32, const physx::PxU8 *, physx::PxU32, physx::PxU32) {}
+
+			physx::PxProfileZone & zone;
+
+		private:
+			unsigned int name(const physx::PxProfileEventId & id); // Interned.
+
+			std::unordered_map<physx::PxU16, unsigned int> event_names; // By event id.
+		};
+
+		physx::PxProfileZoneManager & manager;
+		std::vector<zone_client *> clients;
+	};
+#endif /* N WITHOUT_PHYSX */
+}
+
+#endif /* _TRACE_H_ */
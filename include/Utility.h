@@ -12,6 +12,8 @@
 #include <Physics.h>
 
 #include <cassert>
+#include <cstdio>
+#include <string>
 #include <vector>
 
 /*
@@ -19,7 +21,7 @@
  */
 
 inline bool ends_with(const std::string & haystack, const std::string & needle) {
-	return haystack.find_last_of(needle) == haystack.length() - 1;
+	return haystack.length() >= needle.length() && haystack.compare(haystack.length() - needle.length(), needle.length(), needle) == 0;
 }
 
 inline std::string strip_trailing_string(const std::string & str, const std::string & trailing) {
@@ -69,35 +71,35 @@ T toDegrees(T radians) {
 /*
 * Project vector 'from' onto 'onto'.
 */
-inline physx::PxVec3 proj(const physx::PxVec3 & from, const physx::PxVec3 & onto) {
+inline physics::vec3_type proj(const physics::vec3_type & from, const physics::vec3_type & onto) {
 	return onto * (from.dot(onto) / onto.magnitudeSquared());
 }
 
-static const physx::PxVec3 kPosXAxis(1, 0, 0);
-static const physx::PxVec3 kPosYAxis(0, 1, 0);
-static const physx::PxVec3 kPosZAxis(0, 0, 1);
+static const physics::vec3_type kPosXAxis(1, 0, 0);
+static const physics::vec3_type kPosYAxis(0, 1, 0);
+static const physics::vec3_type kPosZAxis(0, 0, 1);
 
-static const physx::PxVec3 kNegXAxis(-1, 0, 0);
-static const physx::PxVec3 kNegYAxis(0, -1, 0);
-static const physx::PxVec3 kNegZAxis(0, 0, -1);
+static const physics::vec3_type kNegXAxis(-1, 0, 0);
+static const physics::vec3_type kNegYAxis(0, -1, 0);
+static const physics::vec3_type kNegZAxis(0, 0, -1);
 
-static const physx::PxVec3 kZeroVec(0, 0, 0);
-static const physx::PxVec3 kOneVec(1, 1, 1);
+static const physics::vec3_type kZeroVec(0, 0, 0);
+static const physics::vec3_type kOneVec(1, 1, 1);
 
-inline auto signedAngle(physx::PxVec3 from, physx::PxVec3 to, const physx::PxVec3 & normal)->decltype(from.dot(to)) {
+inline auto signedAngle(physics::vec3_type from, physics::vec3_type to, const physics::vec3_type & normal)->decltype(from.dot(to)) {
 	from.normalize();
 	to.normalize();
-	const physx::PxReal tofrom(to.dot(from));
+	const physics::real_type tofrom(to.dot(from));
 
-	if (abs(tofrom) >= physx::PxReal(1.0 - 1e-06))
-		return (1 - sgn_nozero(tofrom)) * physx::PxReal(M_PI / 2);
+	if (abs(tofrom) >= physics::real_type(1.0 - 1e-06))
+		return (1 - sgn_nozero(tofrom)) * physics::real_type(M_PI / 2);
 	else {
 		const int sign = sgn_nozero((normal.cross(from)).dot(to));
 		return sign * std::acos(tofrom);
 	}
 }
 
-physx::PxQuat rotationFromTo(physx::PxVec3 from, physx::PxVec3 to);
+physics::quaternion_type rotationFromTo(physics::vec3_type from, physics::vec3_type to);
 
 template<typename U, typename V>
 V circular_index(U index, V length) {
@@ -129,6 +131,9 @@ void seed();
 #ifdef _WINDOWS
 
 #include <windows.h>
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
 
 // Do not use, internal only, use setinterrupthandler() below.
 template<typename void(*FuncPtr)()>
@@ -154,22 +159,38 @@ inline void seed() {
 	srand(GetTickCount());
 }
 
+// Replaces the file at to by the one at from, atomically if both are on the same volume.
+inline bool replace_file(const std::string & from, const std::string & to) {
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
 inline unsigned int numcpucores() {
 	SYSTEM_INFO sysinfo;
 	GetSystemInfo(&sysinfo);
 	return unsigned int(sysinfo.dwNumberOfProcessors);
 }
 
+// Peak working set of the process in bytes.
+inline unsigned long long peakresidentsetsize() {
+	PROCESS_MEMORY_COUNTERS counters;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? unsigned long long(counters.PeakWorkingSetSize) : 0;
+}
+
 #else
 
+#include <csignal>
+#include <ctime>
+#include <sys/resource.h>
+#include <unistd.h>
+
 // Do not use, internal only, use setinterrupthandler below.
-template<typename void(*FuncPtr)()>
+template<void(*FuncPtr)()>
 void __interrupthandlerroutine(int s) {
 	FuncPtr();
 }
 
 // Set the interrupt handler ^C by template argument to function pointer.
-template<typename void(*FuncPtr)()>
+template<void(*FuncPtr)()>
 inline void setinterrupthandler() {
 	struct sigaction sigint_handler;
 	sigint_handler.sa_handler = __interrupthandlerroutine<FuncPtr>;
@@ -190,8 +211,26 @@ inline void seed() {
 	srand(time(NULL));
 }
 
+// Replaces the file at to by the one at from, atomically if both are on the same file system.
+inline bool replace_file(const std::string & from, const std::string & to) {
+	return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
 inline unsigned int numcpucores() {
-	return unsigned int(sysconf(_SC_NPROCESSORS_ONLN));
+	return static_cast<unsigned int>(sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+// Peak resident set size of the process in bytes.
+inline unsigned long long peakresidentsetsize() {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+#ifdef __APPLE__
+	return (unsigned long long) usage.ru_maxrss;
+#else
+	return (unsigned long long) usage.ru_maxrss * 1024; // Kilobytes on Linux.
+#endif /* __APPLE__ */
 }
 
 #endif /* N _WINDOWS */
@@ -0,0 +1,44 @@
+#include <Batch.h>
+
+#include <sstream>
+
+namespace batch {
+	bool read_manifest(std::istream & manifest, std::vector<job_type> & jobs) {
+		if (!manifest)
+			return false;
+
+		std::string line;
+		while (std::getline(manifest, line)) {
+			std::istringstream ss(line);
+			job_type job;
+
+			if (!(ss >> job.input_file) || job.input_file[0] == '#')
+				continue;
+
+			if (!(ss >> job.output_file)) {
+				const std::string::size_type extension(job.input_file.find_last_of('.')), separator(job.input_file.find_last_of("/\\"));
+				job.output_file = job.input_file.substr(0, extension != std::string::npos && (separator == std::string::npos || extension > separator) ? extension : std::string::npos) + ".rpoly";
+			}
+
+			jobs.push_back(job);
+		}
+
+		return true;
+	}
+
+	const char *status_name(summary_type::Status status) {
+		static const char *statuses[] = { "succeeded", "failed", "interrupted" };
+		return statuses[status];
+	}
+
+	void write_summary(std::ostream & out, const std::vector<job_type> & jobs, const std::vector<summary_type> & summaries) {
+		out << "input\toutput\tstatus\thelices\tinitial_total\tmin\tmax\taverage\ttotal\tseconds\tmessage" << std::endl;
+
+		for (std::vector<job_type>::size_type i = 0; i < jobs.size(); ++i) {
+			const summary_type & summary(summaries[i]);
+			out << jobs[i].input_file << '\t' << jobs[i].output_file << '\t' << status_name(summary.status) << '\t' << summary.helices << '\t'
+				<< summary.initial_total << '\t' << summary.min << '\t' << summary.max << '\t' << summary.average << '\t' << summary.total << '\t'
+				<< summary.seconds << '\t' << summary.message << std::endl;
+		}
+	}
+}
@@ -0,0 +1,105 @@
+#include <BinaryIO.h>
+#include <Checkpoint.h>
+#include <Utility.h>
+
+#include <fstream>
+#include <iostream>
+
+namespace {
+	const char kMagic[6] = { 'R', 'C', 'K', 'P', 'T', '\0' };
+	const uint16_t kVersion(1);
+}
+
+bool checkpoint_type::write(std::ostream & out) const {
+	std::string buffer;
+
+	buffer.append(kMagic, sizeof(kMagic));
+	binary::put(buffer, kVersion);
+	binary::put(buffer, uint32_t(optimizer));
+	binary::put(buffer, uint64_t(position));
+	binary::put_float(buffer, min);
+	binary::put_float(buffer, max);
+	binary::put_float(buffer, average);
+	binary::put_float(buffer, total);
+
+	binary::put(buffer, uint32_t(chains.size()));
+	for (const chain_type & chain : chains) {
+		binary::put(buffer, uint32_t(chain.bases.size()));
+		for (int bases : chain.bases)
+			binary::put(buffer, uint32_t(bases));
+
+		binary::put_float(buffer, chain.total);
+		binary::put(buffer, uint32_t(chain.temperature));
+		binary::put_string(buffer, chain.generator);
+	}
+
+	binary::put_string(buffer, generator);
+
+	out.write(buffer.data(), buffer.size());
+	return out && best.write_binary(out);
+}
+
+bool checkpoint_type::read(std::istream & in) {
+	char magic[sizeof(kMagic)];
+	uint16_t version;
+	uint32_t optimizer_, chainCount;
+	uint64_t position_;
+
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, kMagic, sizeof(magic)) != 0 || !binary::get(in, version) || version != kVersion
+			|| !binary::get(in, optimizer_) || optimizer_ > kParallelTempering || !binary::get(in, position_)
+			|| !binary::get_float(in, min) || !binary::get_float(in, max) || !binary::get_float(in, average) || !binary::get_float(in, total)
+			|| !binary::get(in, chainCount))
+		return false;
+
+	optimizer = Optimizer(optimizer_);
+	position = position_;
+
+	chains.resize(chainCount);
+	for (chain_type & chain : chains) {
+		uint32_t helixCount, temperature;
+		if (!binary::get(in, helixCount))
+			return false;
+
+		chain.bases.resize(helixCount);
+		for (int & bases : chain.bases) {
+			uint32_t value;
+			if (!binary::get(in, value))
+				return false;
+			bases = int(value);
+		}
+
+		if (!binary::get_float(in, chain.total) || !binary::get(in, temperature) || !binary::get_string(in, chain.generator))
+			return false;
+		chain.temperature = temperature;
+	}
+
+	return binary::get_string(in, generator) && best.read_binary(in);
+}
+
+bool checkpointer::save(const checkpoint_type & checkpoint) {
+	if (!isEnabled())
+		return false;
+
+	last = std::chrono::steady_clock::now();
+
+	const std::string temporary(filename + ".tmp");
+	{
+		std::ofstream out(temporary, std::ios::binary);
+		if (!checkpoint.write(out) || !out.flush()) {
+			std::cerr << "Failed to write checkpoint \"" << temporary << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	if (!replace_file(temporary, filename)) {
+		std::cerr << "Failed to replace checkpoint \"" << filename << "\"" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool checkpointer::load(const std::string & filename, checkpoint_type & checkpoint) {
+	std::ifstream in(filename, std::ios::binary);
+	return in && checkpoint.read(in);
+}
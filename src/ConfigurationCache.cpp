@@ -0,0 +1,68 @@
+#include <ConfigurationCache.h>
+
+#include <iterator>
+
+size_t configuration_cache::hash_type::operator()(const key_type & key) const {
+	unsigned long long hash(14695981039346656037ULL);
+
+	for (int bases : key) {
+		hash ^= (unsigned long long) (unsigned int) bases;
+		hash *= 1099511628211ULL;
+	}
+
+	return size_t(hash);
+}
+
+configuration_cache::Lookup configuration_cache::find(const key_type & key, physics::real_type threshold, entry_type & entry) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	const auto it(lookup.find(key));
+	if (it == lookup.end()) {
+		++statistics.misses;
+		return kMissing;
+	}
+
+	entries.splice(entries.begin(), entries, it->second);
+	++statistics.hits;
+
+	// The snapshot is only worth copying if it is to be restored.
+	if (it->second->second.total >= threshold)
+		return kRejected;
+
+	entry = it->second->second;
+	return kFound;
+}
+
+void configuration_cache::insert(const key_type & key, const entry_type & entry) {
+	if (capacity == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	const auto it(lookup.find(key));
+	if (it != lookup.end()) {
+		it->second->second = entry;
+		entries.splice(entries.begin(), entries, it->second);
+		return;
+	}
+
+	if (entries.size() >= capacity) {
+		// Reuse the evicted node and its buffers.
+		lookup.erase(entries.back().first);
+		entries.splice(entries.begin(), entries, std::prev(entries.end()));
+		entries.front().first = key;
+		entries.front().second = entry;
+		++statistics.evictions;
+	} else
+		entries.push_front(std::make_pair(key, entry));
+
+	lookup.insert(std::make_pair(key, entries.begin()));
+}
+
+configuration_cache::statistics_type configuration_cache::getStatistics() const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	statistics_type result(statistics);
+	result.size = entries.size();
+	return result;
+}
@@ -1,7 +1,9 @@
 #include <Definition.h>
 #include <DNA.h>
 #include <Helix.h>
+#include <Profiler.h>
 
+#include <array>
 #include <cassert>
 #include <initializer_list>
 
@@ -37,7 +39,33 @@ std::initializer_list<Helix::AttachmentPoint> opposites(Helix::AttachmentPoint p
 	}
 }
 
-void Helix::createRigidBody(physics & phys, int bases, const physics::transform_type & transform) {
+constexpr physics::real_type kSphereRadius(physics::real_type(DNA::SPHERE_RADIUS * DNA::APPROXIMATION_RADIUS_MULTIPLIER));
+
+// Helices shorter than this are approximated by their end spheres only.
+inline bool hasCapsule(physics::real_type length) {
+	return length > DNA::RADIUS_PLUS_SPHERE_RADIUS * 2;
+}
+
+inline physics::capsule_geometry_type capsuleGeometry(physics::real_type length) {
+	return physics::capsule_geometry_type(physics::real_type(DNA::RADIUS_PLUS_SPHERE_RADIUS), length / 2 - physics::real_type(DNA::RADIUS_PLUS_SPHERE_RADIUS));
+}
+
+const physics::transform_type kCapsuleLocalPose(physics::quaternion_type(physics::real_type(M_PI_2), kNegYAxis));
+
+// Local poses of the four exaggerated end spheres, in the order they are attached to the rigid body.
+std::array<physics::transform_type, 4> sphereLocalPoses(int bases, physics::real_type length) {
+	constexpr physics::real_type offset(physics::real_type(DNA::RADIUS - kSphereRadius + DNA::SPHERE_RADIUS));
+
+	return { {
+		physics::transform_type(physics::vec3_type(0, offset, -length / 2 + kSphereRadius)),
+		physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(-DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, -length / 2 + kSphereRadius))),
+		physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - kSphereRadius))),
+		physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases - DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - kSphereRadius)))
+	} };
+}
+
+void Helix::createRigidBody(physics & phys, int bases, const physics::transform_type & pose) {
+	profiler::scoped_timer timer(profiler::kCreateRigidBody);
 	assert(rigidBody == nullptr);
 
 	const physics::real_type length(physics::real_type(DNA::BasesToLength(bases)));
@@ -45,28 +73,26 @@ void Helix::createRigidBody(physics & phys, int bases, const physics::transform_
 	if (length <= 0/*DNA::RADIUS_PLUS_SPHERE_RADIUS * 2*/)
 		throw std::runtime_error("Helix length is too short. Rescale the structure so that the length of the structure is at least the diameter of the cylinder approximation. This is because PhysX forces us to approximate helices as capsules.");
 
-	constexpr physics::real_type radius(physics::real_type(DNA::SPHERE_RADIUS * DNA::APPROXIMATION_RADIUS_MULTIPLIER));
-	constexpr physics::real_type offset(physics::real_type(DNA::RADIUS - radius + DNA::SPHERE_RADIUS));
-
-	const physics::sphere_geometry_type sphereGeometry(radius);
-	if (length > DNA::RADIUS_PLUS_SPHERE_RADIUS * 2) {
-		rigidBody = phys.create_rigid_body(transform, settings.density,
-			std::make_pair(physics::capsule_geometry_type(physics::real_type(DNA::RADIUS_PLUS_SPHERE_RADIUS), length / 2 - physics::real_type(DNA::RADIUS_PLUS_SPHERE_RADIUS)), physics::transform_type(physics::quaternion_type(physics::real_type(M_PI_2), kNegYAxis))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::vec3_type(0, offset, -length / 2 + radius))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(-DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, -length / 2 + radius)))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - radius)))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases - DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - radius)))));
+	const physics::sphere_geometry_type sphereGeometry(kSphereRadius);
+	const std::array<physics::transform_type, 4> spherePoses(sphereLocalPoses(bases, length));
+	if (hasCapsule(length)) {
+		rigidBody = phys.create_rigid_body(pose, settings.density,
+			std::make_pair(capsuleGeometry(length), kCapsuleLocalPose),
+			std::make_pair(sphereGeometry, spherePoses[0]),
+			std::make_pair(sphereGeometry, spherePoses[1]),
+			std::make_pair(sphereGeometry, spherePoses[2]),
+			std::make_pair(sphereGeometry, spherePoses[3]));
 	} else {
-		rigidBody = phys.create_rigid_body(transform, settings.density,
-			std::make_pair(sphereGeometry, physics::transform_type(physics::vec3_type(0, offset, -length / 2 + radius))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(-DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, -length / 2 + radius)))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - radius)))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases - DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - radius)))));
+		rigidBody = phys.create_rigid_body(pose, settings.density,
+			std::make_pair(sphereGeometry, spherePoses[0]),
+			std::make_pair(sphereGeometry, spherePoses[1]),
+			std::make_pair(sphereGeometry, spherePoses[2]),
+			std::make_pair(sphereGeometry, spherePoses[3]));
 	}
 	assert(rigidBody != nullptr);
 
 	if (settings.attach_fixed) {
-		fixedJoint = phys.create_spring_joint(rigidBody, physics::transform_type(kZeroVec), NULL, transform, settings.fixed_spring_stiffness, settings.spring_damping);
+		fixedJoint = phys.create_spring_joint(rigidBody, physics::transform_type(kZeroVec), NULL, initialTransform, settings.fixed_spring_stiffness, settings.spring_damping);
 		assert(rigidBody != nullptr);
 	}
 
@@ -79,7 +105,8 @@ void Helix::destroyRigidBody(physics & phys) {
 	fixedJoint = NULL;
 }
 
-void Helix::recreateRigidBody(physics & phys, int bases, const physics::transform_type & transform) {
+void Helix::recreateRigidBody(physics & phys, int bases, const physics::transform_type & pose) {
+	profiler::scoped_timer timer(profiler::kRecreateRigidBody);
 	const std::array< std::tuple<Helix *, AttachmentPoint, AttachmentPoint>, 4 > points{ { 
 		std::make_tuple(joints[kForwardThreePrime].helix, kForwardThreePrime, otherPoint(kForwardThreePrime, *joints[kForwardThreePrime].helix)),
 		std::make_tuple(joints[kForwardFivePrime].helix, kForwardFivePrime, otherPoint(kForwardFivePrime, *joints[kForwardFivePrime].helix)),
@@ -87,13 +114,68 @@ void Helix::recreateRigidBody(physics & phys, int bases, const physics::transfor
 		std::make_tuple(joints[kBackwardFivePrime].helix, kBackwardFivePrime, otherPoint(kBackwardFivePrime, *joints[kBackwardFivePrime].helix))
 	} };
 
+	unsigned int vertices[2];
+	const bool filtered(phys.get_collision_vertices(*rigidBody, vertices[0], vertices[1]));
+
 	destroyRigidBody(phys);
-	createRigidBody(phys, bases, transform);
+	createRigidBody(phys, bases, pose);
+
+	if (filtered)
+		phys.set_collision_vertices(*rigidBody, vertices[0], vertices[1]);
 
 	for (int i = 0; i < 4; ++i)
 		attach(phys, *std::get<0>(points[i]), std::get<1>(points[i]), std::get<2>(points[i]));
 }
 
+void Helix::resize(physics & phys, int bases, const physics::transform_type & pose) {
+	const physics::real_type length(physics::real_type(DNA::BasesToLength(bases)));
+
+	// The shapes can only be modified in place as long as the helix keeps or lacks its capsule.
+	if (length <= 0 || hasCapsule(length) != hasCapsule(physics::real_type(DNA::BasesToLength(this->bases)))) {
+		recreateRigidBody(phys, bases, pose);
+		return;
+	}
+
+	std::array<physics::shape_type *, 5> shapes;
+	const unsigned int shapeCount(phys.get_shapes(*rigidBody, shapes.data(), static_cast<unsigned int>(shapes.size())));
+	assert(shapeCount == (hasCapsule(length) ? 5u : 4u));
+
+	const std::array<physics::transform_type, 4> spherePoses(sphereLocalPoses(bases, length));
+	std::array<physics::shape_type *, 5>::iterator sphere_it(shapes.begin());
+	if (hasCapsule(length)) {
+		const physics::capsule_geometry_type geometry(capsuleGeometry(length));
+		phys.set_shape_geometry(**sphere_it++, geometry, kCapsuleLocalPose);
+		phys.set_mass(*rigidBody, settings.density, geometry, kCapsuleLocalPose);
+	} else
+		phys.set_mass(*rigidBody, settings.density, physics::sphere_geometry_type(kSphereRadius), spherePoses[0]);
+
+	for (const physics::transform_type & spherePose : spherePoses)
+		phys.set_shape_geometry(**sphere_it++, physics::sphere_geometry_type(kSphereRadius), spherePose);
+
+	this->bases = bases;
+
+	for (int i = 0; i < 4; ++i) {
+		if (joints[i].joint)
+			phys.set_spring_joint_local_frame(joints[i].joint, rigidBody, physics::transform_type(localFrame(AttachmentPoint(i), bases)));
+	}
+
+	// The fixed spring is attached at the origin of the rigid body, and stays anchored at the initial transform.
+	phys.reset_rigid_body(*rigidBody, pose);
+}
+
+void Helix::setGeometry(physics & phys, Geometry geometry) {
+	std::array<physics::shape_type *, kMaxShapeCount> shapes;
+	const unsigned int shapeCount(phys.get_shapes(*rigidBody, shapes.data(), static_cast<unsigned int>(shapes.size())));
+
+	// The capsule, if any, is the first shape.
+	const bool capsule(hasCapsule(physics::real_type(DNA::BasesToLength(bases))));
+	for (unsigned int i = 0; i < shapeCount; ++i)
+		phys.set_shape_simulated(*shapes[i], geometry == kFullGeometry || (geometry == kCapsuleGeometry && (i == 0 || !capsule)));
+
+	if (geometry == kFullGeometry && !phys.is_kinematic(*rigidBody))
+		physics::wake_up(*rigidBody);
+}
+
 void Helix::attach(physics & phys, Helix & other, AttachmentPoint thisPoint, AttachmentPoint otherPoint) {
 	assert(rigidBody);
 	//assert(joints[thisPoint].helix == nullptr && joints[thisPoint].joint == nullptr && other.joints[otherPoint].helix == nullptr && other.joints[otherPoint].joint == nullptr);
@@ -116,7 +198,7 @@ physics::real_type Helix::getSeparation(AttachmentPoint atPoint) const {
 
 Helix::AttachmentPoint Helix::otherPoint(Helix::AttachmentPoint point, const Helix & other) const {
 	for (Helix::AttachmentPoint otherPoint : opposites(point)) {
-		if (other.joints[otherPoint].helix == this)
+		if (other.joints[otherPoint].helix == this && other.joints[otherPoint].joint == joints[point].joint)
 			return otherPoint;
 	}
 
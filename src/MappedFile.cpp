@@ -0,0 +1,82 @@
+#include <MappedFile.h>
+
+#ifdef _WINDOWS
+
+#include <windows.h>
+
+mapped_file::mapped_file(const std::string & filename) : data(NULL), size(0), open(false), file(INVALID_HANDLE_VALUE), mapping(NULL) {
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+		return;
+
+	size = size_t(fileSize.QuadPart);
+	if (size == 0) {
+		// Empty files can not be mapped.
+		open = true;
+		return;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return;
+
+	data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	open = data != NULL;
+}
+
+mapped_file::~mapped_file() {
+	if (data)
+		UnmapViewOfFile(data);
+
+	if (mapping)
+		CloseHandle(mapping);
+
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::mapped_file(const std::string & filename) : data(NULL), size(0), open(false), descriptor(-1) {
+	descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return;
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0)
+		return;
+
+	size = size_t(status.st_size);
+	if (size == 0) {
+		// Empty files can not be mapped.
+		open = true;
+		return;
+	}
+
+	void *address(mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0));
+	if (address == MAP_FAILED)
+		return;
+
+	madvise(address, size, MADV_SEQUENTIAL);
+	data = static_cast<const char *>(address);
+	open = true;
+}
+
+mapped_file::~mapped_file() {
+	if (data)
+		munmap(const_cast<char *>(data), size);
+
+	if (descriptor >= 0)
+		close(descriptor);
+}
+
+#endif /* _WINDOWS */
@@ -0,0 +1,130 @@
+#include <Metrics.h>
+
+#include <cstdio>
+#include <iostream>
+
+namespace metrics {
+	namespace {
+		std::string escape(const std::string & str) {
+			std::string result;
+			result.reserve(str.size());
+
+			for (char c : str) {
+				if (c == '"' || c == '\\') {
+					result += '\\';
+					result += c;
+				} else if ((unsigned char) c < 0x20) {
+					char buffer[8];
+					snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned int) (unsigned char) c);
+					result += buffer;
+				} else
+					result += c;
+			}
+
+			return result;
+		}
+
+		// JSON has no infinities, as the total of a configuration that was never measured may be.
+		void append(std::string & record, const char *name, double value) {
+			char buffer[64];
+			if (value == value && value - value == 0)
+				snprintf(buffer, sizeof(buffer), ",\"%s\":%.9g", name, value);
+			else
+				snprintf(buffer, sizeof(buffer), ",\"%s\":null", name);
+			record += buffer;
+		}
+	}
+
+	stream::stream(const settings_type & settings) : interval(settings.interval) {
+		if (!settings.filename.empty()) {
+			out.open(settings.filename);
+
+			if (!out.is_open())
+				std::cerr << "Failed to open metrics stream \"" << settings.filename << "\"" << std::endl;
+		}
+	}
+
+	void stream::write(const std::string & record) {
+		std::lock_guard<std::mutex> lock(mutex);
+		out << record << '\n';
+		out.flush();
+	}
+
+	reporter::reporter(stream & out, const relaxation & relax, const std::string & job) : out(out), relax(relax), job(escape(job)),
+			start(std::chrono::steady_clock::now()), last(start), first(relax.getStatistics()), previous(first), stored(false), min(0), max(0), average(0), total(0) {}
+
+	void reporter::best(physics::real_type min_, physics::real_type max_, physics::real_type average_, physics::real_type total_) {
+		if (!out.isOpen())
+			return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stored = true;
+		min = min_;
+		max = max_;
+		average = average_;
+		total = total_;
+		write("best", NULL, false);
+	}
+
+	void reporter::poll() {
+		if (!out.isOpen() || out.getInterval() <= 0)
+			return;
+
+		// Whoever holds the mutex is already writing a record.
+		std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+		if (lock.owns_lock() && std::chrono::duration<double>(std::chrono::steady_clock::now() - last).count() >= out.getInterval())
+			write("progress", NULL, true);
+	}
+
+	void reporter::finish(const char *status) {
+		if (!out.isOpen())
+			return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		write("finished", status, true);
+	}
+
+	void reporter::write(const char *event, const char *status, bool restart) {
+		const std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+		const relaxation::statistics_type statistics(relax.getStatistics());
+		const double seconds(std::chrono::duration<double>(now - last).count());
+		const unsigned long long relaxations(statistics.relaxations - previous.relaxations), steps(statistics.steps - previous.steps);
+
+		std::string record("{\"job\":\"");
+		record += job;
+		record += "\",\"event\":\"";
+		record += event;
+		record += '"';
+
+		if (status) {
+			record += ",\"status\":\"";
+			record += status;
+			record += '"';
+		}
+
+		append(record, "elapsed", std::chrono::duration<double>(now - start).count());
+
+		if (stored) {
+			append(record, "min", min);
+			append(record, "max", max);
+			append(record, "average", average);
+			append(record, "total", total);
+		} else
+			record += ",\"min\":null,\"max\":null,\"average\":null,\"total\":null";
+
+		append(record, "relaxations", double(statistics.relaxations - first.relaxations));
+		append(record, "steps", double(statistics.steps - first.steps));
+		append(record, "steps_per_relaxation", relaxations > 0 ? double(steps) / relaxations : 0.0);
+		append(record, "relaxations_per_second", seconds > 0 ? relaxations / seconds : 0.0);
+		append(record, "steps_per_second", seconds > 0 ? steps / seconds : 0.0);
+		record += '}';
+
+		out.write(record);
+
+		if (!restart)
+			return;
+
+		last = now;
+		previous = statistics;
+	}
+}
@@ -1,9 +1,144 @@
 #include <Utility.h>
 #include <Physics.h>
+#include <Profiler.h>
+#include <SpringNetwork.h>
+#include <Trace.h>
 
-const physics::quaternion_type physics::quaternion_identity(physx::PxIdentity);
+#include <cmath>
+#include <stdexcept>
+
+#ifdef WITHOUT_PHYSX
+
+const physics::quaternion_type physics::quaternion_identity(0, 0, 0, 1);
 
 physics::physics(const settings_type & settings) : settings(settings) {
+	if (settings.engine == kPhysX)
+		throw std::runtime_error("Built without PhysX, use --engine=native or --engine=minimizer");
+
+	PRINT("This CPU has %u cores.", numcpucores());
+	network.reset(new spring_network(*this, numcpucores()));
+}
+
+physics::physics(physics & shared, unsigned int threads) : physics(shared, shared.settings, threads) {}
+
+physics::physics(physics &, const settings_type & settings, unsigned int threads) : settings(settings) {
+	if (settings.engine == kPhysX)
+		throw std::runtime_error("Built without PhysX, use --engine=native or --engine=minimizer");
+
+	network.reset(new spring_network(*this, threads));
+}
+
+physics::~physics() {
+	while (!rigid_bodies.empty())
+		destroy_rigid_body(*rigid_bodies.begin());
+}
+
+// There is no scene to prepare.
+void physics::prepare_scene(const vec3_type &, const vec3_type &, unsigned int, unsigned int, unsigned int) {}
+
+void physics::destroy_rigid_body(rigid_body_type *rigid_body) {
+	for (spring_joint_type *joint : rigid_body->joints) {
+		rigid_body_type *other(joint->rigid_bodies[joint->rigid_bodies[0] == rigid_body ? 1 : 0]);
+		if (other)
+			other->joints.erase(std::find(other->joints.begin(), other->joints.end(), joint));
+
+		delete joint;
+	}
+
+	rigid_bodies.erase(rigid_body);
+	delete rigid_body;
+}
+
+void physics::set_collision_vertices(rigid_body_type & rigid_body, unsigned int vertex1, unsigned int vertex2) const {
+	rigid_body.vertices[0] = vertex1 + 1;
+	rigid_body.vertices[1] = vertex2 + 1;
+}
+
+bool physics::get_collision_vertices(const rigid_body_type & rigid_body, unsigned int & vertex1, unsigned int & vertex2) const {
+	vertex1 = rigid_body.vertices[0] - 1;
+	vertex2 = rigid_body.vertices[1] - 1;
+	return rigid_body.vertices[0] != 0;
+}
+
+physics::spring_joint_type *physics::create_spring_joint(rigid_body_type *rigid_body1, const transform_type & transform1, rigid_body_type *rigid_body2, const transform_type & transform2, real_type stiffness, real_type damping) {
+	spring_joint_type *joint(new spring_joint_type(rigid_body1, transform1, rigid_body2, transform2, stiffness, damping));
+
+	for (rigid_body_type *rigid_body : joint->rigid_bodies) {
+		if (rigid_body)
+			rigid_body->joints.push_back(joint);
+	}
+
+	return joint;
+}
+
+void physics::set_spring_joint_local_frame(spring_joint_type *joint, const rigid_body_type *rigid_body, const transform_type & transform) const {
+	assert(joint->rigid_bodies[0] != joint->rigid_bodies[1]);
+	assert(joint->rigid_bodies[0] == rigid_body || joint->rigid_bodies[1] == rigid_body);
+
+	joint->frames[joint->rigid_bodies[0] == rigid_body ? 0 : 1] = transform;
+}
+
+void physics::get_spring_joint_frames(const spring_joint_type & joint, rigid_body_type *(&rigid_bodies)[2], transform_type (&local_frames)[2]) {
+	for (int i = 0; i < 2; ++i) {
+		rigid_bodies[i] = joint.rigid_bodies[i];
+		local_frames[i] = joint.frames[i];
+	}
+}
+
+void physics::set_kinematic(rigid_body_type & rigid_body, bool kinematic) const {
+	rigid_body.kinematic = kinematic;
+
+	if (!kinematic)
+		rigid_body.wakeUp();
+}
+
+#else
+
+const physics::quaternion_type physics::quaternion_identity(physx::PxIdentity);
+
+namespace {
+	struct profile_type {
+		physx::PxU32 position_iterations, velocity_iterations;
+		physx::PxBroadPhaseType::Enum broadphase;
+		bool pcm;
+	};
+
+	const profile_type kProfiles[] = {
+		{ 2, 1, physx::PxBroadPhaseType::eMBP, false },
+		{ 4, 1, physx::PxBroadPhaseType::eSAP, false },
+		{ 8, 2, physx::PxBroadPhaseType::eSAP, true }
+	};
+
+	const physx::PxU32 kScratchBlockSize(16 * 1024); // PhysX takes the scratch memory in multiples of this.
+	const physx::PxU32 kScratchBytesPerBody(512);
+	const physx::PxU32 kMaxScratchSize(256 * kScratchBlockSize);
+
+	const physx::PxU32 kBodiesPerRegion(256);
+	const physx::PxU32 kMaxRegionSubdivisions(8); // Regions are laid out in a grid of up to this many squared, PhysX allows at most 256.
+	const physics::real_type kRegionMargin(0.25); // Relative to the largest extent of the structure, as the helices move while relaxed.
+
+	// Copied by PhysX along with the filter shader.
+	struct filter_block_type {
+		std::atomic<unsigned int> *filtered_pairs;
+	};
+
+	// Filter data words 0 and 1 hold the vertices of the helix plus one, zero if not set.
+	physx::PxFilterFlags adjacent_filter_shader(physx::PxFilterObjectAttributes attributes0, physx::PxFilterData filterData0, physx::PxFilterObjectAttributes attributes1, physx::PxFilterData filterData1,
+			physx::PxPairFlags & pairFlags, const void *constantBlock, physx::PxU32 constantBlockSize) {
+		if (filterData0.word0 != 0 && filterData1.word0 != 0) {
+			const unsigned int shared((filterData0.word0 == filterData1.word0) + (filterData0.word0 == filterData1.word1) + (filterData0.word1 == filterData1.word0) + (filterData0.word1 == filterData1.word1));
+			if (shared == 1) {
+				assert(constantBlockSize == sizeof(filter_block_type));
+				++*static_cast<const filter_block_type *>(constantBlock)->filtered_pairs;
+				return physx::PxFilterFlag::eKILL;
+			}
+		}
+
+		return physx::PxDefaultSimulationFilterShader(attributes0, physx::PxFilterData(), attributes1, physx::PxFilterData(), pairFlags, NULL, 0);
+	}
+}
+
+physics::physics(const settings_type & settings) : settings(settings), owns_sdk(true), filtered_pairs(0), scratch(nullptr), scratch_size(0) {
 	foundation = PxCreateFoundation(PX_PHYSICS_VERSION, allocator, errorCallback);
 	profileZoneManager = &physx::PxProfileZoneManager::createProfileZoneManager(foundation);
 	pxphysics = PxCreatePhysics(PX_PHYSICS_VERSION, *foundation, physx::PxTolerancesScale(), true, profileZoneManager);
@@ -17,20 +152,34 @@ physics::physics(const settings_type & settings) : settings(settings) {
 	} else
 		connection = nullptr;
 
-	physx::PxSceneDesc sceneDesc(pxphysics->getTolerancesScale());
-	PRINT("This CPU has %u cores.", numcpucores());
-	dispatcher = physx::PxDefaultCpuDispatcherCreate(numcpucores());
-	sceneDesc.cpuDispatcher = dispatcher;
-	sceneDesc.filterShader = physx::PxDefaultSimulationFilterShader;
+	if (trace::enabled)
+		recorder.reset(new trace::zone_recorder(*profileZoneManager));
 
-	scene = pxphysics->createScene(sceneDesc);
+	PRINT("This CPU has %u cores.", numcpucores());
+	create_scene(numcpucores());
 
 	material = pxphysics->createMaterial(settings.kStaticFriction, settings.kDynamicFriction, settings.kRestitution); // What about deletion upon destruction?
 }
 
+physics::physics(physics & shared, unsigned int threads) : physics(shared, shared.settings, threads) {}
+
+physics::physics(physics & shared, const settings_type & settings, unsigned int threads) :
+		foundation(shared.foundation), profileZoneManager(shared.profileZoneManager), pxphysics(shared.pxphysics), connection(nullptr), material(shared.material), settings(settings), owns_sdk(false), filtered_pairs(0), scratch(nullptr), scratch_size(0) {
+	create_scene(threads);
+}
+
 physics::~physics() {
 	scene->release();
 	dispatcher->release();
+
+	if (scratch)
+		allocator.deallocate(scratch);
+
+	if (!owns_sdk)
+		return;
+
+	recorder.reset(); // Flushes the zones while they exist.
+
 	if (connection)
 		connection->release();
 	pxphysics->release();
@@ -38,12 +187,108 @@ physics::~physics() {
 	foundation->release();
 }
 
-physics::sphere_geometry_type physics::create_sphere_geometry(real_type radius) {
-	return physx::PxSphereGeometry(radius);
+void physics::create_scene(unsigned int threads) {
+	position_iterations = kProfiles[settings.profile].position_iterations;
+	velocity_iterations = kProfiles[settings.profile].velocity_iterations;
+
+	dispatcher = physx::PxDefaultCpuDispatcherCreate(threads);
+
+	// Multi box pruning needs regions, which are not known until prepare_scene.
+	scene = create_scene(physx::PxSceneLimits(), physx::PxBroadPhaseType::eSAP);
+
+	if (settings.engine != kPhysX)
+		network.reset(new spring_network(*this, threads));
 }
 
-physics::capsule_geometry_type physics::create_x_axis_capsule(real_type radius, real_type half_height) {
-	return physx::PxCapsuleGeometry(radius, half_height);
+physx::PxScene *physics::create_scene(const physx::PxSceneLimits & limits, physx::PxBroadPhaseType::Enum broadphase) const {
+	physx::PxSceneDesc sceneDesc(pxphysics->getTolerancesScale());
+	sceneDesc.cpuDispatcher = dispatcher;
+	sceneDesc.limits = limits;
+
+	const filter_block_type filter_block = { &filtered_pairs };
+	if (settings.filter_adjacent) {
+		sceneDesc.filterShader = adjacent_filter_shader;
+		sceneDesc.filterShaderData = &filter_block;
+		sceneDesc.filterShaderDataSize = sizeof(filter_block);
+	} else
+		sceneDesc.filterShader = physx::PxDefaultSimulationFilterShader;
+	sceneDesc.broadPhaseType = broadphase;
+
+	if (kProfiles[settings.profile].pcm)
+		sceneDesc.flags |= physx::PxSceneFlag::eENABLE_PCM;
+
+	physx::PxScene *created(pxphysics->createScene(sceneDesc));
+	if (!created)
+		throw std::runtime_error("Failed to create the PhysX scene");
+
+	return created;
+}
+
+void physics::prepare_scene(const vec3_type & lower, const vec3_type & upper, unsigned int rigid_bodies, unsigned int shapes, unsigned int spring_joints) {
+	if (scene->getNbActors(physx::PxActorTypeSelectionFlag::eRIGID_DYNAMIC) != 0)
+		return;
+
+	const profile_type & profile(kProfiles[settings.profile]);
+
+	physx::PxSceneLimits limits;
+	limits.maxNbActors = rigid_bodies;
+	limits.maxNbBodies = rigid_bodies;
+	limits.maxNbDynamicShapes = shapes;
+	limits.maxNbConstraints = spring_joints;
+
+	physx::PxBounds3 regions[kMaxRegionSubdivisions * kMaxRegionSubdivisions];
+	physx::PxU32 region_count(0);
+
+	if (profile.broadphase == physx::PxBroadPhaseType::eMBP) {
+		physx::PxBounds3 bounds(lower, upper);
+		const vec3_type extents(bounds.getExtents());
+		bounds.fattenFast(std::max(std::max(extents.x, extents.y), std::max(extents.z, real_type(1))) * 2 * kRegionMargin);
+
+		// The grid is laid out across the two largest extents.
+		const physx::PxU32 up_axis(extents.x <= extents.y && extents.x <= extents.z ? 0 : (extents.y <= extents.z ? 1 : 2));
+		const physx::PxU32 subdivisions(std::max(physx::PxU32(1), std::min(kMaxRegionSubdivisions, physx::PxU32(std::sqrt(real_type(rigid_bodies) / kBodiesPerRegion)))));
+
+		region_count = physx::PxBroadPhaseExt::createRegionsFromWorldBounds(regions, bounds, subdivisions, up_axis);
+		limits.maxNbRegions = region_count;
+	}
+
+	scene->release();
+	scene = create_scene(limits, profile.broadphase);
+
+	for (physx::PxU32 i = 0; i < region_count; ++i) {
+		const physx::PxBroadPhaseRegion region = { regions[i], NULL };
+		scene->addBroadPhaseRegion(region);
+	}
+
+	if (scratch)
+		allocator.deallocate(scratch);
+
+	scratch_size = std::min(kMaxScratchSize, (rigid_bodies * kScratchBytesPerBody + kScratchBlockSize - 1) / kScratchBlockSize * kScratchBlockSize);
+	scratch = scratch_size ? allocator.allocate(scratch_size, "scratch", __FILE__, __LINE__) : nullptr;
+}
+
+void physics::destroy_rigid_body(rigid_body_type *rigid_body) {
+	scene->removeActor(*rigid_body);
+	rigid_body->release();
+}
+
+void physics::set_collision_vertices(rigid_body_type & rigid_body, unsigned int vertex1, unsigned int vertex2) const {
+	const physx::PxFilterData data(vertex1 + 1, vertex2 + 1, 0, 0);
+
+	shape_type *shape;
+	for (physx::PxU32 i = 0; rigid_body.getShapes(&shape, 1, i) == 1; ++i)
+		shape->setSimulationFilterData(data);
+}
+
+bool physics::get_collision_vertices(const rigid_body_type & rigid_body, unsigned int & vertex1, unsigned int & vertex2) const {
+	shape_type *shape;
+	if (rigid_body.getShapes(&shape, 1) != 1)
+		return false;
+
+	const physx::PxFilterData data(shape->getSimulationFilterData());
+	vertex1 = data.word0 - 1;
+	vertex2 = data.word1 - 1;
+	return data.word0 != 0;
 }
 
 physics::spring_joint_type *physics::create_spring_joint(rigid_body_type *rigid_body1, const transform_type & transform1, rigid_body_type *rigid_body2, const transform_type & transform2, real_type stiffness, real_type damping) {
@@ -55,3 +300,137 @@ physics::spring_joint_type *physics::create_spring_joint(rigid_body_type *rigid_
 
 	return joint;
 }
+
+void physics::set_spring_joint_local_frame(spring_joint_type *joint, const rigid_body_type *rigid_body, const transform_type & transform) const {
+	physx::PxRigidActor *actor0, *actor1;
+	joint->getActors(actor0, actor1);
+	assert(actor0 != actor1);
+	assert(actor0 == rigid_body || actor1 == rigid_body);
+
+	joint->setLocalPose(actor0 == rigid_body ? physx::PxJointActorIndex::eACTOR0 : physx::PxJointActorIndex::eACTOR1, transform);
+}
+
+void physics::get_spring_joint_frames(const spring_joint_type & joint, rigid_body_type *(&rigid_bodies)[2], transform_type (&local_frames)[2]) {
+	physx::PxRigidActor *actors[2];
+	joint.getActors(actors[0], actors[1]);
+
+	// Helices are the only actors in the scene.
+	for (int i = 0; i < 2; ++i) {
+		rigid_bodies[i] = static_cast<rigid_body_type *>(actors[i]);
+		local_frames[i] = joint.getLocalPose(i == 0 ? physx::PxJointActorIndex::eACTOR0 : physx::PxJointActorIndex::eACTOR1);
+	}
+}
+
+void physics::set_kinematic(rigid_body_type & rigid_body, bool kinematic) const {
+	rigid_body.setRigidBodyFlag(physx::PxRigidBodyFlag::eKINEMATIC, kinematic);
+
+	if (!kinematic)
+		rigid_body.wakeUp();
+}
+
+#endif /* N WITHOUT_PHYSX */
+
+physics::sphere_geometry_type physics::create_sphere_geometry(real_type radius) {
+	return sphere_geometry_type(radius);
+}
+
+physics::capsule_geometry_type physics::create_x_axis_capsule(real_type radius, real_type half_height) {
+	return capsule_geometry_type(radius, half_height);
+}
+
+void physics::set_mass(rigid_body_type & rigid_body, real_type density, const capsule_geometry_type & geometry, const transform_type & local_pose) const {
+	// Capsules extend along their local x axis. The mass space is the frame of the shape, as it is aligned with the principal axes.
+	const real_type r(geometry.radius), h(geometry.halfHeight);
+	const real_type cylinderMass(density * real_type(M_PI) * r * r * 2 * h), hemispheresMass(density * real_type(4.0 / 3.0 * M_PI) * r * r * r);
+	const real_type axial(cylinderMass * r * r / 2 + hemispheresMass * r * r * real_type(2.0 / 5.0));
+	const real_type transversal(cylinderMass * (r * r / 4 + h * h / 3) + hemispheresMass * (r * r * real_type(2.0 / 5.0) + h * h + h * r * real_type(3.0 / 4.0)));
+
+	rigid_body.setMass(cylinderMass + hemispheresMass);
+	rigid_body.setMassSpaceInertiaTensor(vec3_type(axial, transversal, transversal));
+	rigid_body.setCMassLocalPose(local_pose);
+}
+
+void physics::set_mass(rigid_body_type & rigid_body, real_type density, const sphere_geometry_type & geometry, const transform_type & local_pose) const {
+	const real_type mass(density * real_type(4.0 / 3.0 * M_PI) * geometry.radius * geometry.radius * geometry.radius);
+
+	rigid_body.setMass(mass);
+	rigid_body.setMassSpaceInertiaTensor(vec3_type(mass * geometry.radius * geometry.radius * real_type(2.0 / 5.0)));
+	rigid_body.setCMassLocalPose(transform_type(local_pose.p));
+}
+
+void physics::reset_rigid_body(rigid_body_type & rigid_body, const transform_type & transform) const {
+	rigid_body.setGlobalPose(transform);
+	rigid_body.setLinearVelocity(kZeroVec);
+	rigid_body.setAngularVelocity(kZeroVec);
+	rigid_body.wakeUp();
+}
+
+void physics::get_bounding_capsule(const rigid_body_type & rigid_body, transform_type & local_pose, real_type & radius, real_type & half_height) const {
+	shape_type *shape;
+	if (rigid_body.getShapes(&shape, 1) != 1)
+		throw std::runtime_error("Rigid body without shapes");
+
+	local_pose = shape->getLocalPose();
+
+	capsule_geometry_type capsule;
+	sphere_geometry_type sphere;
+	if (shape->getCapsuleGeometry(capsule)) {
+		radius = capsule.radius;
+		half_height = capsule.halfHeight;
+	} else if (shape->getSphereGeometry(sphere)) {
+		radius = sphere.radius;
+		half_height = 0;
+	} else
+		throw std::runtime_error("Unsupported shape geometry");
+}
+
+void physics::simulate(real_type timestep, unsigned int substeps) {
+	const real_type substep(timestep / real_type(substeps));
+
+	if (network) {
+		{
+			profiler::scoped_timer timer(profiler::kSimulate);
+			for (unsigned int i = 0; i < substeps; ++i)
+				network->step(substep);
+		}
+
+		profiler::scoped_timer timer(profiler::kFetchResults);
+		network->store();
+		return;
+	}
+
+#ifndef WITHOUT_PHYSX
+	for (unsigned int i = 0; i < substeps; ++i) {
+		{
+			profiler::scoped_timer timer(profiler::kSimulate);
+			scene->simulate(substep, NULL, scratch, scratch_size);
+		}
+		{
+			profiler::scoped_timer timer(profiler::kFetchResults);
+			scene->fetchResults(true);
+		}
+
+		if (profiler::enabled) {
+			physx::PxSimulationStatistics statistics;
+			scene->getSimulationStatistics(statistics);
+
+			const profiler::simulation_statistics_type step = { statistics.nbActiveDynamicBodies, statistics.nbActiveConstraints, statistics.nbDiscreteContactPairsTotal,
+				statistics.nbDiscreteContactPairsWithContacts, statistics.nbNewPairs, statistics.nbLostPairs, filtered_pairs.exchange(0) };
+			profiler::record(step);
+		}
+	}
+#endif /* N WITHOUT_PHYSX */
+}
+
+unsigned int physics::minimize(unsigned int max_iterations, real_type gradient_tolerance, const std::function<bool()> & running, Minimization & outcome) {
+	assert(network);
+	profiler::scoped_timer timer(profiler::kMinimize);
+	const unsigned int iterations(network->minimize(max_iterations, gradient_tolerance, running, outcome));
+	network->store();
+	return iterations;
+}
+
+void physics::select_simulated(const std::vector<rigid_body_type *> & rigid_bodies, const std::vector<spring_joint_type *> & springs) {
+	assert(network);
+	network->load(rigid_bodies, springs);
+}
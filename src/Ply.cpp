@@ -0,0 +1,296 @@
+#include <Ply.h>
+#include <TextScanner.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace ply {
+	namespace {
+		enum Format {
+			kAscii,
+			kBinaryLittleEndian,
+			kBinaryBigEndian
+		};
+
+		enum Type {
+			kInt8, kUInt8, kInt16, kUInt16, kInt32, kUInt32, kFloat32, kFloat64, kNoType
+		};
+
+		struct property_type {
+			std::string name;
+			Type type;
+			Type count_type; // kNoType unless a list, in which case type is that of the items.
+		};
+
+		struct element_type {
+			std::string name;
+			size_t count;
+			std::vector<property_type> properties;
+		};
+
+		Type parse_type(const std::string & name) {
+			static const char *names[][2] = {
+				{ "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+				{ "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+			};
+
+			for (int i = 0; i < kNoType; ++i) {
+				if (name == names[i][0] || name == names[i][1])
+					return Type(i);
+			}
+
+			return kNoType;
+		}
+
+		inline size_t type_size(Type type) {
+			static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+			return sizes[type];
+		}
+
+		inline bool is_little_endian() {
+			const uint16_t value(1);
+			unsigned char byte;
+			memcpy(&byte, &value, 1);
+			return byte == 1;
+		}
+
+		// Reads a binary scalar of any alignment, swapping its bytes if the file and the machine disagree on endianness.
+		double read_binary(const char *data, Type type, bool swap) {
+			unsigned char bytes[8];
+			const size_t size(type_size(type));
+			memcpy(bytes, data, size);
+
+			if (swap) {
+				for (size_t i = 0; i < size / 2; ++i)
+					std::swap(bytes[i], bytes[size - 1 - i]);
+			}
+
+			switch (type) {
+			case kInt8: { int8_t value; memcpy(&value, bytes, size); return double(value); }
+			case kUInt8: { uint8_t value; memcpy(&value, bytes, size); return double(value); }
+			case kInt16: { int16_t value; memcpy(&value, bytes, size); return double(value); }
+			case kUInt16: { uint16_t value; memcpy(&value, bytes, size); return double(value); }
+			case kInt32: { int32_t value; memcpy(&value, bytes, size); return double(value); }
+			case kUInt32: { uint32_t value; memcpy(&value, bytes, size); return double(value); }
+			case kFloat32: { float value; memcpy(&value, bytes, size); return double(value); }
+			case kFloat64: { double value; memcpy(&value, bytes, size); return value; }
+			default: return 0;
+			}
+		}
+
+		// Reads the next whitespace separated word of the header line.
+		bool read_word(const char *& it, const char *end, std::string & word) {
+			scan::skip_blanks(it, end);
+
+			const char *start(it);
+			while (it != end && !scan::is_blank(*it) && *it != '\n')
+				++it;
+
+			word.assign(start, it);
+			return !word.empty();
+		}
+
+		bool parse_header(const char *& it, const char *end, Format & format, std::vector<element_type> & elements) {
+			std::string word;
+
+			if (!read_word(it, end, word) || word != "ply")
+				return false;
+
+			bool has_format(false);
+
+			for (it = scan::next_line(it, end); it != end; it = scan::next_line(it, end)) {
+				const char *position(it);
+				if (!read_word(position, end, word))
+					continue;
+
+				if (word == "format") {
+					if (!read_word(position, end, word))
+						return false;
+
+					if (word == "ascii")
+						format = kAscii;
+					else if (word == "binary_little_endian")
+						format = kBinaryLittleEndian;
+					else if (word == "binary_big_endian")
+						format = kBinaryBigEndian;
+					else
+						return false;
+
+					has_format = true;
+				} else if (word == "element") {
+					element_type element;
+					unsigned int count;
+					if (!read_word(position, end, element.name) || !scan::unsigned_integer(position, end, count))
+						return false;
+
+					element.count = count;
+					elements.push_back(element);
+				} else if (word == "property") {
+					if (elements.empty())
+						return false;
+
+					property_type property;
+					std::string type;
+					if (!read_word(position, end, type))
+						return false;
+
+					if (type == "list") {
+						std::string count_type;
+						if (!read_word(position, end, count_type) || !read_word(position, end, type))
+							return false;
+
+						property.count_type = parse_type(count_type);
+						if (property.count_type == kNoType || property.count_type == kFloat32 || property.count_type == kFloat64)
+							return false;
+					} else
+						property.count_type = kNoType;
+
+					property.type = parse_type(type);
+					if (property.type == kNoType || !read_word(position, end, property.name))
+						return false;
+
+					elements.back().properties.push_back(property);
+				} else if (word == "end_header") {
+					it = scan::next_line(it, end);
+					return has_format;
+				}
+			}
+
+			return false;
+		}
+
+		// Skips an element instance, or reads the values of its scalar properties into values, indexed as the properties.
+		bool read_binary_instance(const char *& it, const char *end, const element_type & element, bool swap, double *values) {
+			for (std::vector<property_type>::size_type i = 0; i < element.properties.size(); ++i) {
+				const property_type & property(element.properties[i]);
+
+				if (property.count_type == kNoType) {
+					if (size_t(end - it) < type_size(property.type))
+						return false;
+
+					if (values)
+						values[i] = read_binary(it, property.type, swap);
+
+					it += type_size(property.type);
+				} else {
+					if (size_t(end - it) < type_size(property.count_type))
+						return false;
+
+					const size_t count(size_t(read_binary(it, property.count_type, swap)));
+					it += type_size(property.count_type);
+
+					if (size_t(end - it) < count * type_size(property.type))
+						return false;
+
+					it += count * type_size(property.type);
+				}
+			}
+
+			return true;
+		}
+
+		bool read_ascii_instance(const char *& it, const char *end, const element_type & element, double *values) {
+			const char *position(it);
+			double value;
+
+			// Instances usually are lines, but need not be.
+			for (std::vector<property_type>::size_type i = 0; i < element.properties.size(); ++i) {
+				const property_type & property(element.properties[i]);
+
+				while (position != end && (scan::is_blank(*position) || *position == '\n'))
+					++position;
+
+				if (!scan::real(position, end, value))
+					return false;
+
+				if (property.count_type == kNoType) {
+					if (values)
+						values[i] = value;
+				} else {
+					for (size_t j = 0; j < size_t(value); ++j) {
+						while (position != end && (scan::is_blank(*position) || *position == '\n'))
+							++position;
+
+						double item;
+						if (!scan::real(position, end, item))
+							return false;
+					}
+				}
+			}
+
+			it = position;
+			return true;
+		}
+	}
+
+	bool read_vertices(const char *begin, const char *end, std::vector<physics::vec3_type> & vertices) {
+		const char *it(begin);
+		Format format;
+		std::vector<element_type> elements;
+
+		if (!parse_header(it, end, format, elements))
+			return false;
+
+		const bool swap(format != kAscii && (format == kBinaryLittleEndian) != is_little_endian());
+
+		for (const element_type & element : elements) {
+			if (element.name != "vertex") {
+				for (size_t i = 0; i < element.count; ++i) {
+					if (!(format == kAscii ? read_ascii_instance(it, end, element, NULL) : read_binary_instance(it, end, element, swap, NULL)))
+						return false;
+				}
+
+				continue;
+			}
+
+			size_t coordinates[3] = { element.properties.size(), element.properties.size(), element.properties.size() };
+			for (std::vector<property_type>::size_type i = 0; i < element.properties.size(); ++i) {
+				const property_type & property(element.properties[i]);
+				if (property.count_type == kNoType && property.name.size() == 1 && property.name[0] >= 'x' && property.name[0] <= 'z')
+					coordinates[property.name[0] - 'x'] = i;
+			}
+
+			if (coordinates[0] == element.properties.size() || coordinates[1] == element.properties.size() || coordinates[2] == element.properties.size())
+				return false;
+
+			vertices.reserve(vertices.size() + element.count);
+
+			// Binary vertices without lists all have the same size, and only the coordinates need to be looked at.
+			if (format != kAscii && std::all_of(element.properties.begin(), element.properties.end(), [](const property_type & property) { return property.count_type == kNoType; })) {
+				size_t stride(0), offsets[3];
+				for (std::vector<property_type>::size_type i = 0; i < element.properties.size(); ++i) {
+					for (int j = 0; j < 3; ++j) {
+						if (coordinates[j] == i)
+							offsets[j] = stride;
+					}
+
+					stride += type_size(element.properties[i].type);
+				}
+
+				if (size_t(end - it) / stride < element.count)
+					return false;
+
+				const Type types[3] = { element.properties[coordinates[0]].type, element.properties[coordinates[1]].type, element.properties[coordinates[2]].type };
+				for (const char *row = it, *rows_end = it + element.count * stride; row != rows_end; row += stride)
+					vertices.push_back(physics::vec3_type(physics::real_type(read_binary(row + offsets[0], types[0], swap)), physics::real_type(read_binary(row + offsets[1], types[1], swap)), physics::real_type(read_binary(row + offsets[2], types[2], swap))));
+
+				return true;
+			}
+
+			std::vector<double> values(element.properties.size());
+
+			for (size_t i = 0; i < element.count; ++i) {
+				if (!(format == kAscii ? read_ascii_instance(it, end, element, values.data()) : read_binary_instance(it, end, element, swap, values.data())))
+					return false;
+
+				vertices.push_back(physics::vec3_type(physics::real_type(values[coordinates[0]]), physics::real_type(values[coordinates[1]]), physics::real_type(values[coordinates[2]])));
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,142 @@
+#include <Profiler.h>
+#include <Utility.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+
+namespace profiler {
+	bool enabled = false;
+
+	namespace {
+		const int kSubBuckets(8); // Per power of two.
+		const int kBuckets(64 * kSubBuckets);
+
+		const char *kPhaseNames[kPhaseCount] = { "parse", "setup_helices", "create_rigid_body", "recreate_rigid_body", "simulate", "fetch_results", "minimize", "energy", "output", "trial", "relaxation" };
+
+		struct phase_type {
+			std::atomic<unsigned long long> count, total, max;
+			std::atomic<unsigned long long> buckets[kBuckets];
+		};
+
+		phase_type phases[kPhaseCount]; // Zero initialized as a static.
+
+		// Buckets are exact below kSubBuckets, and then split every power of two in kSubBuckets.
+		inline int bucket(unsigned long long nanoseconds) {
+			if (nanoseconds < (unsigned long long) kSubBuckets)
+				return int(nanoseconds);
+
+			int exponent(0);
+			while ((nanoseconds >> exponent) >= (unsigned long long) (kSubBuckets * 2))
+				++exponent;
+
+			return (exponent + 1) * kSubBuckets + int(nanoseconds >> exponent) - kSubBuckets;
+		}
+
+		// The largest value of a bucket.
+		inline unsigned long long bucket_limit(int index) {
+			if (index < kSubBuckets)
+				return (unsigned long long) index;
+
+			const int exponent(index / kSubBuckets - 1);
+			return ((unsigned long long) (index % kSubBuckets + kSubBuckets + 1) << exponent) - 1;
+		}
+
+		const double nanoseconds_per_tick(1e9 / double(trace::frequency()));
+
+		const int kSimulationStatisticCount = 7;
+
+		std::mutex simulation_mutex;
+		unsigned long long steps(0);
+		unsigned long long simulation_totals[kSimulationStatisticCount] = { 0, 0, 0, 0, 0, 0, 0 };
+		unsigned int simulation_max[kSimulationStatisticCount] = { 0, 0, 0, 0, 0, 0, 0 };
+	}
+
+	void record(Phase phase, unsigned long long begin, unsigned long long end) {
+		if (trace::enabled)
+			trace::span(kPhaseNames[phase], begin, end);
+
+		if (!enabled)
+			return;
+
+		const unsigned long long nanoseconds(end > begin ? (unsigned long long) ((end - begin) * nanoseconds_per_tick) : 0);
+		phase_type & p(phases[phase]);
+		p.count.fetch_add(1, std::memory_order_relaxed);
+		p.total.fetch_add(nanoseconds, std::memory_order_relaxed);
+		p.buckets[bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+
+		unsigned long long max(p.max.load(std::memory_order_relaxed));
+		while (nanoseconds > max && !p.max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed));
+	}
+
+	void record(const simulation_statistics_type & statistics) {
+		const unsigned int values[kSimulationStatisticCount] = { statistics.active_bodies, statistics.constraints, statistics.pairs, statistics.contact_pairs, statistics.new_pairs, statistics.lost_pairs, statistics.filtered_pairs };
+
+		std::lock_guard<std::mutex> lock(simulation_mutex);
+		++steps;
+		for (int i = 0; i < kSimulationStatisticCount; ++i) {
+			simulation_totals[i] += values[i];
+			simulation_max[i] = std::max(simulation_max[i], values[i]);
+		}
+	}
+
+	void report(std::ostream & out) {
+		char line[256];
+
+		out << "Profile:" << std::endl;
+		snprintf(line, sizeof(line), "%-20s %12s %14s %12s %12s %12s", "phase", "count", "total ms", "mean us", "p99 us", "max us");
+		out << line << std::endl;
+
+		for (int i = 0; i < kPhaseCount; ++i) {
+			const phase_type & p(phases[i]);
+			const unsigned long long count(p.count.load()), total(p.total.load());
+			if (count == 0)
+				continue;
+
+			// The smallest bucket holding at least 99% of the samples.
+			unsigned long long p99(0), seen(0);
+			for (int j = 0; j < kBuckets; ++j) {
+				seen += p.buckets[j].load();
+				if (seen * 100 >= count * 99) {
+					p99 = std::min(bucket_limit(j), p.max.load());
+					break;
+				}
+			}
+
+			snprintf(line, sizeof(line), "%-20s %12llu %14.3f %12.3f %12.3f %12.3f", kPhaseNames[i], count, total / 1e6, double(total) / count / 1e3, p99 / 1e3, p.max.load() / 1e3);
+			out << line << std::endl;
+		}
+
+		out << "Peak resident set: " << (peakresidentsetsize() / (1024.0 * 1024.0)) << " MB" << std::endl;
+
+		std::lock_guard<std::mutex> lock(simulation_mutex);
+		if (steps > 0) {
+			static const char *names[kSimulationStatisticCount] = { "active bodies", "constraints", "contact pairs", "pairs with contacts", "new pairs", "lost pairs", "filtered pairs" };
+
+			out << "PhysX steps: " << steps << std::endl;
+			for (int i = 0; i < kSimulationStatisticCount; ++i)
+				out << '\t' << names[i] << ": average: " << double(simulation_totals[i]) / steps << ", max: " << simulation_max[i] << std::endl;
+			out << "\tfiltered pairs: total: " << simulation_totals[kSimulationStatisticCount - 1] << std::endl;
+		}
+	}
+
+	unsigned long long total(Phase phase) {
+		return phases[phase].total.load();
+	}
+
+	void reset() {
+		for (phase_type & p : phases) {
+			p.count.store(0);
+			p.total.store(0);
+			p.max.store(0);
+			for (std::atomic<unsigned long long> & bucket : p.buckets)
+				bucket.store(0);
+		}
+
+		std::lock_guard<std::mutex> lock(simulation_mutex);
+		steps = 0;
+		std::fill(simulation_totals, simulation_totals + kSimulationStatisticCount, 0ull);
+		std::fill(simulation_max, simulation_max + kSimulationStatisticCount, 0u);
+	}
+}
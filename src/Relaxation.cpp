@@ -0,0 +1,151 @@
+#include <Relaxation.h>
+
+#include <iostream>
+
+relaxation::statistics_type relaxation::getStatistics() const {
+	std::lock_guard<std::mutex> lock(statistics_mutex);
+	return statistics;
+}
+
+void relaxation::record(unsigned int steps, Outcome outcome) const {
+	static const char *outcomes[kOutcomeCount] = { "asleep", "converged", "capped", "interrupted", "stalled" };
+
+	std::lock_guard<std::mutex> lock(statistics_mutex);
+	++statistics.relaxations;
+	statistics.steps += steps;
+	statistics.max_steps = std::max(statistics.max_steps, steps);
+	++statistics.outcomes[outcome];
+
+	if (settings.report_convergence)
+		std::cerr << "Relaxation " << statistics.relaxations << ": " << steps << " steps, " << outcomes[outcome] << std::endl;
+}
+
+unsigned int relaxation::minimize(physics & phys, const std::function<bool()> & running) const {
+	static const unsigned int kMaxIterations(1000);
+	static const Outcome kOutcomes[] = { kConverged, kStalled, kCapped, kInterrupted }; // By physics::Minimization.
+
+	physics::Minimization minimization;
+	const unsigned int iterations(phys.minimize(settings.max_steps > 0 ? settings.max_steps : kMaxIterations, settings.gradient_tolerance, running, minimization));
+	record(iterations, kOutcomes[minimization]);
+	return iterations;
+}
+
+void relaxation::select(const scene & mesh, physics & phys, const region_type *region) const {
+	const scene::HelixContainer & helices(mesh.getHelices());
+	const size_t count(region ? region->size() : helices.size());
+
+	std::vector<physics::rigid_body_type *> rigidBodies;
+	std::vector<physics::spring_joint_type *> springs;
+	rigidBodies.reserve(count);
+	springs.reserve(count * 5);
+
+	for (size_t i = 0; i < count; ++i) {
+		const Helix & helix(helices[region ? (*region)[i] : i]);
+		rigidBodies.push_back(helix.getRigidBody());
+		helix.getSprings(springs);
+	}
+
+	// Springs between two selected helices were added twice.
+	std::sort(springs.begin(), springs.end());
+	springs.erase(std::unique(springs.begin(), springs.end()), springs.end());
+
+	phys.select_simulated(rigidBodies, springs);
+}
+
+void relaxation::begin(scene & mesh, physics & phys) const {
+	if (!isLocal())
+		return;
+
+	for (Helix & helix : mesh.getHelices())
+		helix.setFrozen(phys, true);
+}
+
+void relaxation::revert(scene & mesh, physics & phys, const move_type & move) const {
+	scene::HelixContainer & helices(mesh.getHelices());
+	Helix & helix(helices[move.helix]);
+
+	if (isLocal()) {
+		// Kinematic bodies can be moved but not put at rest, so the helix is unfrozen while resized.
+		helix.setFrozen(phys, false);
+		helix.resize(phys, move.previous_bases, move.previous_transforms.front());
+		helix.setFrozen(phys, true);
+
+		for (relaxation::region_type::size_type i = 1; i < move.region.size(); ++i)
+			helices[move.region[i]].setTransform(move.previous_transforms[i]);
+	} else if (settings.warm_start) {
+		helix.resize(phys, move.previous_bases, move.snapshot[move.helix].pose);
+		mesh.setSnapshot(phys, move.snapshot);
+	} else
+		helix.resize(phys, move.previous_bases, helix.getInitialTransform());
+}
+
+void relaxation::replicate(scene & mesh, physics & phys, const scene & source, const move_type & move) const {
+	scene::HelixContainer & helices(mesh.getHelices());
+	const scene::HelixContainer & sourceHelices(source.getHelices());
+	Helix & helix(helices[move.helix]);
+
+	if (isLocal()) {
+		helix.setFrozen(phys, false);
+		helix.resize(phys, sourceHelices[move.helix].getBaseCount(), sourceHelices[move.helix].getTransform());
+		helix.setFrozen(phys, true);
+
+		for (relaxation::region_type::size_type i = 1; i < move.region.size(); ++i)
+			helices[move.region[i]].setTransform(sourceHelices[move.region[i]].getTransform());
+	} else if (settings.warm_start) {
+		helix.resize(phys, sourceHelices[move.helix].getBaseCount(), sourceHelices[move.helix].getTransform());
+
+		for (scene::HelixContainer::size_type i = 0; i < helices.size(); ++i)
+			helices[i].setState(phys, sourceHelices[i].getState(phys));
+	} else
+		helix.resize(phys, sourceHelices[move.helix].getBaseCount(), helix.getInitialTransform());
+}
+
+void relaxation::revert(scene & mesh, physics & phys, const combined_move_type & move) const {
+	scene::HelixContainer & helices(mesh.getHelices());
+
+	for (std::vector<int>::size_type i = 0; i < move.changes.size(); ++i) {
+		Helix & helix(helices[move.changes[i].first]);
+
+		if (isLocal()) {
+			const relaxation::region_type::size_type position(std::lower_bound(move.region.begin(), move.region.end(), move.changes[i].first) - move.region.begin());
+			helix.setFrozen(phys, false);
+			helix.resize(phys, move.previous_bases[i], move.previous_transforms[position]);
+			helix.setFrozen(phys, true);
+		} else if (settings.warm_start)
+			helix.resize(phys, move.previous_bases[i], move.snapshot[move.changes[i].first].pose);
+		else
+			helix.resize(phys, move.previous_bases[i], helix.getInitialTransform());
+	}
+
+	if (isLocal()) {
+		for (relaxation::region_type::size_type i = 0; i < move.region.size(); ++i)
+			helices[move.region[i]].setTransform(move.previous_transforms[i]);
+	} else if (settings.warm_start)
+		mesh.setSnapshot(phys, move.snapshot);
+}
+
+void relaxation::replicate(scene & mesh, physics & phys, const scene & source, const combined_move_type & move) const {
+	scene::HelixContainer & helices(mesh.getHelices());
+	const scene::HelixContainer & sourceHelices(source.getHelices());
+
+	for (const std::pair<scene::HelixContainer::size_type, int> & change : move.changes) {
+		Helix & helix(helices[change.first]);
+
+		if (isLocal()) {
+			helix.setFrozen(phys, false);
+			helix.resize(phys, sourceHelices[change.first].getBaseCount(), sourceHelices[change.first].getTransform());
+			helix.setFrozen(phys, true);
+		} else if (settings.warm_start)
+			helix.resize(phys, sourceHelices[change.first].getBaseCount(), sourceHelices[change.first].getTransform());
+		else
+			helix.resize(phys, sourceHelices[change.first].getBaseCount(), helix.getInitialTransform());
+	}
+
+	if (isLocal()) {
+		for (scene::HelixContainer::size_type i : move.region)
+			helices[i].setTransform(sourceHelices[i].getTransform());
+	} else if (settings.warm_start) {
+		for (scene::HelixContainer::size_type i = 0; i < helices.size(); ++i)
+			helices[i].setState(phys, sourceHelices[i].getState(phys));
+	}
+}
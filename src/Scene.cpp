@@ -1,40 +1,99 @@
+#include <BinaryIO.h>
 #include <Definition.h>
 #include <DNA.h>
 #include <Scene.h>
+#include <Ply.h>
+#include <Profiler.h>
 #include <SimulatedAnnealing.h>
+#include <TextScanner.h>
+#include <ThreadPool.h>
 
 #include <array>
 #include <cassert>
-#include <functional>
 #include <string>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <iterator>
-#include <set>
+#include <numeric>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+
+namespace {
+	// What the lines of a part of a .rmsh file hold.
+	struct rmesh_chunk {
+		std::vector<physics::vec3_type> vertices;
+		std::vector<unsigned int> path;
+		size_t helices, groups;
+
+		inline rmesh_chunk() : helices(0), groups(0) {}
+	};
+
+	void parse_rmesh(const char *begin, const char *end, physics::real_type scaling, rmesh_chunk & chunk) {
+		physics::vec3_type vertex, zDirection;
+		unsigned int edge, numBases;
+
+		for (const char *line = begin; line != end; line = scan::next_line(line, end)) {
+			const char *it(line + 1);
+
+			switch (*line) {
+			case 'e':
+				if (scan::unsigned_integer(it, end, edge)) {
+					assert(edge >= 1);
+					chunk.path.push_back(edge - 1);
+				}
+				break;
+			case 'v':
+				if (scan::real(it, end, vertex.x) && scan::real(it, end, vertex.y) && scan::real(it, end, vertex.z))
+					chunk.vertices.push_back(vertex * scaling);
+				break;
+			case 'h':
+				// Helices can not be provided yet, so they are only counted.
+				if (scan::unsigned_integer(it, end, numBases) && scan::real(it, end, vertex.x) && scan::real(it, end, vertex.y) && scan::real(it, end, vertex.z)
+						&& scan::real(it, end, zDirection.x) && scan::real(it, end, zDirection.y) && scan::real(it, end, zDirection.z))
+					++chunk.helices;
+				break;
+			case 'g':
+				++chunk.groups;
+				break;
+			}
+		}
+	}
+}
 
 bool scene::read_rmesh(physics & phys, std::istream & ifile) {
-	physics::vec3_type vertex, zDirection;
-	unsigned int edge, numBases;
-	unsigned int gcount(0);
-	std::string line;
-
-	while (ifile.good()) {
-		std::getline(ifile, line);
-
-		if (sscanf(line.c_str(), "e %u", &edge) == 1) {
-			assert(edge >= 1);
-			path.push_back(edge - 1);
-		} else if (sscanf(line.c_str(), "v %f %f %f", &vertex.x, &vertex.y, &vertex.z) == 3) {
-			vertex *= settings.initial_scaling;
-			vertices.push_back(vertex);
-		} else if (sscanf(line.c_str(), "h %u %f %f %f %f %f %f", &numBases, &vertex.x, &vertex.y, &vertex.z, &zDirection.x, &zDirection.y, &zDirection.z) == 7) {
-			const physics::vec3_type cross(kPosZAxis.cross(zDirection));
-			helices.push_back(Helix(helix_settings, phys, numBases, physics::transform_type(vertex, physics::quaternion_type(signedAngle(kPosZAxis, zDirection, cross), cross.getNormalized()))));
-		} else if (line[0] == 'g')
-			++gcount;
+	const std::string contents((std::istreambuf_iterator<char>(ifile)), std::istreambuf_iterator<char>());
+	return read_rmesh(phys, contents.data(), contents.data() + contents.size());
+}
+
+bool scene::read_rmesh(physics & phys, const char *begin, const char *end) {
+	static const size_t kMinChunkSize(1 << 22);
+	profiler::scoped_timer timer(profiler::kParse);
+
+	// Chunks start at line breaks, and are merged in order.
+	const size_t length(end - begin);
+	const unsigned int chunkCount(static_cast<unsigned int>(std::max(size_t(1), std::min(size_t(numcpucores()), length / kMinChunkSize))));
+	std::vector<const char *> boundaries(1, begin);
+	for (unsigned int i = 1; i < chunkCount; ++i)
+		boundaries.push_back(std::max(boundaries.back(), scan::next_line(begin + length * i / chunkCount, end)));
+	boundaries.push_back(end);
+
+	std::vector<rmesh_chunk> chunks(chunkCount);
+	if (chunkCount > 1) {
+		thread_pool pool(chunkCount);
+		pool.parallel_for(chunkCount, [this, &boundaries, &chunks](unsigned int worker, size_t index) { parse_rmesh(boundaries[index], boundaries[index + 1], settings.initial_scaling, chunks[index]); });
+	} else
+		parse_rmesh(begin, end, settings.initial_scaling, chunks.front());
+
+	size_t helixCount(0), gcount(0), vertexCount(0), edgeCount(0);
+	for (const rmesh_chunk & chunk : chunks) {
+		helixCount += chunk.helices;
+		gcount += chunk.groups;
+		vertexCount += chunk.vertices.size();
+		edgeCount += chunk.path.size();
 	}
 
 	if (gcount > 1) {
@@ -42,159 +101,221 @@ bool scene::read_rmesh(physics & phys, std::istream & ifile) {
 		return false;
 	}
 
-	if ((!helices.empty() && helices.size() != path.size() - 1) || path.empty() || vertices.empty())
+	vertices.reserve(vertexCount);
+	path.reserve(edgeCount);
+	for (const rmesh_chunk & chunk : chunks) {
+		vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+		path.insert(path.end(), chunk.path.begin(), chunk.path.end());
+	}
+
+	if ((helixCount > 0 && helixCount != path.size() - 1) || path.empty() || vertices.empty())
 		return false;
 
-	if (!helices.empty()) {
+	if (helixCount > 0) {
 		PRINT("Not implemented yet! Helices can't be provided!");
 		return false;
 	}
 
-	return helices.empty() ? setupHelices(phys) : true;
+	timer.stop();
+	return setupHelices(phys);
 }
 
 bool scene::read_ply(physics & phys, std::istream & ply_file, std::istream & ntrail_file) {
-	std::string line;
-	unsigned int count(0), num_vertices(0);
-	bool has_vertex_header(false);
-	unsigned int pre_vertices_rows(0);
-	physics::vec3_type vertex;
-
-	while (ply_file.good()) {
-		std::getline(ply_file, line);
-
-		if (sscanf(line.c_str(), "element vertex %u", &num_vertices) == 1) {
-			vertices.reserve(num_vertices);
-			has_vertex_header = true;
-		} else if (sscanf(line.c_str(), "element %*s %u", &count) == 1) {
-			if (!has_vertex_header)
-				pre_vertices_rows += count;
-		} else if (line.compare(0, strlen("end_header"), "end_header") == 0) {
-			for (unsigned int i = 0; i < pre_vertices_rows; ++i)
-				std::getline(ply_file, line);
-		} else if (sscanf(line.c_str(), "%f %f %f", &vertex.x, &vertex.y, &vertex.z) == 3 && vertices.size() < num_vertices) {
-			vertex *= settings.initial_scaling;
-			vertices.push_back(vertex);
-		}
+	const std::string ply_contents((std::istreambuf_iterator<char>(ply_file)), std::istreambuf_iterator<char>());
+	const std::string ntrail_contents((std::istreambuf_iterator<char>(ntrail_file)), std::istreambuf_iterator<char>());
+	return read_ply(phys, ply_contents.data(), ply_contents.data() + ply_contents.size(), ntrail_contents.data(), ntrail_contents.data() + ntrail_contents.size());
+}
+
+bool scene::read_ply(physics & phys, const char *ply_begin, const char *ply_end, const char *ntrail_begin, const char *ntrail_end) {
+	profiler::scoped_timer timer(profiler::kParse);
+	std::vector<physics::vec3_type> positions;
+	if (!ply::read_vertices(ply_begin, ply_end, positions))
+		return false;
+
+	vertices.reserve(positions.size());
+	for (const physics::vec3_type & position : positions)
+		vertices.push_back(position * settings.initial_scaling);
+
+	unsigned int index;
+	for (const char *it = ntrail_begin; it != ntrail_end;) {
+		if (scan::unsigned_integer(it, ntrail_end, index))
+			path.push_back(index);
+		else if (scan::is_blank(*it) || *it == '\n')
+			++it;
+		else
+			break;
 	}
 
-	std::copy(std::istream_iterator<unsigned int>(ntrail_file), std::istream_iterator<unsigned int>(), std::back_inserter(path));
+	if (path.empty())
+		return false;
+
 	path.pop_back(); // Because .ntrail stores the last and the first as the same index, this is implied in the rectification algorithm.
 
+	timer.stop();
 	return setupHelices(phys);
 }
 
-std::hash<unsigned int> scene::Edge::hasher;
+scene::scene(const scene & other, physics & phys) : vertices(other.vertices), path(other.path), settings(other.settings), helix_settings(other.helix_settings), tracker(other.settings.separation_epsilon) {
+	helices.reserve(other.helices.size());
+	if (!setupHelices(phys))
+		throw std::runtime_error("Failed to replicate the scene");
+}
 
-bool scene::setupHelices(physics & phys) {
-	// Find duplicate edges.
-	std::unordered_map<Edge, int, std::function<size_t(const Edge &)>> duplicates(path.size() - 1, std::mem_fun_ref(&Edge::hash));
+namespace {
+	// An edge incident to a vertex: The edge index times two plus the end of the edge at the vertex, 0 for the start.
+	struct incidence_type {
+		physics::real_type angle; // In RADIANS!
+		unsigned int end;
 
-	for (std::vector<unsigned int>::const_iterator it(path.begin()); it != path.end(); ++it) {
-		++duplicates[Edge(*it, *circular_increment(it, path))];
-		edges.push_back(Edge(*it, *circular_increment(it, path)));
-	}	
+		inline bool operator<(const incidence_type & incidence) const { return angle < incidence.angle; }
+	};
 
-	for (std::vector<Edge>::const_iterator it(edges.begin()); it != edges.end(); ++it) {
-		for (int i = 0; i < 2; ++i)
-			vertices[it->vertices[i]].neighbor_edges.push_back(Vertex::Edge(unsigned int(std::distance(edges.cbegin(), it))));
+	inline unsigned long long edge_key(unsigned int vertex1, unsigned int vertex2) {
+		return (unsigned long long) std::min(vertex1, vertex2) << 32 | std::max(vertex1, vertex2);
 	}
+}
 
-	// Calculate vertex normal and edge angles.
-	for (std::vector<Vertex>::iterator vertex_it(vertices.begin()); vertex_it != vertices.end(); ++vertex_it) {
-		Vertex & vertex(*vertex_it);
-		const unsigned int vertexIndex(unsigned int(std::distance(vertices.begin(), vertex_it)));
-
-		vertex.normal = kZeroVec;
-		for (Vertex::NeighborContainer::const_iterator it(vertex.neighbor_edges.begin()); it != vertex.neighbor_edges.end(); ++it) {
-			const physics::vec3_type edge1(vertex.position - vertices[edges[circular_increment(it, vertex.neighbor_edges)->index].other(vertexIndex)].position);
-			const physics::vec3_type edge2(vertex.position - vertices[edges[it->index].other(vertexIndex)].position);
-			vertex.normal += edge1.getNormalized().cross(edge2.getNormalized());
-		}
+bool scene::setupHelices(physics & phys) {
+	profiler::scoped_timer timer(profiler::kSetupHelices);
 
-		vertex.normal.normalize();
+	// Edge i goes from path[i] to path[i + 1], circularly.
+	const unsigned int edgeCount(static_cast<unsigned int>(path.size())), vertexCount(static_cast<unsigned int>(vertices.size()));
+	for (unsigned int vertex : path) {
+		if (vertex >= vertexCount)
+			return false;
+	}
 
-		//std::cerr << "vertex " << vertexIndex << " position: " << vertex.position.x << ' ' << vertex.position.y << ' ' << vertex.position.z << std::endl;
+	{
+		physics::vec3_type lower(vertices.empty() ? kZeroVec : vertices.front()), upper(lower);
+		for (const physics::vec3_type & vertex : vertices) {
+			lower = lower.minimum(vertex);
+			upper = upper.maximum(vertex);
+		}
+
+		phys.prepare_scene(lower, upper, edgeCount, edgeCount * Helix::kMaxShapeCount, edgeCount * (helix_settings.attach_fixed ? 3 : 2));
+	}
 
-		physics::vec3_type tangent((vertices[edges[vertex.neighbor_edges.front().index].other(vertexIndex)].position - vertex.position).getNormalized());
-		tangent -= proj(tangent, vertex.normal);
+	const auto edge_vertex([this, edgeCount](unsigned int end) { return path[circular_index((end >> 1) + (end & 1), edgeCount)]; });
+	const auto other_vertex([&edge_vertex](unsigned int end) { return edge_vertex(end ^ 1); });
 
-		for (Vertex::Edge & edge : vertex.neighbor_edges) {
-			const physics::vec3_type delta(vertices[edges[edge.index].other(vertexIndex)].position - vertex.position);
-			//edge.angle = signedAngle(delta - proj(delta, vertex.normal), tangent, vertex.normal);
-			edge.angle = signedAngle(tangent, delta - proj(delta, vertex.normal), vertex.normal);
+	// Find duplicate edges by sorting them by their vertices.
+	std::vector<unsigned int> multiplicity(edgeCount);
+	{
+		std::vector< std::pair<unsigned long long, unsigned int> > keys(edgeCount);
+		for (unsigned int i = 0; i < edgeCount; ++i)
+			keys[i] = std::make_pair(edge_key(edge_vertex(i * 2), edge_vertex(i * 2 + 1)), i);
+		std::sort(keys.begin(), keys.end());
+
+		for (unsigned int first = 0, last; first < edgeCount; first = last) {
+			for (last = first + 1; last < edgeCount && keys[last].first == keys[first].first; ++last);
+			for (unsigned int i = first; i < last; ++i)
+				multiplicity[keys[i].second] = last - first;
 		}
 	}
 
-	// Correct angles for edges visited multiple times.
-	for (std::vector<unsigned int>::const_iterator it(path.begin()); it != path.end(); ++it) {
-		const std::vector<unsigned int>::const_iterator next_it(circular_increment(it, path));
-		const Edge edge(*it, *next_it);
-		const unsigned int it_offset(unsigned int(std::distance(path.cbegin(), it)));
-		assert(duplicates[edge] >= 1);
-
-		if (duplicates[edge] > 1) {
-			Vertex *vertices_[] = { &vertices[edge.vertices[0]], &vertices[edge.vertices[1]] };
+	// The incident edges of vertex v are incidences[offsets[v]] to incidences[offsets[v + 1]], in path order until sorted by angle.
+	std::vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (unsigned int end = 0; end < edgeCount * 2; ++end)
+		++offsets[edge_vertex(end) + 1];
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
 
-			const physics::vec3_type direction(vertices_[1]->position - vertices_[0]->position);
+	std::vector<incidence_type> incidences(edgeCount * 2);
+	std::vector<unsigned int> slots(edgeCount * 2); // Of every end in incidences.
+	{
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (unsigned int end = 0; end < edgeCount * 2; ++end) {
+			slots[end] = fill[edge_vertex(end)]++;
+			incidences[slots[end]].end = end;
+		}
+	}
 
-			const unsigned int connecting_vertex_indices[] = { *circular_increment(next_it, path), *circular_decrement(it, path) };
+	// Calculate vertex normal and edge angles.
+	std::vector<physics::vec3_type> normals(vertexCount, kZeroVec);
+	for (unsigned int vertex = 0; vertex < vertexCount; ++vertex) {
+		const unsigned int begin(offsets[vertex]), end(offsets[vertex + 1]);
+		if (begin == end)
+			continue;
+
+		physics::vec3_type & normal(normals[vertex]);
+		for (unsigned int i = begin; i < end; ++i) {
+			const physics::vec3_type edge1(vertices[vertex] - vertices[other_vertex(incidences[i + 1 == end ? begin : i + 1].end)]);
+			const physics::vec3_type edge2(vertices[vertex] - vertices[other_vertex(incidences[i].end)]);
+			normal += edge1.getNormalized().cross(edge2.getNormalized());
+		}
 
-			physics::vec3_type tangent(kZeroVec);
-			for (int i = 0; i < 2; ++i) {
-				if (connecting_vertex_indices[i] != edge.vertices[i]) {
-					const physics::vec3_type upcoming_direction(vertices[connecting_vertex_indices[i]].position - vertices_[i ^ 1]->position);
-					tangent += upcoming_direction - proj(upcoming_direction, direction);
-				}
-			}
+		normal.normalize();
 
-			const Vertex::NeighborContainer::iterator neighbor_edge_it(std::find(vertices_[0]->neighbor_edges.begin(), vertices_[0]->neighbor_edges.end(), it_offset));
-			assert(neighbor_edge_it != vertices_[0]->neighbor_edges.end());
+		physics::vec3_type tangent((vertices[other_vertex(incidences[begin].end)] - vertices[vertex]).getNormalized());
+		tangent -= proj(tangent, normal);
 
-			//neighbor_edge_it->angle += sgn_nozero(direction.cross(vertices_[0]->normal).dot(tangent)) * physics::real_type(ANGLE_EPSILON);
-			neighbor_edge_it->angle -= sgn_nozero(direction.cross(vertices_[0]->normal).dot(tangent)) * physics::real_type(ANGLE_EPSILON);
+		for (unsigned int i = begin; i < end; ++i) {
+			const physics::vec3_type delta(vertices[other_vertex(incidences[i].end)] - vertices[vertex]);
+			incidences[i].angle = signedAngle(tangent, delta - proj(delta, normal), normal);
 		}
 	}
 
-	// Validate angles for debugging
-	for (const Edge & edge : edges) {
-		const Vertex & vertex(vertices[edge.vertices[1]]);
-		for (Vertex::NeighborContainer::const_iterator nit(vertex.neighbor_edges.begin()); nit != vertex.neighbor_edges.end() - 1; ++nit) {
-			if (nit->angle == (nit + 1)->angle)
-				PRINT("Angles are the same for edges %u and %u at vertex %u leading to vertices %u and %u. Vertex normal: %f, %f, %f", 1 + nit->index, 1 + (nit + 1)->index, 1 + edge.vertices[1], 1 + edges[nit->index].other(edge.vertices[1]), 1 + edges[(nit + 1)->index].other(edge.vertices[1]), vertices[edge.vertices[1]].normal.x, vertices[edge.vertices[1]].normal.y, vertices[edge.vertices[1]].normal.z);
-			assert(nit->angle != (nit + 1)->angle);
-		}
-	}
+	// The vertices connected to the ends of the neighboring edges along the path, used to offset duplicate edges.
+	const auto connecting_vertex([this, edgeCount](unsigned int edge, int i) { return path[i == 0 ? circular_index(edge + 2, edgeCount) : circular_index(int(edge) - 1, int(edgeCount))]; });
 
-	for (const Vertex & vertex : vertices)
-		assert(vertex.neighbor_edges.size() % 2 == 0);
+	// Correct angles for edges visited multiple times.
+	for (unsigned int edge = 0; edge < edgeCount; ++edge) {
+		if (multiplicity[edge] == 1)
+			continue;
 
-	// Sort edges by angle and create the edge lookup.
-	std::for_each(vertices.begin(), vertices.end(), std::mem_fun_ref(&Vertex::generate_lookup));
+		const unsigned int edge_vertices[] = { edge_vertex(edge * 2), edge_vertex(edge * 2 + 1) };
+		const physics::vec3_type direction(vertices[edge_vertices[1]] - vertices[edge_vertices[0]]);
+
+		physics::vec3_type tangent(kZeroVec);
+		for (int i = 0; i < 2; ++i) {
+			if (connecting_vertex(edge, i) != edge_vertices[i]) {
+				const physics::vec3_type upcoming_direction(vertices[connecting_vertex(edge, i)] - vertices[edge_vertices[i ^ 1]]);
+				tangent += upcoming_direction - proj(upcoming_direction, direction);
+			}
+		}
 
-	for (std::vector<unsigned int>::const_iterator it(path.begin()); it != path.end(); ++it) {
-		const std::vector<unsigned int>::const_iterator next_it(circular_increment(it, path));
-		const Edge edge(*it, *next_it);
-		Vertex *vertices_[] = { &vertices[edge.vertices[0]], &vertices[edge.vertices[1]] };
-		const Vertex::NeighborContainer::iterator neighbor_edge_it(std::find_if(vertices_[0]->neighbor_edges.begin(), vertices_[0]->neighbor_edges.end(), [this, &edge](const Vertex::Edge & vertex_edge) { return edges[vertex_edge.index].other(edge.vertices[0]) == edge.vertices[1]; }));
-		assert(neighbor_edge_it != vertices_[0]->neighbor_edges.end());
+		incidences[slots[edge * 2]].angle -= sgn_nozero(direction.cross(normals[edge_vertices[0]]).dot(tangent)) * physics::real_type(ANGLE_EPSILON);
+	}
 
-		const physics::vec3_type origo((vertices_[0]->position + vertices_[1]->position) / 2), direction(vertices_[1]->position - vertices_[0]->position);
+	// Sort edges by angle, and count the unique neighbors of every vertex.
+	std::vector<unsigned int> unique_neighbors(vertexCount);
+	{
+		std::vector<unsigned int> neighbors;
+		for (unsigned int vertex = 0; vertex < vertexCount; ++vertex) {
+			const unsigned int begin(offsets[vertex]), end(offsets[vertex + 1]);
+			assert((end - begin) % 2 == 0);
+
+			std::sort(incidences.begin() + begin, incidences.begin() + end);
+
+			neighbors.clear();
+			for (unsigned int i = begin; i < end; ++i) {
+				slots[incidences[i].end] = i;
+				neighbors.push_back(other_vertex(incidences[i].end));
+
+				// Validate angles for debugging
+				if (i + 1 < end) {
+					if (incidences[i].angle == incidences[i + 1].angle)
+						PRINT("Angles are the same for edges %u and %u at vertex %u leading to vertices %u and %u. Vertex normal: %f, %f, %f", 1 + (incidences[i].end >> 1), 1 + (incidences[i + 1].end >> 1), 1 + vertex, 1 + other_vertex(incidences[i].end), 1 + other_vertex(incidences[i + 1].end), normals[vertex].x, normals[vertex].y, normals[vertex].z);
+					assert(incidences[i].angle != incidences[i + 1].angle);
+				}
+			}
 
-		std::set<unsigned int> vertices_unique_neighbors[2];
-		for (int i = 0; i < 2; ++i) {
-			for (const Vertex::Edge & vertex_edge : vertices_[i]->neighbor_edges)
-				vertices_unique_neighbors[i].insert(edges[vertex_edge.index].other(edge.vertices[i]));
+			std::sort(neighbors.begin(), neighbors.end());
+			unique_neighbors[vertex] = static_cast<unsigned int>(std::unique(neighbors.begin(), neighbors.end()) - neighbors.begin());
 		}
+	}
+
+	helices.reserve(edgeCount);
+	for (unsigned int edge = 0; edge < edgeCount; ++edge) {
+		const unsigned int edge_vertices[] = { edge_vertex(edge * 2), edge_vertex(edge * 2 + 1) };
+		const physics::vec3_type origo((vertices[edge_vertices[0]] + vertices[edge_vertices[1]]) / 2), direction(vertices[edge_vertices[1]] - vertices[edge_vertices[0]]);
 
 		physics::vec3_type tangent(kZeroVec);
-		const unsigned int connecting_vertex_indices[] = { *circular_increment(next_it, path), *circular_decrement(it, path) };
 		bool cross(false);
 
-		if (duplicates[edge] > 1) {
+		if (multiplicity[edge] > 1) {
 			for (int i = 0; i < 2; ++i) {
-				if (connecting_vertex_indices[i] != edge.vertices[i]) {
-					const physics::vec3_type upcoming_direction(vertices[connecting_vertex_indices[i]].position - vertices_[i ^ 1]->position);
+				if (connecting_vertex(edge, i) != edge_vertices[i]) {
+					const physics::vec3_type upcoming_direction(vertices[connecting_vertex(edge, i)] - vertices[edge_vertices[i ^ 1]]);
 					tangent += upcoming_direction - proj(upcoming_direction, direction);
 				} else
 					cross = true;
@@ -202,9 +323,9 @@ bool scene::setupHelices(physics & phys) {
 
 			tangent.normalize();
 		} else
-			cross = (vertices[connecting_vertex_indices[0]].position - vertices_[1]->position).dot(vertices[connecting_vertex_indices[1]].position - vertices_[0]->position) < 0;
+			cross = (vertices[connecting_vertex(edge, 0)] - vertices[edge_vertices[1]]).dot(vertices[connecting_vertex(edge, 1)] - vertices[edge_vertices[0]]) < 0;
 
-		double length(direction.magnitude() - apothem(2 * DNA::RADIUS, vertices_unique_neighbors[0].size()) - apothem(2 * DNA::RADIUS, vertices_unique_neighbors[1].size()));
+		double length(direction.magnitude() - apothem(2 * DNA::RADIUS, unique_neighbors[edge_vertices[0]]) - apothem(2 * DNA::RADIUS, unique_neighbors[edge_vertices[1]]));
 
 		if (settings.discretize_lengths) {
 			const double num_half_turns(length / DNA::HALF_TURN_LENGTH);
@@ -217,86 +338,68 @@ bool scene::setupHelices(physics & phys) {
 		helices.emplace_back(
 			helix_settings,
 			phys, DNA::DistanceToBaseCount(length),
-			physics::transform_type((origo + tangent * physics::real_type((duplicates[edge] - 1) * (DNA::RADIUS + DNA::SPHERE_RADIUS))), rotationFromTo(kPosZAxis, direction)));
+			physics::transform_type((origo + tangent * physics::real_type((multiplicity[edge] - 1) * (DNA::RADIUS + DNA::SPHERE_RADIUS))), rotationFromTo(kPosZAxis, direction)));
+		phys.set_collision_vertices(*helices.back().getRigidBody(), edge_vertices[0], edge_vertices[1]);
 	}
 
 	// Connect the scaffold.
 	for (HelixContainer::iterator it(helices.begin()); it != helices.end(); ++it)
 		circular_decrement(it, helices)->attach(phys, *it, Helix::kForwardThreePrime, Helix::kForwardFivePrime);
 
-	// Connect the staples.
-
-	for (std::vector<Edge>::const_iterator it(edges.begin()); it != edges.end(); ++it) {
-		const Vertex & vertex(vertices[it->vertices[1]]);
-		const unsigned int it_offset(unsigned int(std::distance(edges.cbegin(), it)));
-		const unsigned int next_it_offset(unsigned int(circular_index(it_offset + 1, edges.size())));
-		const Vertex::NeighborContainer::const_iterator edge_it(vertex.edges_lookup.at(it_offset));
-		const Vertex::NeighborContainer::const_iterator next_edge_it(vertex.edges_lookup.at(next_it_offset));
-		assert(edge_it != vertex.neighbor_edges.end() && next_edge_it != vertex.neighbor_edges.end());
-
-		for (Vertex::NeighborContainer::const_iterator nit(vertex.neighbor_edges.begin()); nit != vertex.neighbor_edges.end() - 1; ++nit) {
-			if (nit->angle == (nit + 1)->angle)
-				PRINT("Angles are the same for edges %u and %u at vertex %u leading to vertices %u and %u. Vertex normal: %f, %f, %f", 1 + nit->index, 1 + (nit + 1)->index, 1 + it->vertices[1], 1 + edges[nit->index].other(it->vertices[1]), 1 + edges[(nit + 1)->index].other(it->vertices[1]), vertices[it->vertices[1]].normal.x, vertices[it->vertices[1]].normal.y, vertices[it->vertices[1]].normal.z);
-			assert(nit->angle != (nit + 1)->angle);
-		}
+	// Connect the staples: At the vertex between an edge and the next, the staple continues on the edge on the other side of the edge than the next.
+	for (unsigned int edge = 0; edge < edgeCount; ++edge) {
+		const unsigned int vertex(edge_vertex(edge * 2 + 1));
+		const unsigned int begin(offsets[vertex]), degree(offsets[vertex + 1] - offsets[vertex]);
+		const int edge_offset(int(slots[edge * 2 + 1] - begin)), next_edge_offset(int(slots[circular_index(edge + 1, edgeCount) * 2] - begin));
 
-		const int delta(int(next_edge_it - edge_it));
-		assert(std::abs(delta) == 1 || std::abs(delta) == int(vertex.neighbor_edges.size() - 1));
-		const ptrdiff_t edge_it_offset(std::distance(vertex.neighbor_edges.cbegin(), edge_it));
-		const size_t staple_edge(circular_index(edge_it_offset + sgn_nozero(delta) * ((std::abs(delta) > 1) * 2 - 1), vertex.neighbor_edges.size()));
-		
-		assert(unsigned int((edge_it_offset + vertex.neighbor_edges.size() + sgn_nozero(delta) * ((std::abs(delta) > 1) * 2 - 1)) % vertex.neighbor_edges.size()) == staple_edge);
+		const int delta(next_edge_offset - edge_offset);
+		assert(std::abs(delta) == 1 || std::abs(delta) == int(degree - 1));
+		const unsigned int staple_edge(static_cast<unsigned int>(circular_index(edge_offset + sgn_nozero(delta) * ((std::abs(delta) > 1) * 2 - 1), int(degree))));
 
-		helices[it_offset].attach(phys, helices[(vertex.neighbor_edges.begin() + staple_edge)->index], Helix::kBackwardFivePrime, Helix::kBackwardThreePrime);
+		helices[edge].attach(phys, helices[incidences[begin + staple_edge].end >> 1], Helix::kBackwardFivePrime, Helix::kBackwardThreePrime);
 	}
 
-	/*for (std::vector<Edge>::const_iterator prev_it(edges.begin()); prev_it != edges.end(); ++prev_it) {
-		const Vertex & vertex(vertices[prev_it->vertices[1]]);
-
-		const size_t prev_it_offset(std::distance(edges.cbegin(), prev_it));
-		const std::vector<Edge>::const_iterator next_it(circular_increment(prev_it, edges));
-		const size_t next_it_offset(std::distance(edges.cbegin(), next_it));
+	return true;
+}
 
-		const Vertex::NeighborContainer::const_iterator prev_edge_it(vertex.edges_lookup.at(unsigned int(prev_it_offset)));
-		const Vertex::NeighborContainer::const_iterator next_edge_it(vertex.edges_lookup.at(unsigned int(next_it_offset)));
+void scene::getNeighborhood(HelixContainer::size_type helix, unsigned int hops, std::vector<HelixContainer::size_type> & neighborhood) const {
+	neighborhood.clear();
+	neighborhood.push_back(helix);
 
-		const ptrdiff_t delta(next_edge_it - prev_edge_it);
-		assert(std::abs(delta) == 1 || size_t(std::abs(delta)) == vertex.neighbor_edges.size() - 1);
+	std::unordered_set<HelixContainer::size_type> visited;
+	visited.insert(helix);
 
-		if (std::abs(delta) == 1) {
-			helices[prev_it_offset].attach(phys, helices[prev_it_offset - delta], Helix::kBackwardFivePrime, Helix::kBackwardThreePrime);
-		}
-	}*/
+	// Every pass over the previous ring adds the helices one more joint away.
+	std::vector<HelixContainer::size_type>::size_type ring_begin(0);
+	for (unsigned int hop = 0; hop < hops; ++hop) {
+		const std::vector<HelixContainer::size_type>::size_type ring_end(neighborhood.size());
 
-	return true;
-}
+		for (std::vector<HelixContainer::size_type>::size_type i = ring_begin; i < ring_end; ++i) {
+			for (const Helix::Connection & connection : helices[neighborhood[i]].getJoints()) {
+				if (!connection)
+					continue;
 
-void scene::getTotalSeparationMinMaxAverage(physics::real_type & min, physics::real_type & max, physics::real_type & average, physics::real_type & total) const {
-	min = std::numeric_limits<physics::real_type>::infinity();
-	max = physics::real_type(0);
-	total = physics::real_type(0);
-	size_t helix_offset = 0; // DEBUG
-	for (const Helix & helix : helices) {
-		const Helix::ConnectionContainer & connections(helix.getJoints());
-		size_t connection_offset = 0; // DEBUG
-		for (const Helix::Connection & connection : connections) {
-			if (connection.joint == nullptr) { // DEBUG ONLY
-				PRINT("WARNING: Joint is null, should not happen! connection: %u, helix: %u", connection_offset, helix_offset);
-				continue;
+				const HelixContainer::size_type index(HelixContainer::size_type(connection.helix - &helices.front()));
+				if (visited.insert(index).second)
+					neighborhood.push_back(index);
 			}
-			const physics::real_type separation(connection.joint->getDistance());
-			min = std::min(min, separation);
-			max = std::max(max, separation);
-			total += separation;
-
-			connection_offset++; // DEBUG
 		}
 
-		helix_offset++; // DEBUG
+		if (ring_end == neighborhood.size())
+			break;
+
+		ring_begin = ring_end;
 	}
+}
 
-	average = total / (helices.size() * 4);
-	total /= 2;
+void scene::getTotalSeparationMinMaxAverage(physics::real_type & min, physics::real_type & max, physics::real_type & average, physics::real_type & total) const {
+	profiler::scoped_timer timer(profiler::kEnergy);
+	tracker.update(helices);
+
+	min = tracker.getMin();
+	max = tracker.getMax();
+	total = tracker.getTotal();
+	average = total * 2 / (helices.size() * 4); // Every helix has four springs, each shared by two helices.
 }
 
 SceneDescription::SceneDescription(scene & scene) : totalSeparation(scene.getTotalSeparation()) {
@@ -316,34 +419,154 @@ SceneDescription::SceneDescription(scene & scene) : totalSeparation(scene.getTot
 	}
 }
 
-bool SceneDescription::write(std::ostream & out) const {
-	std::unordered_map<const Helix *, std::string> helixNames;
-	helixNames.reserve(helices.size());
+SceneDescription::SceneDescription(const SceneDescription & scene) : totalSeparation(scene.totalSeparation), helices(scene.helices) {
+	for (Helix & helix : helices) {
+		for (int i = 0; i < 4; ++i)
+			helix.connections[i] = &helices[helix.connections[i] - &scene.helices.front()];
+	}
+}
 
-	{
-		unsigned int i(1);
-		for (const Helix & helix : helices) {
-			std::ostringstream namestream;
-			namestream << "helix_" << i++;
-			const std::string name(namestream.str());
-			helixNames.emplace(&helix, name);
-
-			const physics::vec3_type & position(helix.getPosition());
-			const physics::quaternion_type & orientation(helix.getOrientation());
-			out << "hb " << name << ' ' << helix.baseCount << ' ' << position.x << ' ' << position.y << ' ' << position.z << ' ' << orientation.x << ' ' << orientation.y << ' ' << orientation.z << ' ' << orientation.w << std::endl;
+namespace {
+	// Appends text to a buffer written out in one go, instead of formatting every value through a stream.
+	class text_buffer {
+	public:
+		inline explicit text_buffer(size_t capacity) {
+			buffer.reserve(capacity);
 		}
+
+		inline text_buffer & operator<<(const char *str) {
+			buffer.append(str);
+			return *this;
+		}
+
+		inline text_buffer & operator<<(char c) {
+			buffer.push_back(c);
+			return *this;
+		}
+
+		inline text_buffer & operator<<(unsigned int value) {
+			char digits[16];
+			char *it(digits + sizeof(digits));
+			do {
+				*--it = char('0' + value % 10);
+				value /= 10;
+			} while (value > 0);
+
+			buffer.append(it, digits + sizeof(digits));
+			return *this;
+		}
+
+		// Formatted as the default of std::ostream, six significant digits.
+		inline text_buffer & operator<<(physics::real_type value) {
+			char digits[32];
+			const int length(snprintf(digits, sizeof(digits), "%g", double(value)));
+			buffer.append(digits, size_t(std::max(0, length)));
+			return *this;
+		}
+
+		inline bool write(std::ostream & out) const {
+			out.write(buffer.data(), buffer.size());
+			return bool(out);
+		}
+
+	private:
+		std::string buffer;
+	};
+
+	const char kBinaryMagic[6] = { 'R', 'P', 'O', 'L', 'Y', 'B' };
+	const uint16_t kBinaryVersion(1);
+}
+
+bool SceneDescription::write(std::ostream & out) const {
+	if (helices.empty())
+		return false;
+
+	const Helix *first(&helices.front());
+	text_buffer buffer(helices.size() * 192);
+
+	for (const Helix & helix : helices) {
+		const physics::vec3_type & position(helix.getPosition());
+		const physics::quaternion_type & orientation(helix.getOrientation());
+		buffer << "hb helix_" << static_cast<unsigned int>(&helix - first + 1) << ' ' << helix.baseCount << ' ' << position.x << ' ' << position.y << ' ' << position.z << ' ' << orientation.x << ' ' << orientation.y << ' ' << orientation.z << ' ' << orientation.w << '\n';
 	}
 
-	out << std::endl;
+	buffer << '\n';
 
 	for (const Helix & helix : helices) {
-		const std::string & name(helixNames.at(&helix));
+		const unsigned int name(static_cast<unsigned int>(&helix - first + 1));
+
+		buffer << "c helix_" << name << " f3' helix_" << static_cast<unsigned int>(helix.connections[::Helix::kForwardThreePrime] - first + 1) << " f5'\n"
+			<< "c helix_" << static_cast<unsigned int>(helix.connections[::Helix::kBackwardFivePrime] - first + 1) << " b3' helix_" << name << " b5'\n";
+	}
+
+	buffer << "\nautostaple\nps helix_" << 1u << " f3'\n";
+
+	return buffer.write(out) && bool(out.flush());
+}
+
+bool SceneDescription::write_binary(std::ostream & out) const {
+	const Helix *first(helices.empty() ? NULL : &helices.front());
+	std::string buffer;
+	buffer.reserve(12 + helices.size() * 48);
+
+	buffer.append(kBinaryMagic, sizeof(kBinaryMagic));
+	binary::put(buffer, kBinaryVersion);
+	binary::put(buffer, uint32_t(helices.size()));
+
+	for (const Helix & helix : helices) {
+		binary::put(buffer, uint32_t(helix.baseCount));
+
+		const physics::vec3_type & position(helix.getPosition());
+		const physics::quaternion_type & orientation(helix.getOrientation());
+		const float values[] = { position.x, position.y, position.z, orientation.x, orientation.y, orientation.z, orientation.w };
+		for (float value : values)
+			binary::put_float(buffer, value);
+
+		for (const Helix *connection : helix.connections)
+			binary::put(buffer, uint32_t(connection - first));
+	}
+
+	out.write(buffer.data(), buffer.size());
+	return bool(out.flush());
+}
+
+bool SceneDescription::read_binary(std::istream & in) {
+	char magic[sizeof(kBinaryMagic)];
+	uint16_t version;
+	uint32_t count;
+
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, kBinaryMagic, sizeof(magic)) != 0 || !binary::get(in, version) || version != kBinaryVersion || !binary::get(in, count))
+		return false;
+
+	helices.clear();
+	helices.reserve(count);
+	std::vector<std::array<uint32_t, 4>> connections(count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t baseCount;
+		float values[7];
 
-		out << "c " << name << " f3' " << helixNames.at(helix.connections[::Helix::kForwardThreePrime]) << " f5'" << std::endl
-			<< "c " << helixNames.at(helix.connections[::Helix::kBackwardFivePrime]) << " b3' " << name << " b5'" << std::endl;
+		if (!binary::get(in, baseCount))
+			return false;
+
+		for (float & value : values) {
+			if (!binary::get_float(in, value))
+				return false;
+		}
+
+		for (uint32_t & connection : connections[i]) {
+			if (!binary::get(in, connection) || connection >= count)
+				return false;
+		}
+
+		helices.push_back(Helix(baseCount, physics::transform_type(physics::vec3_type(values[0], values[1], values[2]), physics::quaternion_type(values[3], values[4], values[5], values[6]))));
 	}
 
-	out << std::endl << "autostaple" << std::endl << "ps " << helixNames.at(&helices.front()) << " f3'" << std::endl;
+	for (uint32_t i = 0; i < count; ++i) {
+		for (int j = 0; j < 4; ++j)
+			helices[i].connections[j] = &helices[connections[i][j]];
+	}
 
+	totalSeparation = 0; // Not stored.
 	return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,159 @@
+#include <SeparationTracker.h>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+void separation_tracker::update(const std::vector<Helix> & helices) {
+	if (helices.size() != states.size() || (!helices.empty() && &helices.front() != base)) {
+		rebuild(helices);
+		return;
+	}
+
+	dirty.clear();
+
+	for (std::vector<Helix>::size_type i = 0; i < helices.size(); ++i) {
+		const Helix & helix(helices[i]);
+		helix_state & state(states[i]);
+		const physics::transform_type pose(helix.getTransform());
+
+		if (helix.getRigidBody() != state.rigid_body || helix.getBaseCount() != state.bases) {
+			for (int j = 0; j < 4; ++j) {
+				if (helix.getJoint(Helix::AttachmentPoint(j)).joint != state.joints[j]) {
+					// The rigid body and its springs were recreated.
+					rebuild(helices);
+					return;
+				}
+			}
+
+			state.rigid_body = helix.getRigidBody();
+			state.bases = helix.getBaseCount();
+			measure_reach(helix, state);
+		} else {
+			// An attachment point at distance r from the origin moves by at most |dp| + 2 r |imaginary part of the relative rotation|.
+			const physics::quaternion_type rotation(state.pose.q.getConjugate() * pose.q);
+			const physics::real_type displacement((pose.p - state.pose.p).magnitude() + 2 * state.reach * physics::vec3_type(rotation.x, rotation.y, rotation.z).magnitude());
+
+			if (displacement <= epsilon)
+				continue;
+		}
+
+		state.pose = pose;
+
+		for (unsigned int j = spring_offsets[i]; j < spring_offsets[i + 1]; ++j) {
+			const unsigned int spring(spring_indices[j]);
+			if (!marked[spring]) {
+				marked[spring] = 1;
+				dirty.push_back(spring);
+			}
+		}
+	}
+
+	for (unsigned int spring : dirty) {
+		const physics::real_type separation(physics::get_spring_distance(*springs[spring]));
+		sum += double(separation) - double(separations[spring]);
+		separations[spring] = separation;
+		min_tree[leaves + spring] = max_tree[leaves + spring] = separation;
+		marked[spring] = 0;
+	}
+
+	// Walking up from every leaf costs more than recomputing the trees once many springs changed, as during a global relaxation.
+	size_t depth(0);
+	while ((size_t(1) << depth) < leaves)
+		++depth;
+
+	if (dirty.size() * depth >= leaves)
+		update_trees();
+	else
+		update_trees(dirty);
+}
+
+void separation_tracker::rebuild(const std::vector<Helix> & helices) {
+	base = helices.empty() ? NULL : &helices.front();
+	states.resize(helices.size());
+	springs.clear();
+	spring_offsets.assign(1, 0);
+	spring_indices.clear();
+
+	std::unordered_map<const physics::spring_joint_type *, unsigned int> indices;
+
+	for (std::vector<Helix>::size_type i = 0; i < helices.size(); ++i) {
+		const Helix & helix(helices[i]);
+		helix_state & state(states[i]);
+
+		state.rigid_body = helix.getRigidBody();
+		state.bases = helix.getBaseCount();
+		state.pose = helix.getTransform();
+
+		for (int j = 0; j < 4; ++j) {
+			const Helix::Connection & connection(helix.getJoint(Helix::AttachmentPoint(j)));
+			state.joints[j] = connection.joint;
+
+			if (!connection)
+				continue;
+
+			const auto it(indices.insert(std::make_pair(connection.joint, static_cast<unsigned int>(springs.size()))));
+			if (it.second)
+				springs.push_back(connection.joint);
+
+			spring_indices.push_back(it.first->second);
+		}
+
+		spring_offsets.push_back(static_cast<unsigned int>(spring_indices.size()));
+		measure_reach(helix, state);
+	}
+
+	leaves = 1;
+	while (leaves < springs.size())
+		leaves *= 2;
+
+	separations.resize(springs.size());
+	min_tree.assign(2 * leaves, std::numeric_limits<physics::real_type>::infinity());
+	max_tree.assign(2 * leaves, physics::real_type(0));
+	marked.assign(springs.size(), 0);
+
+	sum = 0;
+	for (std::vector<physics::spring_joint_type *>::size_type i = 0; i < springs.size(); ++i) {
+		separations[i] = physics::get_spring_distance(*springs[i]);
+		sum += separations[i];
+		min_tree[leaves + i] = max_tree[leaves + i] = separations[i];
+	}
+
+	update_trees();
+}
+
+void separation_tracker::measure_reach(const Helix & helix, helix_state & state) const {
+	state.reach = 0;
+
+	for (int j = 0; j < 4; ++j) {
+		const Helix::Connection & connection(helix.getJoint(Helix::AttachmentPoint(j)));
+		if (!connection)
+			continue;
+
+		physics::rigid_body_type *rigid_bodies[2];
+		physics::transform_type frames[2];
+		physics::get_spring_joint_frames(*connection.joint, rigid_bodies, frames);
+		state.reach = std::max(state.reach, frames[rigid_bodies[0] == helix.getRigidBody() ? 0 : 1].p.magnitude());
+	}
+}
+
+void separation_tracker::update_trees() {
+	for (size_t i = leaves - 1; i > 0; --i) {
+		min_tree[i] = std::min(min_tree[2 * i], min_tree[2 * i + 1]);
+		max_tree[i] = std::max(max_tree[2 * i], max_tree[2 * i + 1]);
+	}
+
+	// A good moment to get rid of the rounding errors accumulated by the running sum.
+	sum = 0;
+	for (physics::real_type separation : separations)
+		sum += separation;
+}
+
+void separation_tracker::update_trees(const std::vector<unsigned int> & springs) {
+	for (unsigned int spring : springs) {
+		for (size_t i = (leaves + spring) / 2; i > 0; i /= 2) {
+			min_tree[i] = std::min(min_tree[2 * i], min_tree[2 * i + 1]);
+			max_tree[i] = std::max(max_tree[2 * i], max_tree[2 * i + 1]);
+		}
+	}
+}
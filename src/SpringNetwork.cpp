@@ -0,0 +1,697 @@
+#include <SpringNetwork.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <type_traits>
+#include <unordered_map>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace {
+	typedef physics::real_type real_type;
+
+	const real_type kLinearDamping(0), kAngularDamping(real_type(0.05)); // The PhysX defaults.
+	const real_type kWakeTime(real_type(0.4)); // Time below the sleep threshold before a body falls asleep, the PhysX default.
+	const real_type kMaxAngularVelocity(7); // Also the PhysX default. Keeps light helices on stiff springs from spinning up within a step.
+
+	const size_t kParallelThreshold(4096), kChunkSize(1024);
+
+	const size_t kHistory(8); // L-BFGS correction pairs.
+	const double kMaxDisplacement(1); // Largest translation (nm) or rotation (radians) of a single iteration, keeps the line search local.
+	const double kInitialDisplacement(0.1); // The same for the first iteration, which has no curvature information yet.
+	const double kArmijo(1e-4);
+	const double kStall(1e-9); // Relative decrease of the energy below which single precision poses can not make any real progress.
+	const double kStallGradient(1e-2); // Largest force or torque relative to the force scale of the network, below which a stall is taken for the minimum.
+	const unsigned int kMaxBacktracks(30);
+
+	inline double dot(const std::vector<double> & a, const std::vector<double> & b) {
+		double sum(0);
+		for (size_t i = 0; i < a.size(); ++i)
+			sum += a[i] * b[i];
+		return sum;
+	}
+
+	// Rotates (x, y, z) by the quaternion (qx, qy, qz, qw).
+	inline void rotate(real_type qx, real_type qy, real_type qz, real_type qw, real_type & x, real_type & y, real_type & z) {
+		const real_type tx(2 * (qy * z - qz * y)), ty(2 * (qz * x - qx * z)), tz(2 * (qx * y - qy * x));
+		const real_type rx(x + qw * tx + (qy * tz - qz * ty)), ry(y + qw * ty + (qz * tx - qx * tz)), rz(z + qw * tz + (qx * ty - qy * tx));
+		x = rx;
+		y = ry;
+		z = rz;
+	}
+
+	inline void rotate_inverse(real_type qx, real_type qy, real_type qz, real_type qw, real_type & x, real_type & y, real_type & z) {
+		rotate(-qx, -qy, -qz, qw, x, y, z);
+	}
+
+	inline real_type clamp01(real_type value) {
+		return std::min(real_type(1), std::max(real_type(0), value));
+	}
+
+	/*
+	 * Closest points of the segments p1 + s * d1 and p2 + t * d2, s and t in [0, 1]. From Ericson, Real-Time Collision Detection.
+	 */
+	inline void closest_points(const physics::vec3_type & p1, const physics::vec3_type & d1, const physics::vec3_type & p2, const physics::vec3_type & d2, physics::vec3_type & c1, physics::vec3_type & c2) {
+		const real_type kEpsilon(real_type(1e-12));
+		const physics::vec3_type r(p1 - p2);
+		const real_type a(d1.dot(d1)), e(d2.dot(d2)), f(d2.dot(r));
+		real_type s, t;
+
+		if (a <= kEpsilon && e <= kEpsilon)
+			s = t = 0;
+		else if (a <= kEpsilon) {
+			s = 0;
+			t = clamp01(f / e);
+		} else {
+			const real_type c(d1.dot(r));
+			if (e <= kEpsilon) {
+				t = 0;
+				s = clamp01(-c / a);
+			} else {
+				const real_type b(d1.dot(d2)), denom(a * e - b * b);
+				s = denom > kEpsilon ? clamp01((b * f - c * e) / denom) : 0;
+				t = (b * s + f) / e;
+
+				if (t < 0) {
+					t = 0;
+					s = clamp01(-c / a);
+				} else if (t > 1) {
+					t = 1;
+					s = clamp01((b - c) / a);
+				}
+			}
+		}
+
+		c1 = p1 + d1 * s;
+		c2 = p2 + d2 * t;
+	}
+
+	/*
+	 * The spring force pulling end 0 of every spring in [begin, end) towards end 1. Springs only pull when stretched beyond their maximum distance,
+	 * and are then damped along their direction, as PhysX distance joints are.
+	 */
+	void spring_forces(size_t begin, size_t end, const real_type *dx, const real_type *dy, const real_type *dz, const real_type *dvx, const real_type *dvy, const real_type *dvz,
+			const real_type *stiffness, const real_type *damping, const real_type *max_distance, real_type *fx, real_type *fy, real_type *fz) {
+		size_t i(begin);
+
+#ifdef __AVX2__
+		static_assert(std::is_same<real_type, float>::value, "The AVX2 kernel is written for single precision");
+
+		const __m256 zero(_mm256_setzero_ps()), one(_mm256_set1_ps(1.0f));
+		for (; i + 8 <= end; i += 8) {
+			const __m256 x(_mm256_loadu_ps(dx + i)), y(_mm256_loadu_ps(dy + i)), z(_mm256_loadu_ps(dz + i));
+			const __m256 length(_mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z))));
+			const __m256 stretch(_mm256_sub_ps(length, _mm256_loadu_ps(max_distance + i)));
+			const __m256 stretched(_mm256_cmp_ps(stretch, zero, _CMP_GT_OQ));
+
+			// Lanes that are not stretched may divide by zero, the mask clears them.
+			const __m256 inverse_length(_mm256_div_ps(one, length));
+			const __m256 nx(_mm256_mul_ps(x, inverse_length)), ny(_mm256_mul_ps(y, inverse_length)), nz(_mm256_mul_ps(z, inverse_length));
+			const __m256 velocity(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(dvx + i), nx), _mm256_mul_ps(_mm256_loadu_ps(dvy + i), ny)), _mm256_mul_ps(_mm256_loadu_ps(dvz + i), nz)));
+			const __m256 magnitude(_mm256_and_ps(stretched, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(stiffness + i), stretch), _mm256_mul_ps(_mm256_loadu_ps(damping + i), velocity))));
+
+			_mm256_storeu_ps(fx + i, _mm256_and_ps(stretched, _mm256_mul_ps(magnitude, nx)));
+			_mm256_storeu_ps(fy + i, _mm256_and_ps(stretched, _mm256_mul_ps(magnitude, ny)));
+			_mm256_storeu_ps(fz + i, _mm256_and_ps(stretched, _mm256_mul_ps(magnitude, nz)));
+		}
+#endif /* __AVX2__ */
+
+		for (; i < end; ++i) {
+			const real_type length(std::sqrt(dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]));
+			const real_type stretch(length - max_distance[i]);
+
+			if (stretch > 0) {
+				const real_type nx(dx[i] / length), ny(dy[i] / length), nz(dz[i] / length);
+				const real_type magnitude(stiffness[i] * stretch + damping[i] * (dvx[i] * nx + dvy[i] * ny + dvz[i] * nz));
+				fx[i] = magnitude * nx;
+				fy[i] = magnitude * ny;
+				fz[i] = magnitude * nz;
+			} else
+				fx[i] = fy[i] = fz[i] = 0;
+		}
+	}
+}
+
+spring_network::spring_network(const physics & phys, unsigned int threads) : phys(phys), cell_size(0) {
+	if (threads > 1)
+		pool.reset(new thread_pool(threads));
+}
+
+template<typename FunctorT>
+void spring_network::for_each_range(size_t count, FunctorT functor) {
+	if (!pool || count < kParallelThreshold) {
+		functor(size_t(0), count);
+		return;
+	}
+
+	pool->parallel_for((count + kChunkSize - 1) / kChunkSize, [count, &functor](unsigned int, size_t chunk) {
+		functor(chunk * kChunkSize, std::min(count, (chunk + 1) * kChunkSize));
+	});
+}
+
+void spring_network::load(const std::vector<physics::rigid_body_type *> & rigid_bodies, const std::vector<physics::spring_joint_type *> & springs) {
+	const size_t bodyCount(rigid_bodies.size()), springCount(springs.size());
+
+	bodies = rigid_bodies;
+	for (buffer_type *buffer : { &px, &py, &pz, &qx, &qy, &qz, &qw, &vx, &vy, &vz, &wx, &wy, &wz, &fx, &fy, &fz, &tx, &ty, &tz,
+			&inverse_mass, &ix, &iy, &iz, &mqx, &mqy, &mqz, &mqw, &cmx, &cmy, &cmz, &rest_time, &ccx, &ccy, &ccz, &cax, &cay, &caz, &radius, &half_height })
+		buffer->resize(bodyCount);
+
+	std::unordered_map<const physics::rigid_body_type *, unsigned int> indices(bodyCount);
+	cell_size = 0;
+
+	for (size_t i = 0; i < bodyCount; ++i) {
+		const physics::rigid_body_type & rigid_body(*bodies[i]);
+		const physics::body_state_type state(phys.get_state(rigid_body));
+		const physics::mass_properties_type mass(phys.get_mass_properties(rigid_body));
+		const bool kinematic(phys.is_kinematic(rigid_body));
+		const physics::vec3_type center(state.pose.transform(mass.local_pose.p));
+
+		indices.insert(std::make_pair(&rigid_body, static_cast<unsigned int>(i)));
+
+		px[i] = center.x; py[i] = center.y; pz[i] = center.z;
+		qx[i] = state.pose.q.x; qy[i] = state.pose.q.y; qz[i] = state.pose.q.z; qw[i] = state.pose.q.w;
+		vx[i] = state.linear_velocity.x; vy[i] = state.linear_velocity.y; vz[i] = state.linear_velocity.z;
+		wx[i] = state.angular_velocity.x; wy[i] = state.angular_velocity.y; wz[i] = state.angular_velocity.z;
+
+		inverse_mass[i] = !kinematic && mass.mass > 0 ? 1 / mass.mass : 0;
+		ix[i] = !kinematic && mass.inertia.x > 0 ? 1 / mass.inertia.x : 0;
+		iy[i] = !kinematic && mass.inertia.y > 0 ? 1 / mass.inertia.y : 0;
+		iz[i] = !kinematic && mass.inertia.z > 0 ? 1 / mass.inertia.z : 0;
+		mqx[i] = mass.local_pose.q.x; mqy[i] = mass.local_pose.q.y; mqz[i] = mass.local_pose.q.z; mqw[i] = mass.local_pose.q.w;
+		cmx[i] = mass.local_pose.p.x; cmy[i] = mass.local_pose.p.y; cmz[i] = mass.local_pose.p.z;
+		rest_time[i] = 0;
+
+		physics::transform_type capsule;
+		phys.get_bounding_capsule(rigid_body, capsule, radius[i], half_height[i]);
+		const physics::vec3_type axis(capsule.q.rotate(physics::vec3_type(1, 0, 0)));
+		ccx[i] = capsule.p.x - cmx[i]; ccy[i] = capsule.p.y - cmy[i]; ccz[i] = capsule.p.z - cmz[i];
+		cax[i] = axis.x; cay[i] = axis.y; caz[i] = axis.z;
+
+		cell_size = std::max(cell_size, 2 * (half_height[i] + radius[i]));
+	}
+
+	body0.resize(springCount);
+	body1.resize(springCount);
+	for (buffer_type *buffer : { &l0x, &l0y, &l0z, &l1x, &l1y, &l1z, &stiffness, &damping, &max_distance,
+			&r0x, &r0y, &r0z, &r1x, &r1y, &r1z, &dx, &dy, &dz, &dvx, &dvy, &dvz, &sfx, &sfy, &sfz })
+		buffer->resize(springCount);
+
+	connected_pairs.clear();
+	spring_offsets.assign(bodyCount + 1, 0);
+
+	for (size_t i = 0; i < springCount; ++i) {
+		physics::rigid_body_type *rigid_bodies[2];
+		physics::transform_type frames[2];
+		phys.get_spring_joint_frames(*springs[i], rigid_bodies, frames);
+		phys.get_spring_joint_parameters(*springs[i], stiffness[i], damping[i], max_distance[i]);
+
+		int ends[2];
+		physics::vec3_type points[2];
+		for (int end = 0; end < 2; ++end) {
+			const std::unordered_map<const physics::rigid_body_type *, unsigned int>::const_iterator it(rigid_bodies[end] ? indices.find(rigid_bodies[end]) : indices.end());
+
+			if (it != indices.end()) {
+				ends[end] = int(it->second);
+				points[end] = frames[end].p - physics::vec3_type(cmx[it->second], cmy[it->second], cmz[it->second]);
+				++spring_offsets[it->second + 1];
+			} else {
+				ends[end] = -1;
+				points[end] = rigid_bodies[end] ? phys.get_state(*rigid_bodies[end]).pose.transform(frames[end].p) : frames[end].p;
+			}
+		}
+
+		body0[i] = ends[0];
+		body1[i] = ends[1];
+		l0x[i] = points[0].x; l0y[i] = points[0].y; l0z[i] = points[0].z;
+		l1x[i] = points[1].x; l1y[i] = points[1].y; l1z[i] = points[1].z;
+
+		if (ends[0] >= 0 && ends[1] >= 0 && ends[0] != ends[1])
+			connected_pairs.push_back((static_cast<unsigned long long>(std::min(ends[0], ends[1])) << 32) | static_cast<unsigned long long>(std::max(ends[0], ends[1])));
+	}
+
+	std::sort(connected_pairs.begin(), connected_pairs.end());
+	connected_pairs.erase(std::unique(connected_pairs.begin(), connected_pairs.end()), connected_pairs.end());
+
+	for (size_t i = 0; i < bodyCount; ++i)
+		spring_offsets[i + 1] += spring_offsets[i];
+
+	std::vector<unsigned int> next(spring_offsets.begin(), spring_offsets.end() - 1);
+	spring_ends.resize(spring_offsets.back());
+	for (size_t i = 0; i < springCount; ++i) {
+		if (body0[i] >= 0)
+			spring_ends[next[body0[i]]++] = static_cast<unsigned int>(i * 2);
+		if (body1[i] >= 0)
+			spring_ends[next[body1[i]]++] = static_cast<unsigned int>(i * 2 + 1);
+	}
+}
+
+void spring_network::compute_spring_points(size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i) {
+		real_type p0x(l0x[i]), p0y(l0y[i]), p0z(l0z[i]), v0x(0), v0y(0), v0z(0);
+		real_type p1x(l1x[i]), p1y(l1y[i]), p1z(l1z[i]), v1x(0), v1y(0), v1z(0);
+
+		if (body0[i] >= 0) {
+			const int b(body0[i]);
+			rotate(qx[b], qy[b], qz[b], qw[b], p0x, p0y, p0z);
+			r0x[i] = p0x; r0y[i] = p0y; r0z[i] = p0z;
+			v0x = vx[b] + wy[b] * p0z - wz[b] * p0y;
+			v0y = vy[b] + wz[b] * p0x - wx[b] * p0z;
+			v0z = vz[b] + wx[b] * p0y - wy[b] * p0x;
+			p0x += px[b]; p0y += py[b]; p0z += pz[b];
+		} else
+			r0x[i] = r0y[i] = r0z[i] = 0;
+
+		if (body1[i] >= 0) {
+			const int b(body1[i]);
+			rotate(qx[b], qy[b], qz[b], qw[b], p1x, p1y, p1z);
+			r1x[i] = p1x; r1y[i] = p1y; r1z[i] = p1z;
+			v1x = vx[b] + wy[b] * p1z - wz[b] * p1y;
+			v1y = vy[b] + wz[b] * p1x - wx[b] * p1z;
+			v1z = vz[b] + wx[b] * p1y - wy[b] * p1x;
+			p1x += px[b]; p1y += py[b]; p1z += pz[b];
+		} else
+			r1x[i] = r1y[i] = r1z[i] = 0;
+
+		dx[i] = p1x - p0x; dy[i] = p1y - p0y; dz[i] = p1z - p0z;
+		dvx[i] = v1x - v0x; dvy[i] = v1y - v0y; dvz[i] = v1z - v0z;
+	}
+}
+
+void spring_network::compute_body_forces(size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i) {
+		real_type forceX(0), forceY(0), forceZ(0), torqueX(0), torqueY(0), torqueZ(0);
+
+		for (unsigned int j = spring_offsets[i]; j < spring_offsets[i + 1]; ++j) {
+			const unsigned int spring(spring_ends[j] >> 1);
+			const bool second(spring_ends[j] & 1);
+			const real_type sign(second ? real_type(-1) : real_type(1));
+			const real_type x(sign * sfx[spring]), y(sign * sfy[spring]), z(sign * sfz[spring]);
+			const real_type rx(second ? r1x[spring] : r0x[spring]), ry(second ? r1y[spring] : r0y[spring]), rz(second ? r1z[spring] : r0z[spring]);
+
+			forceX += x; forceY += y; forceZ += z;
+			torqueX += ry * z - rz * y;
+			torqueY += rz * x - rx * z;
+			torqueZ += rx * y - ry * x;
+		}
+
+		fx[i] = forceX; fy[i] = forceY; fz[i] = forceZ;
+		tx[i] = torqueX; ty[i] = torqueY; tz[i] = torqueZ;
+	}
+}
+
+double spring_network::compute_contacts() {
+	const real_type contactStiffness(phys.settings.contact_stiffness);
+	const size_t bodyCount(bodies.size());
+	double energy(0);
+
+	if (contactStiffness <= 0 || bodyCount < 2 || cell_size <= 0)
+		return energy;
+
+	std::vector<physics::vec3_type> centers(bodyCount), axes(bodyCount);
+	cells.resize(bodyCount);
+
+	for (size_t i = 0; i < bodyCount; ++i) {
+		real_type x(ccx[i]), y(ccy[i]), z(ccz[i]), ax(cax[i]), ay(cay[i]), az(caz[i]);
+		rotate(qx[i], qy[i], qz[i], qw[i], x, y, z);
+		rotate(qx[i], qy[i], qz[i], qw[i], ax, ay, az);
+
+		centers[i] = physics::vec3_type(px[i] + x, py[i] + y, pz[i] + z);
+		axes[i] = physics::vec3_type(ax, ay, az) * half_height[i];
+
+		const cell_entry entry = { int(std::floor(centers[i].x / cell_size)), int(std::floor(centers[i].y / cell_size)), int(std::floor(centers[i].z / cell_size)), static_cast<unsigned int>(i) };
+		cells[i] = entry;
+	}
+
+	std::sort(cells.begin(), cells.end());
+
+	// Overlapping capsules are at most cell_size apart, and thus in neighboring cells.
+	for (const cell_entry & entry : cells) {
+		const unsigned int i(entry.body);
+
+		for (int x = entry.x - 1; x <= entry.x + 1; ++x) {
+			for (int y = entry.y - 1; y <= entry.y + 1; ++y) {
+				for (int z = entry.z - 1; z <= entry.z + 1; ++z) {
+					const cell_entry first = { x, y, z, 0 };
+
+					for (std::vector<cell_entry>::const_iterator it(std::lower_bound(cells.begin(), cells.end(), first)); it != cells.end() && it->x == x && it->y == y && it->z == z; ++it) {
+						const unsigned int j(it->body);
+						if (j <= i || std::binary_search(connected_pairs.begin(), connected_pairs.end(), (static_cast<unsigned long long>(i) << 32) | j))
+							continue;
+
+						physics::vec3_type ci, cj;
+						closest_points(centers[i] - axes[i], axes[i] * 2, centers[j] - axes[j], axes[j] * 2, ci, cj);
+
+						const physics::vec3_type delta(cj - ci);
+						const real_type distance(delta.magnitude()), penetration(radius[i] + radius[j] - distance);
+						if (penetration <= 0 || distance <= 0)
+							continue;
+
+						energy += 0.5 * contactStiffness * penetration * penetration;
+
+						const physics::vec3_type force(delta * (contactStiffness * penetration / distance));
+						const physics::vec3_type armI(ci - physics::vec3_type(px[i], py[i], pz[i])), armJ(cj - physics::vec3_type(px[j], py[j], pz[j]));
+						const physics::vec3_type torqueI(armI.cross(-force)), torqueJ(armJ.cross(force));
+
+						fx[i] -= force.x; fy[i] -= force.y; fz[i] -= force.z;
+						fx[j] += force.x; fy[j] += force.y; fz[j] += force.z;
+						tx[i] += torqueI.x; ty[i] += torqueI.y; tz[i] += torqueI.z;
+						tx[j] += torqueJ.x; ty[j] += torqueJ.y; tz[j] += torqueJ.z;
+					}
+				}
+			}
+		}
+	}
+
+	return energy;
+}
+
+void spring_network::integrate(size_t begin, size_t end, real_type timestep) {
+	const real_type linearDamping(1 / (1 + timestep * kLinearDamping)), angularDamping(1 / (1 + timestep * kAngularDamping));
+	const real_type sleepThreshold(phys.settings.kRigidBodySleepThreshold);
+
+	for (size_t i = begin; i < end; ++i) {
+		if (inverse_mass[i] == 0)
+			continue;
+
+		vx[i] = (vx[i] + timestep * inverse_mass[i] * fx[i]) * linearDamping;
+		vy[i] = (vy[i] + timestep * inverse_mass[i] * fy[i]) * linearDamping;
+		vz[i] = (vz[i] + timestep * inverse_mass[i] * fz[i]) * linearDamping;
+		px[i] += timestep * vx[i];
+		py[i] += timestep * vy[i];
+		pz[i] += timestep * vz[i];
+
+		// Angular velocity and torque in the principal frame, where the inertia is diagonal.
+		const real_type frameW(qw[i] * mqw[i] - qx[i] * mqx[i] - qy[i] * mqy[i] - qz[i] * mqz[i]);
+		const real_type frameX(qw[i] * mqx[i] + qx[i] * mqw[i] + qy[i] * mqz[i] - qz[i] * mqy[i]);
+		const real_type frameY(qw[i] * mqy[i] - qx[i] * mqz[i] + qy[i] * mqw[i] + qz[i] * mqx[i]);
+		const real_type frameZ(qw[i] * mqz[i] + qx[i] * mqy[i] - qy[i] * mqx[i] + qz[i] * mqw[i]);
+
+		real_type torqueX(tx[i]), torqueY(ty[i]), torqueZ(tz[i]), angularX(wx[i]), angularY(wy[i]), angularZ(wz[i]);
+		rotate_inverse(frameX, frameY, frameZ, frameW, torqueX, torqueY, torqueZ);
+		rotate_inverse(frameX, frameY, frameZ, frameW, angularX, angularY, angularZ);
+
+		angularX = (angularX + timestep * ix[i] * torqueX) * angularDamping;
+		angularY = (angularY + timestep * iy[i] * torqueY) * angularDamping;
+		angularZ = (angularZ + timestep * iz[i] * torqueZ) * angularDamping;
+
+		const real_type angularSpeed(std::sqrt(angularX * angularX + angularY * angularY + angularZ * angularZ));
+		if (angularSpeed > kMaxAngularVelocity) {
+			const real_type scale(kMaxAngularVelocity / angularSpeed);
+			angularX *= scale;
+			angularY *= scale;
+			angularZ *= scale;
+		}
+
+		const real_type rotational((ix[i] > 0 ? angularX * angularX / ix[i] : 0) + (iy[i] > 0 ? angularY * angularY / iy[i] : 0) + (iz[i] > 0 ? angularZ * angularZ / iz[i] : 0));
+		const real_type kineticEnergy(real_type(0.5) * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i] + rotational * inverse_mass[i]));
+		rest_time[i] = kineticEnergy < sleepThreshold ? rest_time[i] + timestep : 0;
+
+		rotate(frameX, frameY, frameZ, frameW, angularX, angularY, angularZ);
+		wx[i] = angularX;
+		wy[i] = angularY;
+		wz[i] = angularZ;
+
+		// q += dt / 2 * (w, 0) * q
+		const real_type h(real_type(0.5) * timestep);
+		const real_type x(qx[i] + h * (wx[i] * qw[i] + wy[i] * qz[i] - wz[i] * qy[i]));
+		const real_type y(qy[i] + h * (wy[i] * qw[i] + wz[i] * qx[i] - wx[i] * qz[i]));
+		const real_type z(qz[i] + h * (wz[i] * qw[i] + wx[i] * qy[i] - wy[i] * qx[i]));
+		const real_type w(qw[i] - h * (wx[i] * qx[i] + wy[i] * qy[i] + wz[i] * qz[i]));
+		const real_type inverse_norm(1 / std::sqrt(x * x + y * y + z * z + w * w));
+
+		qx[i] = x * inverse_norm;
+		qy[i] = y * inverse_norm;
+		qz[i] = z * inverse_norm;
+		qw[i] = w * inverse_norm;
+	}
+}
+
+void spring_network::step(real_type timestep) {
+	const size_t bodyCount(bodies.size()), springCount(body0.size());
+
+	for_each_range(springCount, [this](size_t begin, size_t end) {
+		compute_spring_points(begin, end);
+		spring_forces(begin, end, dx.data(), dy.data(), dz.data(), dvx.data(), dvy.data(), dvz.data(), stiffness.data(), damping.data(), max_distance.data(), sfx.data(), sfy.data(), sfz.data());
+	});
+	for_each_range(bodyCount, [this](size_t begin, size_t end) { compute_body_forces(begin, end); });
+	compute_contacts();
+	for_each_range(bodyCount, [this, timestep](size_t begin, size_t end) { integrate(begin, end, timestep); });
+}
+
+double spring_network::evaluate() {
+	const size_t bodyCount(bodies.size()), springCount(body0.size());
+
+	for_each_range(springCount, [this](size_t begin, size_t end) {
+		compute_spring_points(begin, end);
+		spring_forces(begin, end, dx.data(), dy.data(), dz.data(), dvx.data(), dvy.data(), dvz.data(), stiffness.data(), damping.data(), max_distance.data(), sfx.data(), sfy.data(), sfz.data());
+	});
+	for_each_range(bodyCount, [this](size_t begin, size_t end) { compute_body_forces(begin, end); });
+
+	double energy(compute_contacts());
+	for (size_t i = 0; i < springCount; ++i) {
+		const double stretch(std::sqrt(double(dx[i]) * dx[i] + double(dy[i]) * dy[i] + double(dz[i]) * dz[i]) - max_distance[i]);
+		if (stretch > 0)
+			energy += 0.5 * stiffness[i] * stretch * stretch;
+	}
+
+	return energy;
+}
+
+void spring_network::displace(double step, const std::vector<double> & direction) {
+	for (size_t i = 0; i < bodies.size(); ++i) {
+		const double *d(&direction[i * 6]);
+
+		px[i] = real_type(spx[i] + step * d[0]);
+		py[i] = real_type(spy[i] + step * d[1]);
+		pz[i] = real_type(spz[i] + step * d[2]);
+
+		// q = exp(step * d / 2) * saved q
+		const double rx(step * d[3]), ry(step * d[4]), rz(step * d[5]);
+		const double angle(std::sqrt(rx * rx + ry * ry + rz * rz));
+		const double s(angle > 1e-12 ? std::sin(angle / 2) / angle : 0.5), c(std::cos(angle / 2));
+		const double ax(s * rx), ay(s * ry), az(s * rz);
+
+		const double x(c * sqx[i] + ax * sqw[i] + ay * sqz[i] - az * sqy[i]);
+		const double y(c * sqy[i] - ax * sqz[i] + ay * sqw[i] + az * sqx[i]);
+		const double z(c * sqz[i] + ax * sqy[i] - ay * sqx[i] + az * sqw[i]);
+		const double w(c * sqw[i] - ax * sqx[i] - ay * sqy[i] - az * sqz[i]);
+		const double inverse_norm(1 / std::sqrt(x * x + y * y + z * z + w * w));
+
+		qx[i] = real_type(x * inverse_norm);
+		qy[i] = real_type(y * inverse_norm);
+		qz[i] = real_type(z * inverse_norm);
+		qw[i] = real_type(w * inverse_norm);
+	}
+}
+
+unsigned int spring_network::minimize(unsigned int max_iterations, real_type gradient_tolerance, const std::function<bool()> & running, physics::Minimization & outcome) {
+	const size_t bodyCount(bodies.size()), size(bodyCount * 6);
+
+	for (buffer_type *buffer : { &vx, &vy, &vz, &wx, &wy, &wz })
+		std::fill(buffer->begin(), buffer->end(), real_type(0));
+	for (buffer_type *buffer : { &spx, &spy, &spz, &sqx, &sqy, &sqz, &sqw })
+		buffer->resize(bodyCount);
+
+	gradient.resize(size);
+	previous_gradient.resize(size);
+	direction.resize(size);
+	preconditioner.resize(size);
+	history_steps.resize(kHistory);
+	history_gradients.resize(kHistory);
+	history_rho.resize(kHistory);
+	history_alpha.resize(kHistory);
+
+	double energy(evaluate());
+
+	/*
+	 * The inverse of an estimate of the diagonal of the Hessian: The stiffness of the springs attached to a body, times the squared arm for rotations.
+	 * Kinematic bodies get zeros and are never moved.
+	 */
+	for (size_t i = 0; i < bodyCount; ++i) {
+		double translation(0), rotation(0);
+		for (unsigned int j = spring_offsets[i]; j < spring_offsets[i + 1]; ++j) {
+			const unsigned int spring(spring_ends[j] >> 1);
+			const bool second(spring_ends[j] & 1);
+			const double rx(second ? r1x[spring] : r0x[spring]), ry(second ? r1y[spring] : r0y[spring]), rz(second ? r1z[spring] : r0z[spring]);
+
+			translation += stiffness[spring];
+			rotation += stiffness[spring] * (rx * rx + ry * ry + rz * rz);
+		}
+
+		const double fallback(phys.settings.contact_stiffness > 0 ? 1 / double(phys.settings.contact_stiffness) : 0);
+		for (int j = 0; j < 3; ++j) {
+			preconditioner[i * 6 + j] = inverse_mass[i] == 0 ? 0 : (translation > 0 ? 1 / translation : fallback);
+			preconditioner[i * 6 + 3 + j] = inverse_mass[i] == 0 ? 0 : (rotation > 0 ? 1 / rotation : fallback);
+		}
+	}
+
+	const auto gather_gradient([this, bodyCount]() {
+		double maximum(0);
+		for (size_t i = 0; i < bodyCount; ++i) {
+			const real_type *values[6] = { &fx[i], &fy[i], &fz[i], &tx[i], &ty[i], &tz[i] };
+			for (int j = 0; j < 6; ++j) {
+				gradient[i * 6 + j] = inverse_mass[i] == 0 ? 0.0 : -double(*values[j]);
+				maximum = std::max(maximum, std::abs(gradient[i * 6 + j]));
+			}
+		}
+		return maximum;
+	});
+
+	double maximumGradient(gather_gradient());
+
+	/*
+	 * Single precision poses stop lowering the energy once the largest force has come down to a few thousandths of the force scale of the network,
+	 * that of a spring of average stiffness holding an equal share of the energy, which is often above gradient_tolerance. A stall below kStallGradient of it is the minimum.
+	 */
+	double meanStiffness(0);
+	for (real_type value : stiffness)
+		meanStiffness += value;
+	const size_t springCount(body0.size());
+	if (springCount > 0)
+		meanStiffness /= double(springCount);
+
+	const auto at_minimum([gradient_tolerance, meanStiffness, springCount](double largest, double at_energy) {
+		return largest <= gradient_tolerance || (springCount > 0 && largest <= kStallGradient * std::sqrt(2 * std::max(at_energy, 0.0) * meanStiffness / double(springCount)));
+	});
+
+	size_t historyCount(0), historyNewest(0);
+	unsigned int iteration(0);
+	outcome = physics::kIterationCap;
+
+	for (; iteration < max_iterations; ++iteration) {
+		if (maximumGradient <= gradient_tolerance) {
+			outcome = physics::kMinimum;
+			break;
+		}
+
+		if (!running()) {
+			outcome = physics::kStopped;
+			break;
+		}
+
+		// Two loop recursion, with the scaled preconditioner as the initial inverse Hessian.
+		direction = gradient;
+		for (size_t k = 0; k < historyCount; ++k) {
+			const size_t index((historyNewest + kHistory - k) % kHistory);
+			history_alpha[index] = history_rho[index] * dot(history_steps[index], direction);
+			for (size_t j = 0; j < size; ++j)
+				direction[j] -= history_alpha[index] * history_gradients[index][j];
+		}
+
+		double scale(1);
+		if (historyCount > 0) {
+			const std::vector<double> & y(history_gradients[historyNewest]);
+			double yDy(0);
+			for (size_t j = 0; j < size; ++j)
+				yDy += y[j] * preconditioner[j] * y[j];
+			scale = yDy > 0 ? 1 / (history_rho[historyNewest] * yDy) : 1;
+		}
+
+		for (size_t j = 0; j < size; ++j)
+			direction[j] *= scale * preconditioner[j];
+
+		for (size_t k = historyCount; k-- > 0;) {
+			const size_t index((historyNewest + kHistory - k) % kHistory);
+			const double beta(history_rho[index] * dot(history_gradients[index], direction));
+			for (size_t j = 0; j < size; ++j)
+				direction[j] += history_steps[index][j] * (history_alpha[index] - beta);
+		}
+
+		for (double & value : direction)
+			value = -value;
+
+		double slope(dot(gradient, direction));
+		if (slope >= 0) {
+			// Not a descent direction, start over from the preconditioned gradient.
+			historyCount = 0;
+			for (size_t j = 0; j < size; ++j)
+				direction[j] = -preconditioner[j] * gradient[j];
+			slope = dot(gradient, direction);
+		}
+
+		double largest(0);
+		for (double value : direction)
+			largest = std::max(largest, std::abs(value));
+		if (largest == 0) {
+			outcome = physics::kMinimum;
+			break;
+		}
+
+		spx = px; spy = py; spz = pz;
+		sqx = qx; sqy = qy; sqz = qz; sqw = qw;
+		previous_gradient = gradient;
+
+		// Backtracking line search on the Armijo condition.
+		double step(std::min(1.0, (historyCount > 0 ? kMaxDisplacement : kInitialDisplacement) / largest)), newEnergy(energy);
+		unsigned int backtracks(0);
+		for (; backtracks < kMaxBacktracks; ++backtracks, step /= 2) {
+			displace(step, direction);
+			newEnergy = evaluate();
+			if (newEnergy <= energy + kArmijo * step * slope)
+				break;
+		}
+
+		if (backtracks == kMaxBacktracks) {
+			// The energy can not be lowered any further at this precision.
+			displace(0, direction);
+			evaluate();
+			outcome = at_minimum(maximumGradient, energy) ? physics::kMinimum : physics::kStalled;
+			break;
+		}
+
+		const bool stalled(energy - newEnergy <= kStall * std::abs(energy));
+		energy = newEnergy;
+		maximumGradient = gather_gradient();
+
+		// Pairs without positive curvature would break the positive definiteness of the approximation, and are skipped.
+		double sy(0);
+		for (size_t j = 0; j < size; ++j)
+			sy += step * direction[j] * (gradient[j] - previous_gradient[j]);
+
+		if (sy > 1e-12) {
+			historyNewest = historyCount > 0 ? (historyNewest + 1) % kHistory : 0;
+			historyCount = std::min(historyCount + 1, kHistory);
+			history_rho[historyNewest] = 1 / sy;
+
+			std::vector<double> & s(history_steps[historyNewest]), & y(history_gradients[historyNewest]);
+			s.resize(size);
+			y.resize(size);
+			for (size_t j = 0; j < size; ++j) {
+				s[j] = step * direction[j];
+				y[j] = gradient[j] - previous_gradient[j];
+			}
+		}
+
+		if (stalled) {
+			outcome = at_minimum(maximumGradient, energy) ? physics::kMinimum : physics::kStalled;
+			++iteration;
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < bodyCount; ++i)
+		rest_time[i] = kWakeTime;
+
+	return iteration;
+}
+
+void spring_network::store() const {
+	for (size_t i = 0; i < bodies.size(); ++i) {
+		if (inverse_mass[i] == 0)
+			continue;
+
+		const physics::quaternion_type orientation(qx[i], qy[i], qz[i], qw[i]);
+		const physics::transform_type pose(physics::vec3_type(px[i], py[i], pz[i]) - orientation.rotate(physics::vec3_type(cmx[i], cmy[i], cmz[i])), orientation);
+
+		if (rest_time[i] >= kWakeTime)
+			phys.put_to_sleep(*bodies[i], pose);
+		else {
+			const physics::body_state_type state = { pose, physics::vec3_type(vx[i], vy[i], vz[i]), physics::vec3_type(wx[i], wy[i], wz[i]) };
+			phys.set_state(*bodies[i], state);
+		}
+	}
+}
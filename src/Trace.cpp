@@ -0,0 +1,198 @@
+#include <Trace.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif /* _WINDOWS */
+
+namespace trace {
+	bool enabled = false;
+
+	namespace {
+		enum Process {
+			kRectification = 1,
+			kPhysX = 2
+		};
+
+		struct event_type {
+			unsigned int name;
+			char phase; // 'X' for a span, 'B' and 'E' for the start and stop of a PhysX zone.
+			Process process;
+			unsigned int thread;
+			unsigned long long timestamp, duration;
+		};
+
+		std::mutex mutex;
+		std::vector<event_type> events;
+		std::vector<std::string> names;
+		std::unordered_map<std::string, unsigned int> name_indices;
+		std::unordered_map<std::thread::id, unsigned int> threads; // Numbered in order of appearance.
+
+		// With the mutex locked.
+		unsigned int intern(const char *name) {
+			const std::pair<std::unordered_map<std::string, unsigned int>::iterator, bool> result(name_indices.insert(std::make_pair(std::string(name ? name : "unknown"), static_cast<unsigned int>(names.size()))));
+			if (result.second)
+				names.push_back(result.first->first);
+			return result.first->second;
+		}
+
+		inline void add(const event_type & event) {
+			std::lock_guard<std::mutex> lock(mutex);
+			events.push_back(event);
+		}
+
+		void append_escaped(std::string & out, const std::string & str) {
+			for (char c : str) {
+				if (c == '"' || c == '\\')
+					out += '\\';
+				if ((unsigned char) c >= 0x20)
+					out += c;
+			}
+		}
+	}
+
+	unsigned long long now() {
+#ifdef _WINDOWS
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return unsigned long long(counter.QuadPart);
+#else
+		struct timespec time;
+		clock_gettime(CLOCK_REALTIME, &time);
+		return (unsigned long long) time.tv_sec * 1000000000ull + (unsigned long long) time.tv_nsec;
+#endif /* _WINDOWS */
+	}
+
+	unsigned long long frequency() {
+#ifdef _WINDOWS
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return unsigned long long(frequency.QuadPart);
+#else
+		return 1000000000ull;
+#endif /* _WINDOWS */
+	}
+
+	void span(const char *name, unsigned long long begin, unsigned long long end) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		const std::pair<std::unordered_map<std::thread::id, unsigned int>::iterator, bool> thread(threads.insert(std::make_pair(std::this_thread::get_id(), static_cast<unsigned int>(threads.size() + 1))));
+		const event_type event = { intern(name), 'X', kRectification, thread.first->second, begin, end > begin ? end - begin : 0 };
+		events.push_back(event);
+	}
+
+	bool write(const std::string & filename) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		unsigned long long origin(~0ull);
+		for (const event_type & event : events)
+			origin = std::min(origin, event.timestamp);
+
+		const double microseconds(1e6 / double(frequency()));
+		char buffer[160];
+
+		std::string out("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"rectification\"}},\n";
+		out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"PhysX\"}}";
+
+		for (const event_type & event : events) {
+			out += ",\n{\"name\":\"";
+			append_escaped(out, names[event.name]);
+
+			if (event.phase == 'X')
+				snprintf(buffer, sizeof(buffer), "\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", int(event.process), event.thread, (event.timestamp - origin) * microseconds, event.duration * microseconds);
+			else
+				snprintf(buffer, sizeof(buffer), "\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f}", event.phase, int(event.process), event.thread, (event.timestamp - origin) * microseconds);
+			out += buffer;
+		}
+
+		out += "\n]}\n";
+
+		std::ofstream file(filename, std::ios::binary);
+		file.write(out.data(), out.size());
+
+		if (!file) {
+			std::cerr << "Failed to write trace \"" << filename << "\"" << std::endl;
+			return false;
+		}
+
+		std::cerr << "Trace of " << events.size() << " events written to \"" << filename << "\"" << std::endl;
+		return true;
+	}
+
+#ifndef WITHOUT_PHYSX
+	zone_recorder::zone_recorder(physx::PxProfileZoneManager & manager) : manager(manager) {
+		manager.addProfileZoneHandler(*this); // Reports the zones that already exist.
+	}
+
+	zone_recorder::~zone_recorder() {
+		manager.flushProfileEvents();
+		manager.removeProfileZoneHandler(*this);
+
+		for (zone_client *client : clients) {
+			client->zone.removeClient(*client);
+			delete client;
+		}
+	}
+
+	void zone_recorder::onZoneAdded(physx::PxProfileZone & zone) {
+		clients.push_back(new zone_client(zone));
+		zone.addClient(*clients.back());
+	}
+
+	void zone_recorder::onZoneRemoved(physx::PxProfileZone & zone) {
+		for (std::vector<zone_client *>::iterator it(clients.begin()); it != clients.end(); ++it) {
+			if (&(*it)->zone == &zone) {
+				zone.removeClient(**it);
+				delete *it;
+				clients.erase(it);
+				return;
+			}
+		}
+	}
+
+	void zone_recorder::zone_client::handleEventAdded(const physx::PxProfileEventName & name) {
+		std::lock_guard<std::mutex> lock(mutex);
+		event_names[name.mEventId.mEventId] = intern(name.mName);
+	}
+
+	void zone_recorder::zone_client::handleBufferFlush(const physx::PxU8 *data, physx::PxU32 length) {
+		physx::PxProfileEventHandler::parseEventBuffer(data, length, *this, false);
+	}
+
+	void zone_recorder::zone_client::onStartEvent(const physx::PxProfileEventId & id, physx::PxU32 threadId, physx::PxU64, physx::PxU8, physx::PxU8, physx::PxU64 timestamp) {
+		const event_type event = { name(id), 'B', kPhysX, threadId, timestamp, 0 };
+		add(event);
+	}
+
+	void zone_recorder::zone_client::onStopEvent(const physx::PxProfileEventId & id, physx::PxU32 threadId, physx::PxU64, physx::PxU8, physx::PxU8, physx::PxU64 timestamp) {
+		const event_type event = { name(id), 'E', kPhysX, threadId, timestamp, 0 };
+		add(event);
+	}
+
+	unsigned int zone_recorder::zone_client::name(const physx::PxProfileEventId & id) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		const std::unordered_map<physx::PxU16, unsigned int>::const_iterator it(event_names.find(id.mEventId));
+		if (it != event_names.end())
+			return it->second;
+
+		// Events registered before the client was added are only known by the zone.
+		const physx::PxProfileNames zone_names(zone.getProfileNames());
+		for (physx::PxU32 i = 0; i < zone_names.mEventCount; ++i) {
+			if (zone_names.mEvents[i].mEventId.mEventId == id.mEventId)
+				return event_names[id.mEventId] = intern(zone_names.mEvents[i].mName);
+		}
+
+		return event_names[id.mEventId] = intern(NULL);
+	}
+#endif /* N WITHOUT_PHYSX */
+}
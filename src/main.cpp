@@ -1,125 +1,337 @@
 #include <Definition.h>
 #include <DNA.h>
+#include <Metrics.h>
 #include <Utility.h>
+#include <Batch.h>
+#include <Checkpoint.h>
+#include <Optimizer.h>
+#include <Profiler.h>
 #include <ParseSettings.h>
+#include <Relaxation.h>
 #include <Scene.h>
 #include <SimulatedAnnealing.h>
+#include <ThreadPool.h>
+#include <Trace.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include <Physics.h>
 
+volatile bool running = true;
+
+void handle_exit() {
+	running = false;
+}
+
+std::mutex message_mutex;
+
 /*
- * Increases/decreases the base counts of individual helices with min(minbasecount, basecount + [ -baserange, baserange ]), and evaluates the new energy level of the system by simulated annealing.
+ * A line of the messages of a job, written to std::cerr as a whole when destroyed, so that lines of concurrent jobs do not interleave.
  */
-template<typename StoreBestFunctorT, typename RunningFunctorT>
-void simulated_annealing(scene & mesh, physics & phys, int kmax, float emax, unsigned int minbasecount, int baserange,
-		StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
-
-	int modifiedHelix, previousBaseCount;
-	physics::transform_type previousTransform;
-
-	scene::HelixContainer & helices(mesh.getHelices());
-	const scene::HelixContainer::size_type helixCount(helices.size());
-
-	simulated_annealing(mesh,
-		[](scene & mesh) { return mesh.getTotalSeparation(); },
-		[&helixCount](float k) { return float(std::max(0., (exp(-k) - 1 / M_E) / (1 - 1 / M_E))) * helixCount; },
-		[&modifiedHelix, &helices, &helixCount, &previousBaseCount, &previousTransform, &phys, &minbasecount, &baserange, &running_functor](scene & mesh) {
-			for (Helix & helix : helices)
-				helix.setTransform(helix.getInitialTransform());
-
-			modifiedHelix = rand() % helixCount;
-			Helix & helix(helices[modifiedHelix]);
-			previousBaseCount = helix.getBaseCount();
-			previousTransform = helix.getTransform();
-
-			helix.recreateRigidBody(
-				phys, std::max(minbasecount, helix.getInitialBaseCount() + (rand() % 2 * 2 - 1) * (1 + rand() % (baserange))), helix.getInitialTransform());
-
-			while (!mesh.isSleeping() && running_functor()) {
-				phys.scene->simulate(1.0f / 60.0f);
-				phys.scene->fetchResults(true);
-			}
-		},
-		probability_functor<float, float>(),
-		[&modifiedHelix, &helices, &previousBaseCount, &previousTransform, &phys](scene & mesh) {
-			Helix & helix(helices[modifiedHelix]);
-			helix.recreateRigidBody(phys, previousBaseCount, helix.getInitialTransform());
-		},
-		store_best_functor,
-		running_functor,
-		kmax, emax);
+class message_line {
+public:
+	inline explicit message_line(const std::string & prefix) {
+		buffer << prefix;
+	}
+
+	inline ~message_line() {
+		buffer << '\n';
+		std::lock_guard<std::mutex> lock(message_mutex);
+		std::cerr << buffer.str();
+		std::cerr.flush();
+	}
+
+	template<typename T>
+	inline message_line & operator<<(const T & value) {
+		buffer << value;
+		return *this;
+	}
+
+private:
+	std::ostringstream buffer;
+};
+
+/*
+ * Checks that a checkpoint was written by the optimizer selected, for a design with as many helices as mesh.
+ */
+bool validate_checkpoint(const checkpoint_type & checkpoint, const scene & mesh, const optimizer::settings_type & optimizer_settings, std::string & message) {
+	const unsigned int chainCount(optimizer_settings.chains);
+
+	if (optimizer_settings.algorithm != optimizer::kGradientDescent) {
+		message = std::string("Checkpoints are not supported by ") + optimizer::algorithm_name(optimizer_settings.algorithm);
+		return false;
+	}
+
+	if (checkpoint.optimizer != (chainCount > 0 ? checkpoint_type::kParallelTempering : checkpoint_type::kGradientDescent)) {
+		message = "Checkpoint was written by another optimizer";
+		return false;
+	}
+
+	if (checkpoint.best.getHelixCount() != mesh.getHelixCount()) {
+		message = "Checkpoint belongs to another design";
+		return false;
+	}
+
+	if (checkpoint.chains.size() != chainCount) {
+		message = "Checkpoint has another number of chains";
+		return false;
+	}
+
+	std::vector<bool> temperatures(chainCount, false);
+	for (const checkpoint_type::chain_type & chain : checkpoint.chains) {
+		if (chain.bases.size() != mesh.getHelixCount() || chain.temperature >= chainCount || temperatures[chain.temperature]) {
+			message = "Checkpoint is corrupt";
+			return false;
+		}
+
+		temperatures[chain.temperature] = true;
+	}
+
+	return true;
 }
 
 /*
- * Simple gradient descent implementation: Energy lower? Choose it, if not don't.
+ * Reads the design in input_file into the empty scene of phys, rectifies it and writes the result to output_file. Every message is prefixed by prefix.
+ * Checkpoints are written to output_file with .checkpoint appended. Unless empty, the optimization continues from the checkpoint in resume_file.
+ * Progress is reported to progress, which the caller finishes.
  */
-template<typename StoreBestFunctorT, typename RunningFunctorT>
-void gradient_descent(scene & mesh, physics & phys, int minbasecount, StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
-	scene::HelixContainer & helices(mesh.getHelices());
+batch::summary_type rectify(physics & phys, const scene::settings_type & scene_settings, const Helix::settings_type & helix_settings, const relaxation & relax, const optimizer::settings_type & optimizer_settings,
+		const std::string & input_file, const std::string & output_file, const std::string & resume_file, metrics::reporter & progress, const std::string & prefix) {
+	const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
 
-	while (!mesh.isSleeping() && running_functor()) {
-		phys.scene->simulate(1.0f / 60.0f);
-		phys.scene->fetchResults(true);
+	batch::summary_type summary;
+	summary.status = batch::summary_type::kFailed;
+	summary.helices = 0;
+	summary.initial_total = summary.min = summary.max = summary.average = summary.total = 0;
+	summary.seconds = 0;
+
+	scene mesh(scene_settings, helix_settings);
+
+	try {
+		if (!mesh.read(phys, input_file)) {
+			summary.message = "Failed to read scene";
+			message_line(prefix) << "Failed to read scene \"" << input_file << "\"";
+			return summary;
+		}
+	}
+	catch (const std::runtime_error & e) {
+		summary.message = std::string("Failed to read scene: ") + e.what();
+		message_line(prefix) << "Failed to read scene \"" << input_file << "\": " << e.what();
+		return summary;
 	}
 
-	//physics::real_type separation(mesh.getTotalSeparation());
-	physics::real_type min, max, average, total;
-	mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
-	store_best_functor(mesh, min, max, average, total);
+	physics::real_type initialmin, initialmax, initialaverage, initialtotal, min, max, average, total;
+	mesh.getTotalSeparationMinMaxAverage(initialmin, initialmax, initialaverage, initialtotal);
 
-	for (Helix & helix : helices) {
-		for (int i = 0; i < 2; ++i) {
-			if (!running_functor())
-				return;
+	message_line(prefix) << "Running simulation for scene loaded from \"" << input_file << " outputting to " << output_file << "\".";
+	message_line(prefix) << "Initial: min: " << initialmin << ", max: " << initialmax << ", average: " << initialaverage << ", total: " << initialtotal << " nm";
 
-			helix.recreateRigidBody(phys, std::max(minbasecount, int(helix.getInitialBaseCount() + (i * 2 - 1))), helix.getInitialTransform());
+	SceneDescription best_scene;
 
-			while (!mesh.isSleeping() && running_functor()) {
-				phys.scene->simulate(1.0f / 60.0f);
-				phys.scene->fetchResults(true);
-			}
+	checkpoint_type checkpoint;
+	checkpointer checkpoints(output_file + ".checkpoint", optimizer_settings.checkpoint_interval);
+
+	if (!resume_file.empty()) {
+		if (!checkpointer::load(resume_file, checkpoint)) {
+			summary.message = "Failed to read checkpoint";
+			message_line(prefix) << "Failed to read checkpoint \"" << resume_file << "\"";
+			return summary;
+		}
+
+		if (!validate_checkpoint(checkpoint, mesh, optimizer_settings, summary.message)) {
+			message_line(prefix) << summary.message << ": \"" << resume_file << "\"";
+			return summary;
+		}
+
+		best_scene = SceneDescription(checkpoint.best);
+		min = checkpoint.min;
+		max = checkpoint.max;
+		average = checkpoint.average;
+		total = checkpoint.total;
+		checkpoints.setResume(&checkpoint);
+		progress.best(min, max, average, total);
+
+		message_line(prefix) << "Resuming from \"" << resume_file << "\" at " << checkpoint.position << ", total: " << total << " nm";
+	}
+
+	const auto store_best_functor([&best_scene, &min, &max, &average, &total, &prefix, &progress](scene & mesh, physics::real_type min_, physics::real_type max_, physics::real_type average_, physics::real_type total_) { min = min_; max = max_; average = average_; total = total_; message_line(prefix) << "State: min: " << min << ", max: " << max << ", average: " << average << " total: " << total << " nm"; best_scene = SceneDescription(mesh); progress.best(min, max, average, total); });
+	const auto running_functor([&progress]() { progress.poll(); return running; });
 
-			//const physics::real_type newseparation(mesh.getTotalSeparation());
-			physics::real_type newtotal;
-			mesh.getTotalSeparationMinMaxAverage(min, max, average, newtotal);
+	optimizer::optimize(mesh, phys, relax, optimizer_settings, 7, checkpoints, store_best_functor, running_functor);
 
-			if (newtotal < total) {
-				total = newtotal;
-				store_best_functor(mesh, min, max, average, total);
-			} else
-				helix.recreateRigidBody(phys, helix.getInitialBaseCount(), helix.getInitialTransform());
+	message_line(prefix) << "Result: min: " << min << ", max: " << max << ", average: " << average << ", total: " << total << " nm";
 
-			for (Helix & helix : helices)
-				helix.setTransform(helix.getInitialTransform());
+	summary.status = running ? batch::summary_type::kSucceeded : batch::summary_type::kInterrupted;
+	summary.helices = mesh.getHelixCount();
+	summary.initial_total = initialtotal;
+	summary.min = min;
+	summary.max = max;
+	summary.average = average;
+	summary.total = total;
+
+	profiler::scoped_timer output_timer(profiler::kOutput);
+
+	if (ends_with(output_file, ".rpolyb")) {
+		std::ofstream outfile(output_file, std::ios::binary);
+
+		if (!best_scene.write_binary(outfile)) {
+			summary.status = batch::summary_type::kFailed;
+			summary.message = "Failed to write resulting mesh";
+			message_line(prefix) << "Failed to write resulting mesh to \"" << output_file << "\"";
+		}
+	} else {
+		std::ofstream outfile(output_file);
+		outfile << "# Relaxation of original " << input_file << " file. " << mesh.getHelixCount() << " helices." << std::endl
+			<< "# Total separation: Initial: min: " << initialmin << ", max: " << initialmax << ", average: " << initialaverage << ", total: " << initialtotal << " nm" << ", final: min: " << min << ", max: " << max << ", average: " << average << ", total: " << total << " nm" << std::endl;
+
+		if (!best_scene.write(outfile)) {
+			summary.status = batch::summary_type::kFailed;
+			summary.message = "Failed to write resulting mesh";
+			message_line(prefix) << "Failed to write resulting mesh to \"" << output_file << "\"";
 		}
+
+		outfile.close();
 	}
+
+	output_timer.stop();
+
+	// A finished optimization has nothing to continue.
+	if (summary.status == batch::summary_type::kSucceeded && checkpoints.isEnabled())
+		std::remove((output_file + ".checkpoint").c_str());
+
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return summary;
 }
 
-volatile bool running = true;
+void print_statistics(const relaxation::statistics_type & statistics, const configuration_cache::statistics_type & cache_statistics) {
+	std::cerr << "Relaxations: " << statistics.relaxations << ", steps: " << statistics.steps << " (average: " << (statistics.relaxations > 0 ? double(statistics.steps) / statistics.relaxations : 0.0) << ", max: " << statistics.max_steps << ")"
+		<< ", asleep: " << statistics.outcomes[relaxation::kAsleep] << ", converged: " << statistics.outcomes[relaxation::kConverged]
+		<< ", capped: " << statistics.outcomes[relaxation::kCapped] << ", interrupted: " << statistics.outcomes[relaxation::kInterrupted] << ", stalled: " << statistics.outcomes[relaxation::kStalled] << std::endl;
 
-void handle_exit() {
-	running = false;
+	if (cache_statistics.hits + cache_statistics.misses > 0)
+		std::cerr << "Cache: hits: " << cache_statistics.hits << ", misses: " << cache_statistics.misses << ", evictions: " << cache_statistics.evictions << ", size: " << cache_statistics.size << std::endl;
 }
 
 /*
- * Does a simple rectification of the structure without modification.
+ * Runs every job of the manifest, batch_settings.jobs at a time. The SDK is created once and every job simulates in a scene of its own.
+ * Every job also has a relaxation of its own, so that neither its cache nor its statistics mix with those of other structures.
  */
-template<typename RunningFunctorT>
-SceneDescription simulated_rectification(scene & mesh, physics & phys, RunningFunctorT running_functor) {
-	while (!mesh.isSleeping() && running_functor()) {
-		phys.scene->simulate(1.0f / 60.0f);
-		phys.scene->fetchResults(true);
+int rectify_batch(const physics::settings_type & physics_settings, const scene::settings_type & scene_settings, const Helix::settings_type & helix_settings, const relaxation::settings_type & relaxation_settings,
+		const optimizer::settings_type & optimizer_settings, const batch::settings_type & batch_settings, metrics::stream & metrics_stream) {
+	std::vector<batch::job_type> jobs;
+
+	{
+		std::ifstream manifest(batch_settings.manifest);
+		if (!batch::read_manifest(manifest, jobs)) {
+			std::cerr << "Failed to read manifest \"" << batch_settings.manifest << "\"" << std::endl;
+			return 1;
+		}
+	}
+
+	if (jobs.empty()) {
+		std::cerr << "No jobs in manifest \"" << batch_settings.manifest << "\"" << std::endl;
+		return 1;
+	}
+
+	const unsigned int in_flight(static_cast<unsigned int>(std::min(size_t(batch_settings.jobs == 0 ? numcpucores() : batch_settings.jobs), jobs.size())));
+
+	physics phys(physics_settings);
+	std::mutex sdk_mutex;
+
+	batch::summary_type interrupted;
+	interrupted.status = batch::summary_type::kInterrupted;
+	interrupted.helices = 0;
+	interrupted.initial_total = interrupted.min = interrupted.max = interrupted.average = interrupted.total = 0;
+	interrupted.seconds = 0;
+
+	std::vector<batch::summary_type> summaries(jobs.size(), interrupted);
+
+	// Of all jobs, for the statistics printed at exit.
+	std::mutex statistics_mutex;
+	relaxation::statistics_type statistics = relaxation::statistics_type();
+	configuration_cache::statistics_type cache_statistics = configuration_cache::statistics_type();
+
+	std::cerr << "Running " << jobs.size() << " jobs from \"" << batch_settings.manifest << "\", " << in_flight << " at a time." << std::endl
+		<< "Connect with NVIDIA PhysX Visual Debugger to " << PVD_HOST << ':' << PVD_PORT << " to visualize the progress. " << std::endl
+		<< "Press ^C to stop the relaxations...." << std::endl;
+
+	setinterrupthandler<handle_exit>();
+
+	{
+		thread_pool pool(in_flight);
+		pool.parallel_for(jobs.size(), [&](unsigned int worker, size_t index) {
+			if (!running)
+				return;
+
+			std::unique_ptr<physics> job_phys;
+			{
+				// Scene creation goes through the shared SDK.
+				std::lock_guard<std::mutex> lock(sdk_mutex);
+				job_phys.reset(new physics(phys, std::max(1u, numcpucores() / in_flight)));
+			}
+
+			std::stringstream prefix;
+			prefix << '[' << jobs[index].input_file << "] ";
+
+			// Jobs stopped by an earlier run continue from their checkpoints.
+			const std::string checkpoint_file(jobs[index].output_file + ".checkpoint");
+			const bool resume(optimizer_settings.checkpoint_interval > 0 && std::ifstream(checkpoint_file).good());
+
+			const relaxation relax(relaxation_settings);
+			metrics::reporter progress(metrics_stream, relax, jobs[index].input_file);
+			summaries[index] = rectify(*job_phys, scene_settings, helix_settings, relax, optimizer_settings, jobs[index].input_file, jobs[index].output_file, resume ? checkpoint_file : std::string(), progress, prefix.str());
+			progress.finish(batch::status_name(summaries[index].status));
+
+			const relaxation::statistics_type job_statistics(relax.getStatistics());
+			const configuration_cache::statistics_type job_cache_statistics(relax.getCacheStatistics());
+
+			std::lock_guard<std::mutex> lock(statistics_mutex);
+			statistics.relaxations += job_statistics.relaxations;
+			statistics.steps += job_statistics.steps;
+			statistics.max_steps = std::max(statistics.max_steps, job_statistics.max_steps);
+			for (int i = 0; i < relaxation::kOutcomeCount; ++i)
+				statistics.outcomes[i] += job_statistics.outcomes[i];
+
+			cache_statistics.hits += job_cache_statistics.hits;
+			cache_statistics.misses += job_cache_statistics.misses;
+			cache_statistics.evictions += job_cache_statistics.evictions;
+			cache_statistics.size += job_cache_statistics.size;
+		});
 	}
 
-	return SceneDescription(mesh);
+	print_statistics(statistics, cache_statistics);
+
+	if (profiler::enabled)
+		profiler::report(std::cerr);
+
+	const std::string summary_file(batch_settings.summary.empty() ? batch_settings.manifest + ".summary" : batch_settings.summary);
+	{
+		std::ofstream outfile(summary_file);
+		batch::write_summary(outfile, jobs, summaries);
+
+		if (!outfile)
+			std::cerr << "Failed to write summary to \"" << summary_file << "\"" << std::endl;
+	}
+
+	size_t counts[3] = { 0, 0, 0 };
+	for (const batch::summary_type & summary : summaries)
+		++counts[summary.status];
+
+	std::cerr << "Jobs: succeeded: " << counts[batch::summary_type::kSucceeded] << ", failed: " << counts[batch::summary_type::kFailed] << ", interrupted: " << counts[batch::summary_type::kInterrupted]
+		<< ". Summary written to \"" << summary_file << "\"." << std::endl;
+
+	return counts[batch::summary_type::kFailed] > 0 ? 1 : 0;
 }
 
 int main(int argc, const char **argv) {
@@ -128,67 +340,97 @@ int main(int argc, const char **argv) {
 	physics::settings_type physics_settings;
 	scene::settings_type scene_settings;
 	Helix::settings_type helix_settings;
+	relaxation::settings_type relaxation_settings;
+	optimizer::settings_type optimizer_settings;
+	batch::settings_type batch_settings;
+	metrics::settings_type metrics_settings;
+	profiler::settings_type profiler_settings;
+	trace::settings_type trace_settings;
 
 	std::string input_file, output_file;
-	parse_settings::parse(argc, argv, physics_settings, scene_settings, helix_settings, input_file, output_file);
+	parse_settings::parse(argc, argv, physics_settings, scene_settings, helix_settings, relaxation_settings, optimizer_settings, batch_settings, metrics_settings, profiler_settings, trace_settings, input_file, output_file);
+	profiler::enabled = profiler_settings.enabled;
+	trace::enabled = !trace_settings.filename.empty();
 
-	if (input_file.empty() || output_file.empty() || argc < 3) {
+	if (optimizer_settings.seed != 0)
+		srand(optimizer_settings.seed);
+
+	if ((batch_settings.manifest.empty() && (input_file.empty() || output_file.empty())) || argc < 2) {
 		std::cerr << parse_settings::usage(argv[0]) << std::endl;
 		return 0;
 	}
 
-	scene mesh(scene_settings, helix_settings);
-	physics phys(physics_settings);
+	if (optimizer_settings.algorithm == optimizer::kUnknownAlgorithm) {
+		std::cerr << "Unknown optimizer, use --optimizer=gradient_descent, simulated_annealing or simulated_rectification" << std::endl;
+		return 1;
+	}
 
-	try {
-		if (!mesh.read(phys, input_file)) {
-			std::cerr << "Failed to read scene \"" << input_file << "\"" << std::endl;
+#ifdef WITHOUT_PHYSX
+	if (physics_settings.engine == physics::kPhysX) {
+		std::cerr << "Built without PhysX, use --engine=native or --engine=minimizer" << std::endl;
+		return 1;
+	}
+#endif /* N WITHOUT_PHYSX */
+
+	// Conversion of a binary result to the text format.
+	if (ends_with(input_file, ".rpolyb")) {
+		SceneDescription description;
+		std::ifstream infile(input_file, std::ios::binary);
+		if (!description.read_binary(infile)) {
+			std::cerr << "Failed to read \"" << input_file << "\"" << std::endl;
 			return 1;
 		}
-	}
-	catch (const std::runtime_error & e) {
-		std::cerr << "Failed to read scene \"" << input_file << "\": " << e.what() << std::endl;
-		return 1;
+
+		std::ofstream outfile(output_file);
+		outfile << "# Conversion of " << input_file << ". " << description.getHelixCount() << " helices." << std::endl;
+		if (!description.write(outfile)) {
+			std::cerr << "Failed to write \"" << output_file << "\"" << std::endl;
+			return 1;
+		}
+
+		return 0;
 	}
 
-	physics::real_type initialmin, initialmax, initialaverage, initialtotal, min, max, average, total;
-	mesh.getTotalSeparationMinMaxAverage(initialmin, initialmax, initialaverage, initialtotal);
+	metrics::stream metrics_stream(metrics_settings);
 
-	std::cerr << "Running simulation for scene loaded from \"" << input_file << " outputting to " << output_file << "\"." << std::endl
-		<< "Initial: min: " << initialmin << ", max: " << initialmax << ", average: " << initialaverage << ", total: " << initialtotal << " nm" << std::endl
-		<< "Connect with NVIDIA PhysX Visual Debugger to " << PVD_HOST << ':' << PVD_PORT << " to visualize the progress. " << std::endl
-		<< "Press ^C to stop the relaxation...." << std::endl;
+	if (!batch_settings.manifest.empty()) {
+		const int status(rectify_batch(physics_settings, scene_settings, helix_settings, relaxation_settings, optimizer_settings, batch_settings, metrics_stream));
 
-	setinterrupthandler<handle_exit>();
+		if (trace::enabled)
+			trace::write(trace_settings.filename);
 
-	SceneDescription best_scene;
-#if 0
-	best_scene = simulated_rectification(mesh, phys, []() { return running; });
-#else
-#if 0
-	simulated_annealing(mesh, phys, 100, 0, 7, 1,
-		[&best_scene](scene & mesh, float e) { std::cerr << "Store best energy: " << e << std::endl; best_scene = SceneDescription(mesh); },
-		[]() { return running; });
-#else
-	gradient_descent(mesh, phys, 7,
-		[&best_scene, &min, &max, &average, &total](scene & mesh, physics::real_type min_, physics::real_type max_, physics::real_type average_, physics::real_type total_) { min = min_; max = max_; average = average_; total = total_; std::cerr << "State: min: " << min << ", max: " << max << ", average: " << average << " total: " << total << " nm" << std::endl; best_scene = SceneDescription(mesh); },
-		[]() { return running; });
-#endif
-#endif
-
-	std::cerr << "Result: min: " << min << ", max: " << max << ", average: " << average << ", total: " << total << " nm" << std::endl;
+		sleepms(2000);
+		return status;
+	}
+
+	const relaxation relax(relaxation_settings);
+	batch::summary_type summary;
 
+	// The PhysX profile zones are flushed to the trace when the SDK is released.
 	{
-		std::ofstream outfile(output_file);
-		outfile << "# Relaxation of original " << input_file << " file. " << mesh.getHelixCount() << " helices." << std::endl
-			<< "# Total separation: Initial: min: " << initialmin << ", max: " << initialmax << ", average: " << initialaverage << ", total: " << initialtotal << " nm" << ", final: min: " << min << ", max: " << max << ", average: " << average << ", total: " << total << " nm" << std::endl;
+		physics phys(physics_settings);
 
-		if (!best_scene.write(outfile))
-			std::cerr << "Failed to write resulting mesh to \"" << output_file << "\"" << std::endl;
+		std::cerr << "Connect with NVIDIA PhysX Visual Debugger to " << PVD_HOST << ':' << PVD_PORT << " to visualize the progress. " << std::endl
+			<< "Press ^C to stop the relaxation...." << std::endl;
 
-		outfile.close();
+		setinterrupthandler<handle_exit>();
+
+		metrics::reporter progress(metrics_stream, relax, input_file);
+		summary = rectify(phys, scene_settings, helix_settings, relax, optimizer_settings, input_file, output_file, optimizer_settings.resume, progress, std::string());
+		progress.finish(batch::status_name(summary.status));
 	}
 
+	if (trace::enabled)
+		trace::write(trace_settings.filename);
+
+	if (summary.status == batch::summary_type::kFailed && summary.helices == 0)
+		return 1;
+
+	print_statistics(relax.getStatistics(), relax.getCacheStatistics());
+
+	if (profiler::enabled)
+		profiler::report(std::cerr);
+
 	sleepms(2000);
 
 	return 0;